@@ -29,6 +29,12 @@ export FLEXMALLOC_LOCATIONS=${2}
 set_LD_PRELOAD="LD_PRELOAD=${FLEXMALLOC_HOME}/lib/${library}.so"
 runner="env ${set_LD_PRELOAD}"
 
+# Let the dynamic loader report module loads/unloads to flexmalloc
+if [[ ${FLEXMALLOC_RTLD_AUDIT} != "0" ]] && [[ ${FLEXMALLOC_RTLD_AUDIT} != "disabled" ]] && [[ ${FLEXMALLOC_RTLD_AUDIT} != "no" ]] ; then
+	set_LD_AUDIT="LD_AUDIT=${FLEXMALLOC_HOME}/lib/libflexmalloc_audit.so"
+	runner="${runner} ${set_LD_AUDIT}"
+fi
+
 mpi_rank="${PMIX_RANK}"
 if [[ -z "${mpi_rank}" ]]; then
 	mpi_rank="${PMI_RANK}"
@@ -52,7 +58,7 @@ if [[ "${mpi_rank}" == "0" || "${mpi_rank}" == "" ]] ; then
 		cat >$tmp_gdb <<EOF
 set environment FLEXMALLOC_DEFINITIONS ${1}
 set environment FLEXMALLOC_LOCATIONS ${2}
-set exec-wrapper env '${set_LD_PRELOAD}'
+set exec-wrapper env '${set_LD_PRELOAD}' ${set_LD_AUDIT:+'${set_LD_AUDIT}'}
 EOF
 		case "${FLEXMALLOC_GDB}" in
 			1|enabled|yes)
@@ -0,0 +1,429 @@
+// License: To determine
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <new>
+
+#include "common.hxx"
+#include "allocator-arena.hxx"
+
+Arena::Arena (allocation_functions_t &af, void *base, size_t size, const char *label)
+  : _af(af), _base ((char*) base), _size (size), _in_use (0), _in_use_hwm (0),
+    _untouched ((uintptr_t) base)
+{
+	snprintf (_label, sizeof(_label), "%s", label);
+	pthread_mutex_init (&_mtx, nullptr);
+
+	_free = (extent_t*) _af.malloc (sizeof(extent_t));
+	assert (_free != nullptr);
+	_free->start = (uintptr_t) _base;
+	_free->length = _size;
+	_free->next = nullptr;
+}
+
+Arena::~Arena ()
+{
+}
+
+// First-fit search in the free extents
+void * Arena::alloc (size_t length, size_t *dirty)
+{
+	void *res = nullptr;
+	length = round (length);
+
+	pthread_mutex_lock (&_mtx);
+	extent_t *prev = nullptr;
+	for (extent_t *e = _free; e != nullptr; prev = e, e = e->next)
+		if (e->length >= length)
+		{
+			res = (void*) e->start;
+			if (dirty != nullptr)
+				*dirty = e->start < _untouched ? MIN(length, _untouched - e->start) : 0;
+			_untouched = MAX(_untouched, e->start + length);
+			e->start += length;
+			e->length -= length;
+			if (e->length == 0)
+			{
+				if (prev != nullptr)
+					prev->next = e->next;
+				else
+					_free = e->next;
+				_af.free (e);
+			}
+			_in_use += length;
+			_in_use_hwm = MAX(_in_use_hwm, _in_use);
+			break;
+		}
+	pthread_mutex_unlock (&_mtx);
+
+	return res;
+}
+
+// Gives back an extent, merging it with the adjacent free extents
+void Arena::release (void *start, size_t length)
+{
+	uintptr_t s = (uintptr_t) start;
+
+	pthread_mutex_lock (&_mtx);
+	extent_t *prev = nullptr, *next = _free;
+	while (next != nullptr && next->start < s)
+	{
+		prev = next;
+		next = next->next;
+	}
+
+	_in_use -= length;
+	if (prev != nullptr && prev->start + prev->length == s)
+	{
+		prev->length += length;
+		if (next != nullptr && prev->start + prev->length == next->start)
+		{
+			prev->length += next->length;
+			prev->next = next->next;
+			_af.free (next);
+		}
+	}
+	else if (next != nullptr && s + length == next->start)
+	{
+		next->start = s;
+		next->length += length;
+	}
+	else
+	{
+		extent_t *e = (extent_t*) _af.malloc (sizeof(extent_t));
+		assert (e != nullptr);
+		e->start = s;
+		e->length = length;
+		e->next = next;
+		if (prev != nullptr)
+			prev->next = e;
+		else
+			_free = e;
+	}
+	pthread_mutex_unlock (&_mtx);
+}
+
+// Grows an extent in place if it is followed by enough free space
+bool Arena::extend (void *start, size_t length, size_t new_length)
+{
+	bool res = false;
+	uintptr_t end = (uintptr_t) start + length;
+	size_t delta = new_length - length;
+
+	pthread_mutex_lock (&_mtx);
+	extent_t *prev = nullptr;
+	for (extent_t *e = _free; e != nullptr && e->start <= end; prev = e, e = e->next)
+		if (e->start == end && e->length >= delta)
+		{
+			_untouched = MAX(_untouched, e->start + delta);
+			e->start += delta;
+			e->length -= delta;
+			if (e->length == 0)
+			{
+				if (prev != nullptr)
+					prev->next = e->next;
+				else
+					_free = e->next;
+				_af.free (e);
+			}
+			_in_use += delta;
+			_in_use_hwm = MAX(_in_use_hwm, _in_use);
+			res = true;
+			break;
+		}
+	pthread_mutex_unlock (&_mtx);
+
+	return res;
+}
+
+void Arena::show_statistics (const char *allocator_name) const
+{
+	VERBOSE_MSG(1, "%s: Arena %s at %p with %lu MBytes, high-water mark of %lu bytes in use, %lu bytes still in use.\n",
+	  allocator_name, _label, _base, _size >> 20, _in_use_hwm, _in_use);
+}
+
+AllocatorArena::AllocatorArena (allocation_functions_t &af)
+  : Allocator (af), _narenas (0), _nfallback (0), _charged (0)
+{
+}
+
+AllocatorArena::~AllocatorArena ()
+{
+}
+
+bool AllocatorArena::add_arena (void *base, size_t size, const char *label)
+{
+	if (_narenas >= MAX_ARENAS)
+		return false;
+
+	Arena *a = (Arena*) _af.malloc (sizeof(Arena));
+	assert (a != nullptr);
+	_arenas[_narenas++] = new (a) Arena (const_cast<allocation_functions_t&>(_af), base, size, label);
+	return true;
+}
+
+Arena * AllocatorArena::arena_of (const void *p) const
+{
+	for (unsigned u = 0; u < _narenas; ++u)
+		if (_arenas[u]->contains (p))
+			return _arenas[u];
+	return nullptr;
+}
+
+// Returns total bytes from the arenas (starting from the preferred one) or,
+// if they are exhausted, from the regular posix calls. If dirty is given,
+// it receives how many leading bytes may be non-zero, and memory from the
+// posix calls is then obtained zeroed.
+void * AllocatorArena::alloc_extent (size_t total, size_t *dirty)
+{
+	void *baseptr = nullptr;
+	if (_narenas > 0)
+	{
+		unsigned first = preferred_arena ();
+		for (unsigned u = 0; u < _narenas && baseptr == nullptr; ++u)
+			baseptr = _arenas[(first + u) % _narenas]->alloc (total, dirty);
+	}
+	if (baseptr == nullptr)
+	{
+		VERBOSE_MSG(3, "%s: Arenas exhausted, allocating %lu bytes through posix calls\n", name(), total);
+		if (dirty != nullptr)
+			*dirty = 0;
+		baseptr = dirty != nullptr ? _af.calloc (1, total) : _af.malloc (total);
+		__sync_fetch_and_add (&_nfallback, 1);
+	}
+	return baseptr;
+}
+
+void * AllocatorArena::malloc (size_t size)
+{
+	void * baseptr = alloc_extent (Allocator::getTotalSize (size));
+	void * res = nullptr;
+
+	// If malloc succeded, then forge a header and the pointer points to the
+	// data space after the header
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeader (baseptr, this, size);
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, "%s: Allocated %lu bytes in %p (hdr & base at %p) w/ allocator %s (%p)\n", name(), size, res, Allocator::getAllocatorHeader (res), name(), this);
+		_stats.record_malloc (size);
+	}
+
+	return res;
+}
+
+void * AllocatorArena::calloc (size_t nmemb, size_t size)
+{
+	size_t dirty;
+	void * baseptr = alloc_extent (Allocator::getTotalSize (nmemb * size), &dirty);
+	void * res = nullptr;
+
+	// If malloc succeded, then forge a header and the pointer points to the
+	// data space after the header
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeader (baseptr, this, nmemb * size);
+		// Only the part of the extent that was handed out before needs clearing
+		uintptr_t dirty_end = (uintptr_t) baseptr + dirty;
+		if (dirty_end > (uintptr_t) res)
+			::memset (res, 0, MIN(nmemb * size, dirty_end - (uintptr_t) res));
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, "%s: Allocated %lu bytes in %p (hdr & base %p) w/ allocator %s (%p)\n", name(), size, res, Allocator::getAllocatorHeader (res), name(), this);
+		_stats.record_calloc (nmemb * size);
+	}
+
+	return res;
+}
+
+int AllocatorArena::posix_memalign (void **ptr, size_t align, size_t size)
+{
+	assert (ptr != nullptr);
+
+	void * baseptr = alloc_extent (Allocator::getTotalSize (size + align));
+	void * res = nullptr;
+
+	// If malloc succeded, then forge a header and the pointer points to the
+	// data space after the header
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
+
+		// The extent only keeps up to the end of the object, which is what
+		// free gives back, and the rest of the alignment slack is returned
+		Arena *a = arena_of (baseptr);
+		if (a != nullptr)
+		{
+			size_t total = Arena::round (Allocator::getTotalSize (size + align));
+			size_t length = Arena::length (Allocator::getAllocatorHeader (res), res);
+			if (length < total)
+				a->release ((char*) baseptr + length, total - length);
+		}
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, "%s: Allocated %lu bytes in %p (hdr %p, base %p) w/ allocator %s (%p)\n", name(), size, res, Allocator::getAllocatorHeader (res), baseptr, name(), this);
+		_stats.record_aligned_malloc (size + align);
+
+		*ptr = res;
+		return 0;
+	}
+	else
+		return ENOMEM;
+}
+
+void AllocatorArena::free (void *ptr)
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+
+	// When freeing the memory, need to free the base pointe
+	VERBOSE_MSG(3, "%s: Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", name(), ptr, hdr, hdr->size(), hdr->base_ptr());
+
+	_stats.record_free (hdr->size());
+	void *base = hdr->base_ptr();
+	size_t length = Arena::length (hdr, ptr);
+	Allocator::releaseAllocatorHeader (ptr);
+	Arena *a = arena_of (base);
+	if (a != nullptr)
+		a->release (base, length);
+	else
+		_af.free (base);
+}
+
+void * AllocatorArena::realloc (void *ptr, size_t size)
+{
+	// If previous pointer is not null, behave normally. otherwise, behave like a malloc but
+	// without calling information
+	if (ptr)
+	{
+		// Search for previous allocation size through the header
+		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
+		size_t prev_size = prev_hdr->size();
+		void * prev_baseptr = prev_hdr->base_ptr();
+		uintptr_t extra_size = Allocator::getExtraSize (prev_hdr);
+
+		if (prev_size < size)
+		{
+			void *res = nullptr;
+			Arena *a = arena_of (prev_baseptr);
+
+			if (a != nullptr)
+			{
+				size_t length = Arena::length (prev_hdr, ptr);
+				size_t new_length = Arena::span ((uintptr_t) ptr - (uintptr_t) prev_baseptr + size);
+
+				if (new_length == length || a->extend (prev_baseptr, length, new_length))
+				{
+					prev_hdr->size (size);
+					res = ptr;
+				}
+				else if ((res = this->malloc (size)) != nullptr)
+				{
+					this->memcpy (res, ptr, prev_size);
+					this->free (ptr);
+				}
+			}
+			else
+			{
+				// Reallocate, from base pointer to fit the new size plus a new header
+				void *new_baseptr = _af.realloc (prev_baseptr, Allocator::getTotalSize (size + extra_size));
+				if (new_baseptr)
+				{
+					res = Allocator::generateAllocatorHeader (new_baseptr, extra_size, this, size);
+					if (res != ptr)
+						Allocator::releaseAllocatorHeader (ptr);
+				}
+			}
+			DBG("Reallocated (%ld->%ld [extra bytes = %lu]) from %p (base at %p, header at %p) into %p w/ allocator %s (%p)\n", prev_size, size, extra_size, ptr, prev_baseptr, prev_hdr, res, name(), this);
+
+			_stats.record_realloc (size, prev_size);
+
+			return res;
+		}
+		else if (Allocator::shrinks (prev_size, size))
+		{
+			void *res = ptr;
+			Arena *a = arena_of (prev_baseptr);
+
+			// The tail of the extent goes back to the arena, where it can serve
+			// other objects
+			if (a != nullptr)
+			{
+				size_t length = Arena::length (prev_hdr, ptr);
+				size_t new_length = Arena::span ((uintptr_t) ptr - (uintptr_t) prev_baseptr + size);
+				if (new_length < length)
+					a->release ((char*) prev_baseptr + new_length, length - new_length);
+				prev_hdr->size (size);
+			}
+			else
+			{
+				void *new_baseptr = _af.realloc (prev_baseptr, Allocator::getTotalSize (size + extra_size));
+				if (new_baseptr == nullptr)
+					return ptr;
+				res = Allocator::generateAllocatorHeader (new_baseptr, extra_size, this, size);
+				if (res != ptr)
+					Allocator::releaseAllocatorHeader (ptr);
+			}
+			DBG("Shrunk (%ld->%ld [extra bytes = %lu]) from %p (base at %p, header at %p) into %p w/ allocator %s (%p)\n", prev_size, size, extra_size, ptr, prev_baseptr, prev_hdr, res, name(), this);
+
+			_stats.record_shrink_realloc (size, prev_size);
+
+			return res;
+		}
+		else
+		{
+			DBG("Reallocated (%ld->%ld) from %p but not touching as new size is smaller w/ allocator %s (%p)\n", prev_size, size, ptr, name(), this);
+			return ptr;
+		}
+	}
+	else
+	{
+		VERBOSE_MSG(3, "%s: realloc (NULL, ...) forwarded to malloc\n", name());
+		_stats.record_realloc_forward_malloc();
+
+		return this->malloc (size);
+	}
+}
+
+size_t AllocatorArena::malloc_usable_size (void *ptr)
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+
+	// When checking for the usable size, return the size we requested originally, no matter
+	// what the underlying library did. This may alter execution behaviors, though.
+	VERBOSE_MSG(3, "%s: Checking usable size on pointer %p w/ size - %lu (but base pointer located in %p)\n",
+	  name(), ptr, hdr->size(), hdr->base_ptr());
+
+	return hdr->size();
+}
+
+void AllocatorArena::show_statistics (void) const
+{
+	_stats.show_statistics (name(), true);
+	for (unsigned u = 0; u < _narenas; ++u)
+		_arenas[u]->show_statistics (name());
+	VERBOSE_MSG(1, "%s: %llu allocations served through posix calls.\n", name(), _nfallback);
+}
+
+// Room left in the arenas, minus the capacity charged for memory placed
+// elsewhere on their behalf
+size_t AllocatorArena::available (void) const
+{
+	size_t total = 0;
+	for (unsigned u = 0; u < _narenas; ++u)
+		total += _arenas[u]->available();
+	return total > _charged ? total - _charged : 0;
+}
+
+// Objects are only placed here if some arena has room for them
+bool AllocatorArena::fits (size_t s) const
+{
+	if (available() < Allocator::getTotalSize (s))
+		return false;
+	for (unsigned u = 0; u < _narenas; ++u)
+		if (_arenas[u]->available() >= Allocator::getTotalSize (s))
+			return true;
+	return false;
+}
@@ -0,0 +1,136 @@
+// License: To determine
+
+#pragma once
+
+#include <pthread.h>
+#include <string.h>
+
+#include "allocator.hxx"
+
+// A contiguous memory region (e.g. mmap-ed with specific flags or memory
+// policy) from which objects are carved. Free extents are kept sorted by
+// address and coalesced when released. The region is expected to be freshly
+// mapped, so that the part never handed out is known to be zero.
+class Arena
+{
+	private:
+	static const size_t GRANULE = 64; // allocation granularity
+
+	typedef struct extent_st
+	{
+		uintptr_t start;
+		size_t length;
+		struct extent_st *next;
+	} extent_t;
+
+	const allocation_functions_t _af;
+	char * const _base;
+	const size_t _size;
+	char _label[64];
+
+	pthread_mutex_t _mtx;  // protects the fields below
+	extent_t *_free;
+	size_t _in_use;
+	size_t _in_use_hwm;
+	uintptr_t _untouched; // start of the part never handed out
+
+	public:
+	Arena (allocation_functions_t &, void *base, size_t size, const char *label);
+	~Arena ();
+
+	static size_t round (size_t length)
+	  { return (length + GRANULE - 1) & ~(GRANULE - 1); }
+	// Length of the extent of an object that ends end bytes past the start
+	// of the extent. Objects of size 0 without a header still take a granule.
+	static size_t span (size_t end)
+	  { return round (end > 0 ? end : 1); }
+	// Length of the extent holding ptr, which starts at hdr->base_ptr().
+	// Allocations keep exactly this length, so that it is what is released.
+	static size_t length (const Allocator::Header_t *hdr, const void *ptr)
+	  { return span ((uintptr_t) ptr - (uintptr_t) hdr->base_ptr() + hdr->size()); }
+
+	bool contains (const void *p) const
+	  { return (uintptr_t) p - (uintptr_t) _base < _size; }
+	size_t available (void) const
+	  { return _size - _in_use; }
+	void * base (void) const
+	  { return _base; }
+	size_t size (void) const
+	  { return _size; }
+
+	// dirty, if given, receives how many leading bytes of the extent may
+	// have been written since the region was mapped
+	void * alloc (size_t length, size_t *dirty = nullptr);
+	void release (void *start, size_t length);
+	bool extend (void *start, size_t length, size_t new_length);
+	void show_statistics (const char *allocator_name) const;
+};
+
+// Base for the allocators that place the objects in one or more arenas.
+// When the arenas are exhausted, objects are served through the regular
+// posix calls instead.
+class AllocatorArena : public Allocator
+{
+	protected:
+	static const unsigned MAX_ARENAS = 64;
+
+	AllocatorStatistics _stats;
+	Arena * _arenas[MAX_ARENAS];
+	unsigned _narenas;
+	unsigned long long _nfallback;
+	size_t _charged;
+
+	bool add_arena (void *base, size_t size, const char *label);
+	// Index of the arena to try first, the others are tried afterwards
+	virtual unsigned preferred_arena (void) const
+	  { return 0; }
+
+	private:
+	Arena * arena_of (const void *p) const;
+	void * alloc_extent (size_t total, size_t *dirty = nullptr);
+
+	public:
+	AllocatorArena (allocation_functions_t &);
+	virtual ~AllocatorArena ();
+
+	void*  malloc (size_t);
+	void*  calloc (size_t, size_t);
+	int    posix_memalign (void **, size_t, size_t);
+	void   free (void *);
+	void*  realloc (void *, size_t);
+	size_t malloc_usable_size (void*);
+
+	void show_statistics (void) const;
+
+	void *memcpy (void *dest, const void *src, size_t n)
+	  { return ::memcpy (dest, src, n); }
+
+	bool fits (size_t s) const;
+	size_t available (void) const;
+	bool owns_pages (void *ptr)
+	  { return arena_of (Allocator::getAllocatorHeader (ptr)->base_ptr()) != nullptr; }
+	void charge (size_t s)
+	  { __sync_fetch_and_add (&_charged, s); }
+	void discharge (size_t s)
+	  { __sync_fetch_and_sub (&_charged, s); }
+	size_t hwm (void) const
+	  { return _stats.water_mark(); }
+	void record_unfitted_malloc (size_t s)
+	  { _stats.record_unfitted_malloc (s); } ;
+	void record_unfitted_calloc (size_t s)
+	  { _stats.record_unfitted_calloc (s); } ;
+	void record_unfitted_aligned_malloc (size_t s)
+	  { _stats.record_unfitted_aligned_malloc (s); } ;
+	void record_unfitted_realloc (size_t s)
+	  { _stats.record_unfitted_realloc (s); } ;
+
+	void record_source_realloc (size_t s)
+	  { _stats.record_source_realloc (s); };
+	void record_target_realloc (size_t s)
+	  { _stats.record_target_realloc (s); };
+	void record_self_realloc (size_t s)
+	  { _stats.record_self_realloc (s); };
+
+	void record_realloc_forward_malloc (void)
+	  { _stats.record_realloc_forward_malloc (); }
+};
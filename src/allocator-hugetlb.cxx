@@ -0,0 +1,126 @@
+// License: To determine
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "common.hxx"
+#include "allocator-hugetlb.hxx"
+
+#define ALLOCATOR_NAME "hugetlb"
+
+#ifndef MAP_HUGE_SHIFT
+# define MAP_HUGE_SHIFT 26
+#endif
+
+// Macro to align an address to the nearest power of two
+#ifndef align_to
+# define align_to(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
+#endif
+
+AllocatorHugeTLB::AllocatorHugeTLB (allocation_functions_t &af)
+  : AllocatorArena (af), _page_size (2UL << 20)
+{
+}
+
+AllocatorHugeTLB::~AllocatorHugeTLB ()
+{
+}
+
+void AllocatorHugeTLB::configure (const char *config)
+{
+	const char * MEMORYCONFIG_SIZE = "Size ";
+	const char * MEMORYCONFIG_MBYTES_SUFFIX = " MBytes";
+	const char * MEMORYCONFIG_PAGES = " Pages ";
+
+	if (strncmp (config, MEMORYCONFIG_SIZE, strlen(MEMORYCONFIG_SIZE)) == 0)
+	{
+		// Get given size after the Size marker
+		char *pEnd = nullptr;
+		long long s_size = strtoll (&config[strlen(MEMORYCONFIG_SIZE)], &pEnd, 10);
+		// Was text converted into s? If so, now look for suffix
+		if (pEnd != &config[strlen(MEMORYCONFIG_SIZE)])
+		{
+			if (strncmp (pEnd, MEMORYCONFIG_MBYTES_SUFFIX, strlen(MEMORYCONFIG_MBYTES_SUFFIX)) == 0)
+			{
+				size_t s;
+				if (s_size < 0)
+				{
+					VERBOSE_MSG(1, ALLOCATOR_NAME": Invalid given size.\n");
+					exit (1);
+				}
+				else
+					s = s_size;
+				VERBOSE_MSG(1, ALLOCATOR_NAME": Setting up size %lu MBytes.\n", s);
+				size (s << 20);
+
+				// Optionally followed by the huge page size
+				pEnd += strlen(MEMORYCONFIG_MBYTES_SUFFIX);
+				if (strncmp (pEnd, MEMORYCONFIG_PAGES, strlen(MEMORYCONFIG_PAGES)) == 0)
+				{
+					pEnd += strlen(MEMORYCONFIG_PAGES);
+					if (strcmp (pEnd, "2M") == 0)
+						_page_size = 2UL << 20;
+					else if (strcmp (pEnd, "1G") == 0)
+						_page_size = 1UL << 30;
+					else
+					{
+						VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid page size. Available page sizes are 2M and 1G.\n");
+						exit (1);
+					}
+				}
+				else if (*pEnd != '\0')
+				{
+					VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid page size specification.\n");
+					exit (1);
+				}
+			}
+			else
+			{
+				VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid size suffix.\n");
+				exit (1);
+			}
+		}
+		else
+		{
+			VERBOSE_MSG(0, ALLOCATOR_NAME": Could not parse given size.\n");
+			exit (1);
+		}
+	}
+	else
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Wrong configuration for the allocator. Available options include:\n"
+		               " Size <NUM> MBytes [Pages 2M|1G]\n");
+		exit (1);
+	}
+
+	// Reserve the huge pages now, so the pool cannot run out later on
+	size_t region_size = align_to (this->size(), _page_size);
+	int page_shift = __builtin_ctzl (_page_size);
+	void *p = mmap (nullptr, region_size, PROT_READ|PROT_WRITE,
+	  MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(page_shift << MAP_HUGE_SHIFT), -1, 0);
+	if (p != MAP_FAILED)
+	{
+		char label[64];
+		snprintf (label, sizeof(label), "of %lu KBytes pages", _page_size >> 10);
+		add_arena (p, region_size, label);
+		VERBOSE_MSG(1, ALLOCATOR_NAME": Reserved %lu MBytes at %p using %lu KBytes pages.\n",
+		  region_size >> 20, p, _page_size >> 10);
+	}
+	else
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Could not reserve %lu MBytes of %lu KBytes pages (%s). Allocations will be served by the fallback allocator.\n",
+		  region_size >> 20, _page_size >> 10, strerror (errno));
+
+	_is_ready = true;
+}
+
+const char * AllocatorHugeTLB::name (void) const
+{
+	return ALLOCATOR_NAME;
+}
+
+const char * AllocatorHugeTLB::description (void) const
+{
+	return "Allocator based on a region of explicit huge pages (hugetlb)";
+}
@@ -0,0 +1,27 @@
+// License: To determine
+
+#pragma once
+
+#include "allocator-arena.hxx"
+
+// Allocator that carves the objects out of a region backed by explicit huge
+// pages (MAP_HUGETLB), reserved from the hugetlb pool when configured. If
+// the pool cannot provide the region, or once the region is exhausted, the
+// objects are served by the regular posix calls instead.
+class AllocatorHugeTLB final : public AllocatorArena
+{
+	private:
+	size_t _page_size;
+
+	public:
+	AllocatorHugeTLB (allocation_functions_t &);
+	~AllocatorHugeTLB();
+
+	void   configure (const char *);
+	const char * name (void) const;
+	const char * description (void) const;
+
+	// Huge pages cannot be moved in base pages
+	bool owns_pages (void *)
+	  { return false; }
+};
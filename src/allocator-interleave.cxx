@@ -0,0 +1,514 @@
+// License: To determine
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "common.hxx"
+#include "allocators.hxx"
+#include "allocator-interleave.hxx"
+
+#define ALLOCATOR_NAME "interleave"
+
+// Macro to align an address to the nearest power of two
+#ifndef align_to
+# define align_to(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
+#endif
+
+AllocatorInterleave::AllocatorInterleave (allocation_functions_t &af, Allocators *allocators)
+  : Allocator (af), _allocators (allocators), _ntiers (0), _weight_sum (0), _largest (0),
+    _page_size (sysconf (_SC_PAGESIZE)), _ninterleaved (0), _nforwarded (0)
+{
+}
+
+AllocatorInterleave::~AllocatorInterleave ()
+{
+}
+
+// Length of the mapping holding ptr, which starts at hdr->base_ptr()
+size_t AllocatorInterleave::length (const Allocator::Header_t *hdr, const void *ptr) const
+{
+	return align_to ((uintptr_t) ptr - (uintptr_t) hdr->base_ptr() + hdr->size(), _page_size);
+}
+
+// Length of the runs of a mapping, so that it holds at most MAX_RUNS of them
+size_t AllocatorInterleave::run_length (size_t length) const
+{
+	return MAX(RUN_GRANULE, align_to (length / MAX_RUNS, RUN_GRANULE));
+}
+
+// Bytes of a mapping of the given length that the runs place in each tier
+void AllocatorInterleave::tier_parts (size_t length, size_t *parts) const
+{
+	size_t run = run_length (length);
+
+	for (unsigned t = 0; t < _ntiers; ++t)
+		parts[t] = 0;
+	size_t offset = 0;
+	while (offset < length)
+		for (unsigned t = 0; t < _ntiers && offset < length; ++t)
+		{
+			size_t len = MIN(run * _tiers[t].weight, length - offset);
+			parts[t] += len;
+			offset += len;
+		}
+}
+
+// Whether every tier has room for its part of a mapping of the given length
+bool AllocatorInterleave::tiers_fit (size_t length) const
+{
+	size_t parts[MAX_TIERS];
+	tier_parts (length, parts);
+	for (unsigned t = 0; t < _ntiers; ++t)
+		if (_tiers[t].allocator->available() < parts[t])
+			return false;
+	return true;
+}
+
+// The tiers are charged for the parts of the mapping as it is when placed
+// anew, so that the charges of an object only depend on its current length
+// and are given back as such when it shrinks or is freed
+void AllocatorInterleave::charge_tiers (size_t length)
+{
+	size_t parts[MAX_TIERS];
+	tier_parts (length, parts);
+	for (unsigned t = 0; t < _ntiers; ++t)
+		_tiers[t].allocator->charge (parts[t]);
+}
+
+void AllocatorInterleave::discharge_tiers (size_t length)
+{
+	size_t parts[MAX_TIERS];
+	tier_parts (length, parts);
+	for (unsigned t = 0; t < _ntiers; ++t)
+		_tiers[t].allocator->discharge (parts[t]);
+}
+
+// Applies the policy of each tier to its runs, e.g. with weights 3,1 the
+// first three runs go to the first tier and the fourth to the second. Each
+// run becomes a mapping on its own, so they grow with the object size.
+bool AllocatorInterleave::place_runs (char *p, size_t length)
+{
+	size_t run = run_length (length);
+
+	size_t offset = 0;
+	while (offset < length)
+		for (unsigned t = 0; t < _ntiers && offset < length; ++t)
+		{
+			size_t len = MIN(run * _tiers[t].weight, length - offset);
+			unsigned long mask = _tiers[t].nodemask;
+			// The kernel expects the number of bits in the mask plus one
+			if (syscall (SYS_mbind, p + offset, len, _tiers[t].mode, &mask, sizeof(mask)*8 + 1, 0) != 0)
+				return false;
+			offset += len;
+		}
+
+	size_t parts[MAX_TIERS];
+	tier_parts (length, parts);
+	for (unsigned t = 0; t < _ntiers; ++t)
+	{
+		_tiers[t].allocator->charge (parts[t]);
+		__sync_fetch_and_add (&_tiers[t].placed, parts[t]);
+	}
+
+	return true;
+}
+
+// Maps and places a large object, unless some tier lacks room for its part
+void * AllocatorInterleave::map_object (size_t total)
+{
+	size_t len = align_to (total, _page_size);
+	if (!tiers_fit (len))
+	{
+		VERBOSE_MSG(2, ALLOCATOR_NAME": Some tier has no room for its part of %lu bytes.\n", len);
+		return nullptr;
+	}
+
+	void *p = mmap (nullptr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return nullptr;
+
+	if (!place_runs ((char*) p, len))
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Could not apply the tier policies to %lu bytes (%s).\n",
+		  len, strerror (errno));
+		munmap (p, len);
+		return nullptr;
+	}
+
+	__sync_fetch_and_add (&_ninterleaved, 1);
+	return p;
+}
+
+// Gives back the pages mapped for the object at base beyond those that
+// length() accounts for, as with the room for the alignment, so that free
+// unmaps all of them
+void AllocatorInterleave::trim_object (void *base, size_t total, const Allocator::Header_t *hdr, const void *ptr)
+{
+	size_t mapped = align_to (total, _page_size), len = length (hdr, ptr);
+	if (len < mapped)
+	{
+		munmap ((char*) base + len, mapped - len);
+		discharge_tiers (mapped);
+		charge_tiers (len);
+	}
+}
+
+// Objects smaller than a period are placed in the tier with the largest
+// weight. They carry our header after the one of the tier, and they are
+// told apart from the interleaved ones through their size.
+void * AllocatorInterleave::alloc_small (size_t total)
+{
+	__sync_fetch_and_add (&_nforwarded, 1);
+	return _tiers[_largest].allocator->malloc (total);
+}
+
+// Reallocates a small object in its tier, or returns nullptr leaving it
+// untouched
+void * AllocatorInterleave::realloc_small (void *ptr, Allocator::Header_t *hdr, size_t size)
+{
+	void *res = nullptr;
+	uintptr_t extra_size = Allocator::getExtraSize (hdr);
+	void *prev_baseptr = hdr->base_ptr();
+	Allocator::Header_t h = *hdr;
+	Allocator::releaseAllocatorHeader (ptr);
+	void *new_baseptr = _tiers[_largest].allocator->realloc (prev_baseptr,
+	  Allocator::getTotalSize (size + extra_size));
+	if (new_baseptr)
+		res = Allocator::generateAllocatorHeader (new_baseptr, extra_size, this, size);
+	else
+		Allocator::restoreAllocatorHeader (ptr, h);
+	return res;
+}
+
+void AllocatorInterleave::free_object (void *base, size_t size, size_t len)
+{
+	if (is_small (size))
+		_tiers[_largest].allocator->free (base);
+	else
+	{
+		munmap (base, len);
+		discharge_tiers (len);
+	}
+}
+
+void * AllocatorInterleave::malloc (size_t size)
+{
+	void * baseptr = is_small (size) ? alloc_small (Allocator::getTotalSize (size))
+	                                 : map_object (Allocator::getTotalSize (size));
+	void * res = nullptr;
+
+	// If malloc succeded, then forge a header and the pointer points to the
+	// data space after the header
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeader (baseptr, this, size);
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr & base at %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), name(), this);
+		_stats.record_malloc (size);
+	}
+
+	return res;
+}
+
+void * AllocatorInterleave::calloc (size_t nmemb, size_t size)
+{
+	// Fresh anonymous mappings are already zeroed
+	bool small = is_small (nmemb * size);
+	void * baseptr = small ? alloc_small (Allocator::getTotalSize (nmemb * size))
+	                       : map_object (Allocator::getTotalSize (nmemb * size));
+	void * res = nullptr;
+
+	// If malloc succeded, then forge a header and the pointer points to the
+	// data space after the header
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeader (baseptr, this, nmemb * size);
+		if (small)
+			::memset (res, 0, nmemb * size);
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr & base %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), name(), this);
+		_stats.record_calloc (nmemb * size);
+	}
+
+	return res;
+}
+
+int AllocatorInterleave::posix_memalign (void **ptr, size_t align, size_t size)
+{
+	assert (ptr != nullptr);
+
+	size_t total = Allocator::getTotalSize (size + align);
+	void * baseptr = is_small (size) ? alloc_small (total) : map_object (total);
+	void * res = nullptr;
+
+	// If malloc succeded, then forge a header and the pointer points to the
+	// data space after the header
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
+		if (!is_small (size))
+			trim_object (baseptr, total, Allocator::getAllocatorHeader (res), res);
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr %p, base %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), baseptr, name(), this);
+		_stats.record_aligned_malloc (size + align);
+
+		*ptr = res;
+		return 0;
+	}
+	else
+		return ENOMEM;
+}
+
+void AllocatorInterleave::free (void *ptr)
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+
+	// When freeing the memory, need to free the base pointe
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size(), hdr->base_ptr());
+
+	_stats.record_free (hdr->size());
+	// Small objects share the address with the header of their tier
+	void *base = hdr->base_ptr();
+	size_t size = hdr->size();
+	size_t len = length (hdr, ptr);
+	Allocator::releaseAllocatorHeader (ptr);
+	free_object (base, size, len);
+}
+
+void * AllocatorInterleave::realloc (void *ptr, size_t size)
+{
+	// If previous pointer is not null, behave normally. otherwise, behave like a malloc but
+	// without calling information
+	if (ptr)
+	{
+		// Search for previous allocation size through the header
+		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
+		size_t prev_size = prev_hdr->size();
+
+		if (prev_size < size)
+		{
+			void *res = nullptr;
+
+			// Small objects that remain small are reallocated in their tier,
+			// the interleaved ones grow within the last page of the mapping,
+			// and otherwise the object is moved
+			if (is_small (prev_size) && is_small (size))
+				res = realloc_small (ptr, prev_hdr, size);
+			else if (!is_small (prev_size) &&
+			    (uintptr_t) ptr + size <= (uintptr_t) prev_hdr->base_ptr() + length (prev_hdr, ptr))
+			{
+				prev_hdr->size (size);
+				res = ptr;
+			}
+			else if ((res = this->malloc (size)) != nullptr)
+			{
+				this->memcpy (res, ptr, prev_size);
+				this->free (ptr);
+			}
+			DBG("Reallocated (%ld->%ld) from %p into %p w/ allocator %s (%p)\n", prev_size, size, ptr, res, name(), this);
+
+			_stats.record_realloc (size, prev_size);
+
+			return res;
+		}
+		else if (Allocator::shrinks (prev_size, size))
+		{
+			void *res = nullptr;
+
+			// Interleaved objects that remain large unmap the runs past the new
+			// size, small ones are reallocated in their tier, and otherwise the
+			// object is moved there
+			if (!is_small (size))
+			{
+				void *base = prev_hdr->base_ptr();
+				size_t len = align_to ((uintptr_t) ptr - (uintptr_t) base + size, _page_size);
+				size_t prev_len = length (prev_hdr, ptr);
+				if (len < prev_len)
+				{
+					munmap ((char*) base + len, prev_len - len);
+					discharge_tiers (prev_len);
+					charge_tiers (len);
+				}
+				prev_hdr->size (size);
+				res = ptr;
+			}
+			else if (is_small (prev_size))
+				res = realloc_small (ptr, prev_hdr, size);
+			else if ((res = this->malloc (size)) != nullptr)
+			{
+				this->memcpy (res, ptr, size);
+				this->free (ptr);
+			}
+			DBG("Shrunk (%ld->%ld) from %p into %p w/ allocator %s (%p)\n", prev_size, size, ptr, res, name(), this);
+
+			// Objects that cannot be shrunk are left untouched
+			if (res == nullptr)
+				return ptr;
+			_stats.record_shrink_realloc (size, prev_size);
+
+			return res;
+		}
+		else
+		{
+			DBG("Reallocated (%ld->%ld) from %p but not touching as new size is smaller w/ allocator %s (%p)\n", prev_size, size, ptr, name(), this);
+			return ptr;
+		}
+	}
+	else
+	{
+		VERBOSE_MSG(3, ALLOCATOR_NAME": realloc (NULL, ...) forwarded to malloc\n");
+		_stats.record_realloc_forward_malloc();
+
+		return this->malloc (size);
+	}
+}
+
+size_t AllocatorInterleave::malloc_usable_size (void *ptr)
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+
+	// When checking for the usable size, return the size we requested originally, no matter
+	// what the underlying library did. This may alter execution behaviors, though.
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Checking usable size on pointer %p w/ size - %lu (but base pointer located in %p)\n",
+	  ptr, hdr->size(), hdr->base_ptr());
+
+	return hdr->size();
+}
+
+void AllocatorInterleave::configure (const char *config)
+{
+	const char * MEMORYCONFIG_SIZE = "Size ";
+	const char * MEMORYCONFIG_MBYTES_SUFFIX = " MBytes";
+	const char * MEMORYCONFIG_TIER = " @ ";
+
+	if (strncmp (config, MEMORYCONFIG_SIZE, strlen(MEMORYCONFIG_SIZE)) == 0)
+	{
+		// Get given size after the Size marker
+		char *pEnd = nullptr;
+		long long s_size = strtoll (&config[strlen(MEMORYCONFIG_SIZE)], &pEnd, 10);
+		// Was text converted into s? If so, now look for suffix
+		if (pEnd != &config[strlen(MEMORYCONFIG_SIZE)])
+		{
+			if (strncmp (pEnd, MEMORYCONFIG_MBYTES_SUFFIX, strlen(MEMORYCONFIG_MBYTES_SUFFIX)) == 0)
+			{
+				size_t s;
+				if (s_size < 0)
+				{
+					VERBOSE_MSG(1, ALLOCATOR_NAME": Invalid given size.\n");
+					exit (1);
+				}
+				else
+					s = s_size;
+				VERBOSE_MSG(1, ALLOCATOR_NAME": Setting up size %lu MBytes.\n", s);
+				size (s << 20);
+
+				// Followed by the tiers, each with an optional weight
+				const char *p = pEnd + strlen(MEMORYCONFIG_MBYTES_SUFFIX);
+				while (strncmp (p, MEMORYCONFIG_TIER, strlen(MEMORYCONFIG_TIER)) == 0)
+				{
+					if (_ntiers == MAX_TIERS)
+					{
+						VERBOSE_MSG(0, ALLOCATOR_NAME": Too many tiers, at most %u are supported.\n", MAX_TIERS);
+						exit (1);
+					}
+
+					char tiername[256];
+					p += strlen(MEMORYCONFIG_TIER);
+					size_t count = MIN(strcspn (p, " "), sizeof(tiername) - 1);
+					memcpy (tiername, p, count);
+					tiername[count] = '\0';
+					p += strcspn (p, " ");
+
+					unsigned weight = 1;
+					if (p[0] == ' ' && isdigit (p[1]))
+					{
+						weight = strtoul (p + 1, &pEnd, 10);
+						p = pEnd;
+					}
+
+					tier_t *t = &_tiers[_ntiers];
+					t->allocator = _allocators->get (tiername);
+					if (t->allocator == nullptr || t->allocator == this || weight == 0)
+					{
+						VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid tier '%s' with weight %u.\n", tiername, weight);
+						exit (1);
+					}
+					if (!t->allocator->mempolicy (t->mode, t->nodemask))
+					{
+						VERBOSE_MSG(0, ALLOCATOR_NAME": Tier '%s' cannot be interleaved. Tiers must be defined before and place their memory through a memory policy.\n", tiername);
+						exit (1);
+					}
+					VERBOSE_MSG(1, ALLOCATOR_NAME": Using allocator %s with weight %u (policy %d, node mask 0x%lx).\n",
+					  tiername, weight, t->mode, t->nodemask);
+					t->allocator->used (true);
+					t->weight = weight;
+					t->placed = 0;
+					if (weight > _tiers[_largest].weight)
+						_largest = _ntiers;
+					_weight_sum += weight;
+					_ntiers++;
+				}
+				if (*p != '\0' || _ntiers < 2)
+				{
+					VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid tiers specification. At least two tiers are needed.\n");
+					exit (1);
+				}
+			}
+			else
+			{
+				VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid size suffix.\n");
+				exit (1);
+			}
+		}
+		else
+		{
+			VERBOSE_MSG(0, ALLOCATOR_NAME": Could not parse given size.\n");
+			exit (1);
+		}
+	}
+	else
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Wrong configuration for the allocator. Available options include:\n"
+		               " Size <NUM> MBytes @ <allocator> [<weight>] @ <allocator> [<weight>] ...\n");
+		exit (1);
+	}
+
+	_is_ready = true;
+}
+
+const char * AllocatorInterleave::name (void) const
+{
+	return ALLOCATOR_NAME;
+}
+
+const char * AllocatorInterleave::description (void) const
+{
+	return "Virtual allocator interleaving large objects across other allocators";
+}
+
+void AllocatorInterleave::show_statistics (void) const
+{
+	_stats.show_statistics (ALLOCATOR_NAME, true);
+	VERBOSE_MSG(1, ALLOCATOR_NAME": %llu objects interleaved, %llu small objects placed in %s.\n",
+	  _ninterleaved, _nforwarded, _ntiers > 0 ? _tiers[_largest].allocator->name() : "-");
+	for (unsigned t = 0; t < _ntiers; ++t)
+		VERBOSE_MSG(1, ALLOCATOR_NAME": %llu MBytes placed in %s (weight %u).\n",
+		  _tiers[t].placed >> 20, _tiers[t].allocator->name(), _tiers[t].weight);
+}
+
+bool AllocatorInterleave::fits (size_t s) const
+{
+	if (is_small (s))
+		return _tiers[_largest].allocator->fits (s);
+	return _stats.water_mark() + s <= this->size() &&
+	  tiers_fit (align_to (Allocator::getTotalSize (s), _page_size));
+}
@@ -0,0 +1,98 @@
+// License: To determine
+
+#pragma once
+
+#include "allocator.hxx"
+#include <string.h>
+
+class Allocators;
+
+// Virtual allocator that combines two or more tiers with a ratio. Each large
+// object is given a virtual range of its own whose consecutive runs are
+// placed, following the weights, with the memory policy of each tier, so a
+// single array obtains the aggregate bandwidth of the tiers. Each tier is
+// charged for the pages of its runs, and objects are only interleaved while
+// every tier has room for its part. Objects smaller than a period of runs are
+// placed in the tier with the largest weight.
+class AllocatorInterleave final : public Allocator
+{
+	private:
+	static const unsigned MAX_TIERS = 8;
+	static const size_t RUN_GRANULE = 2UL << 20; // huge page size, for THP
+	static const size_t MAX_RUNS = 1024;         // per object, bounds the mappings
+
+	typedef struct tier_st
+	{
+		Allocator *allocator;
+		unsigned weight;
+		int mode;                 // memory policy of the tier
+		unsigned long nodemask;
+		unsigned long long placed; // bytes of the objects placed in the tier
+	} tier_t;
+
+	AllocatorStatistics _stats;
+	Allocators * _allocators;
+	tier_t _tiers[MAX_TIERS];
+	unsigned _ntiers;
+	unsigned _weight_sum;
+	unsigned _largest;            // tier receiving the small objects
+	size_t _page_size;
+	unsigned long long _ninterleaved;
+	unsigned long long _nforwarded;
+
+	bool is_small (size_t size) const
+	  { return size < _weight_sum * RUN_GRANULE; }
+	size_t length (const Allocator::Header_t *, const void *) const;
+	size_t run_length (size_t) const;
+	void tier_parts (size_t, size_t *) const;
+	bool tiers_fit (size_t) const;
+	void charge_tiers (size_t);
+	void discharge_tiers (size_t);
+	bool place_runs (char *, size_t);
+	void * map_object (size_t);
+	void trim_object (void *base, size_t total, const Allocator::Header_t *, const void *);
+	void * alloc_small (size_t);
+	void * realloc_small (void *, Allocator::Header_t *, size_t);
+	void free_object (void *base, size_t size, size_t len);
+
+	public:
+	AllocatorInterleave (allocation_functions_t &, Allocators *);
+	~AllocatorInterleave();
+
+	void*  malloc (size_t);
+	void*  calloc (size_t, size_t);
+	int    posix_memalign (void **, size_t, size_t);
+	void   free (void *);
+	void*  realloc (void *, size_t);
+	size_t malloc_usable_size (void*);
+
+	void   configure (const char *);
+	const char * name (void) const;
+	const char * description (void) const;
+	void show_statistics (void) const;
+
+	void *memcpy (void *dest, const void *src, size_t n)
+	  { return ::memcpy (dest, src, n); }
+
+	bool fits (size_t s) const;
+	size_t hwm (void) const
+	  { return _stats.water_mark(); }
+	void record_unfitted_malloc (size_t s)
+	  { _stats.record_unfitted_malloc (s); } ;
+	void record_unfitted_calloc (size_t s)
+	  { _stats.record_unfitted_calloc (s); } ;
+	void record_unfitted_aligned_malloc (size_t s)
+	  { _stats.record_unfitted_aligned_malloc (s); } ;
+	void record_unfitted_realloc (size_t s)
+	  { _stats.record_unfitted_realloc (s); } ;
+
+	void record_source_realloc (size_t s)
+	  { _stats.record_source_realloc (s); };
+	void record_target_realloc (size_t s)
+	  { _stats.record_target_realloc (s); };
+	void record_self_realloc (size_t s)
+	  { _stats.record_self_realloc (s); };
+
+	void record_realloc_forward_malloc (void)
+	  { _stats.record_realloc_forward_malloc (); }
+};
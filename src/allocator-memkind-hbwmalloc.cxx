@@ -8,6 +8,9 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 #include "common.hxx"
 #include "allocator-memkind-hbwmalloc.hxx"
@@ -46,9 +49,10 @@ void * AllocatorMemkindHBWMalloc::malloc (size_t size)
 
 void * AllocatorMemkindHBWMalloc::calloc (size_t nmemb, size_t size)
 {
-	// Forward memory request to real malloc and request additional space to store
-	// the allocator and the basepointer
-	void * baseptr = hbw_malloc (Allocator::getTotalSize (nmemb * size));
+	// Forward memory request to real calloc, which does not clear the memory it
+	// knows to be zero, and request additional space to store the allocator and
+	// the basepointer
+	void * baseptr = hbw_calloc (1, Allocator::getTotalSize (nmemb * size));
 	void * res = nullptr;
 
 	// If malloc succeded, then forge a header and the pointer points to the 
@@ -69,20 +73,26 @@ int AllocatorMemkindHBWMalloc::posix_memalign (void **ptr, size_t align, size_t
 {
 	assert (ptr != nullptr);
 
-	// Forward memory request to real malloc and request additional space to
-	// store the allocator and the basepointer
-	void * baseptr = hbw_malloc (Allocator::getTotalSize (size + align));
+	// Aligned entry points of the backend take no more than the object,
+	// otherwise request additional space to store the header in front of it
+	bool native = Allocator::nativeAlignment (align);
+	void * baseptr = nullptr;
+	if (!native)
+		baseptr = hbw_malloc (Allocator::getTotalSize (size + align));
+	else if (hbw_posix_memalign (&baseptr, align, size) != 0)
+		baseptr = nullptr;
 	void * res = nullptr;
 
 	// If malloc succeded, then forge a header and the pointer points to the 
 	// data space after the header
 	if (baseptr)
 	{
-		res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
+		res = native ? Allocator::generateAllocatorHeaderOnNative (baseptr, this, size)
+		             : Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
 
 		// Verbosity and emit statistics
 		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr %p, base %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), baseptr, name(), this);
-		_stats.record_aligned_malloc (size + align);
+		_stats.record_aligned_malloc (native ? size : size + align);
 
 		*ptr = res;
 		return 0;
@@ -96,10 +106,12 @@ void AllocatorMemkindHBWMalloc::free (void *ptr)
 	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
 
 	// When freeing the memory, need to free the base pointe
-	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size, hdr->base_ptr);
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size(), hdr->base_ptr());
 	
-	_stats.record_free (hdr->size);
-	hbw_free (hdr->base_ptr);
+	_stats.record_free (hdr->size());
+	void *base = hdr->base_ptr();
+	Allocator::releaseAllocatorHeader (ptr);
+	hbw_free (base);
 }
 
 void * AllocatorMemkindHBWMalloc::realloc (void *ptr, size_t size)
@@ -110,13 +122,27 @@ void * AllocatorMemkindHBWMalloc::realloc (void *ptr, size_t size)
 	{
 		// Search for previous allocation size through the header
 		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
-		size_t prev_size = prev_hdr->size;
-		void * prev_baseptr = prev_hdr->base_ptr;
+		size_t prev_size = prev_hdr->size();
+		void * prev_baseptr = prev_hdr->base_ptr();
 		uintptr_t extra_size = Allocator::getExtraSize (prev_hdr);
 
-		if (prev_size < size)
+		if (prev_size < size && !Allocator::growsInBackend (prev_hdr))
 		{
-			// Reallocate, from base pointer to fit the new size plus a new header
+			// Objects from aligned entry points may have to move, which malloc and free
+			// already account for
+			void *res = this->malloc (size);
+			if (res != nullptr)
+			{
+				this->memcpy (res, ptr, prev_size);
+				this->free (ptr);
+			}
+			return res;
+		}
+		else if (prev_size < size ||
+		         (Allocator::shrinks (prev_size, size) && Allocator::growsInBackend (prev_hdr)))
+		{
+			// Reallocate, from base pointer to fit the new size plus a new header.
+			// When shrinking, the backend gives the tail back to the kind.
 			void *new_baseptr = hbw_realloc (prev_baseptr, Allocator::getTotalSize (size + extra_size));
 			void *res = nullptr;
 
@@ -127,9 +153,14 @@ void * AllocatorMemkindHBWMalloc::realloc (void *ptr, size_t size)
 				// res points to the space where the user can store their data
 				res = Allocator::generateAllocatorHeader (new_baseptr, extra_size, this, size);
 				DBG("Reallocated (%ld->%ld [extra bytes = %lu]) from %p (base at %p, header at %p) into %p (base at %p, header at %p) w/ allocator %s (%p)\n", prev_size, size, extra_size, ptr, prev_baseptr, prev_hdr, res, new_baseptr, Allocator::getAllocatorHeader (res), name(), this);
+				if (res != ptr)
+					Allocator::releaseAllocatorHeader (ptr);
 			}
 
-			_stats.record_realloc (size, prev_size);
+			if (prev_size < size)
+				_stats.record_realloc (size, prev_size);
+			else
+				_stats.record_shrink_realloc (size, prev_size);
 
 			return res;
 		}
@@ -155,9 +186,9 @@ size_t AllocatorMemkindHBWMalloc::malloc_usable_size (void *ptr)
 	// When checking for the usable size, return the size we requested originally, no matter
 	// what the underlying library did. This may alter execution behaviors, though.
 	VERBOSE_MSG(3, ALLOCATOR_NAME": Checking usable size on pointer %p w/ size - %lu (but base pointer located in %p)\n",
-	  ptr, hdr->size, hdr->base_ptr);
+	  ptr, hdr->size(), hdr->base_ptr());
 
-	return hdr->size;
+	return hdr->size();
 }
 
 void AllocatorMemkindHBWMalloc::configure (const char *config)
@@ -208,6 +239,30 @@ void AllocatorMemkindHBWMalloc::configure (const char *config)
 	_is_ready = true;
 }
 
+// The high-bandwidth node is learnt from the page hbwmalloc gives when
+// touched, as the preferred policy set in the constructor is used. Only the
+// node closest to the calling CPU is found this way, so on machines with
+// several high-bandwidth nodes the pages placed through this policy (as the
+// runs of an interleaved tier) all go to that node.
+bool AllocatorMemkindHBWMalloc::mempolicy (int &mode, unsigned long &nodemask)
+{
+	size_t page_size = sysconf (_SC_PAGESIZE);
+	void *p = nullptr;
+	if (hbw_posix_memalign (&p, page_size, page_size) != 0)
+		return false;
+
+	*(volatile char*) p = 0;
+	int node = -1;
+	long res = syscall (SYS_get_mempolicy, &node, nullptr, 0, p, MPOL_F_NODE|MPOL_F_ADDR);
+	hbw_free (p);
+	if (res != 0 || node < 0 || node >= (int) (sizeof(nodemask)*8))
+		return false;
+
+	mode = MPOL_PREFERRED;
+	nodemask = 1UL << node;
+	return true;
+}
+
 const char * AllocatorMemkindHBWMalloc::name (void) const
 {
 	return ALLOCATOR_NAME;
@@ -23,6 +23,7 @@ class AllocatorMemkindHBWMalloc final : public Allocator
 	size_t malloc_usable_size (void*);
 
 	void   configure (const char *);
+	bool   mempolicy (int &, unsigned long &);
 	const char * name (void) const;
 	const char * description (void) const;
 	void show_statistics (void) const;
@@ -31,6 +32,12 @@ class AllocatorMemkindHBWMalloc final : public Allocator
 	  { return ::memcpy (dest, src, n); }
 
 	bool fits (size_t s) const;
+	size_t available (void) const
+	  { return _stats.water_mark() < this->size() ? this->size() - _stats.water_mark() : 0; }
+	void charge (size_t s)
+	  { _stats.record_charge (s); }
+	void discharge (size_t s)
+	  { _stats.record_discharge (s); }
 	size_t hwm (void) const
 	  { return _stats.water_mark(); }
 	void record_unfitted_malloc (size_t s)
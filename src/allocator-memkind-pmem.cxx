@@ -22,7 +22,7 @@
 #define ALLOCATOR_NAME "memkind/pmem"
 
 AllocatorMemkindPMEM::AllocatorMemkindPMEM (allocation_functions_t &af)
-  : Allocator (af)
+  : Allocator (af), _ncache_hits (0), _ncache_misses (0), _ncache_evictions (0)
 {
 	if (numa_available() == -1)
 	{
@@ -43,6 +43,8 @@ AllocatorMemkindPMEM::AllocatorMemkindPMEM (allocation_functions_t &af)
 	_stats = (AllocatorStatistics*) _af.malloc (_num_NUMA_nodes * sizeof(AllocatorStatistics));
 	assert (_stats != nullptr);
 	new (_stats) AllocatorStatistics[_num_NUMA_nodes];
+
+	pthread_key_create (&_cache_key, AllocatorMemkindPMEM::cache_release);
 }
 
 AllocatorMemkindPMEM::~AllocatorMemkindPMEM ()
@@ -52,6 +54,95 @@ AllocatorMemkindPMEM::~AllocatorMemkindPMEM ()
 	_af.free (_cpu_2_NUMA);
 }
 
+// Invoked at thread exit, gives the cached blocks back to memkind
+void AllocatorMemkindPMEM::cache_release (void *p)
+{
+	cache_t *c = (cache_t*) p;
+	AllocatorMemkindPMEM *a = c->allocator;
+
+	for (long n = 0; n < a->_num_NUMA_nodes; ++n)
+		for (unsigned k = 0; k < CACHE_CLASSES; ++k)
+		{
+			void *block = c->bins[n*CACHE_CLASSES + k].head;
+			while (block != nullptr)
+			{
+				void *next = *(void**) block;
+				memkind_free (a->_kind[n], block);
+				block = next;
+			}
+		}
+	a->_af.free (c);
+}
+
+AllocatorMemkindPMEM::cache_t * AllocatorMemkindPMEM::cache (void)
+{
+	cache_t *c = (cache_t*) pthread_getspecific (_cache_key);
+	if (LIKELY(c != nullptr))
+		return c;
+
+	c = (cache_t*) _af.calloc (1, sizeof(cache_t) + _num_NUMA_nodes * CACHE_CLASSES * sizeof(bin_t));
+	if (c != nullptr)
+	{
+		c->allocator = this;
+		pthread_setspecific (_cache_key, c);
+	}
+	return c;
+}
+
+// Returns a block of at least total bytes on the given node. Sizes within
+// the cached classes are rounded up to their class so that the blocks can
+// be reused for any request of the class. If requested, the first total
+// bytes are zeroed, which memkind_calloc only does when not already known.
+void * AllocatorMemkindPMEM::alloc_block (long n, size_t total, bool zero)
+{
+	if (total > (1UL << CACHE_MAX_SHIFT))
+		return zero ? memkind_calloc (_kind[n], 1, total) : memkind_malloc (_kind[n], total);
+
+	unsigned shift = total <= (1UL << CACHE_MIN_SHIFT) ? CACHE_MIN_SHIFT : 64 - __builtin_clzl (total - 1);
+	cache_t *c = cache ();
+	if (c != nullptr)
+	{
+		bin_t *b = &c->bins[n*CACHE_CLASSES + shift - CACHE_MIN_SHIFT];
+		if (b->head != nullptr)
+		{
+			void *block = b->head;
+			b->head = *(void**) block;
+			b->nblocks--;
+			__sync_fetch_and_add (&_ncache_hits, 1);
+			if (zero)
+				::memset (block, 0, total);
+			return block;
+		}
+	}
+	__sync_fetch_and_add (&_ncache_misses, 1);
+	return zero ? memkind_calloc (_kind[n], 1, 1UL << shift) : memkind_malloc (_kind[n], 1UL << shift);
+}
+
+// Keeps the block in the cache of the calling thread, in the largest class
+// it can hold, unless it is too large or the class is full
+void AllocatorMemkindPMEM::free_block (long n, void *baseptr)
+{
+	size_t usable = memkind_malloc_usable_size (_kind[n], baseptr);
+	if (usable >= (1UL << CACHE_MIN_SHIFT) && usable < (2UL << CACHE_MAX_SHIFT))
+	{
+		unsigned shift = std::min (63u - __builtin_clzl (usable), CACHE_MAX_SHIFT);
+		cache_t *c = cache ();
+		if (c != nullptr)
+		{
+			bin_t *b = &c->bins[n*CACHE_CLASSES + shift - CACHE_MIN_SHIFT];
+			if (((size_t) b->nblocks + 1) << shift <= CACHE_BIN_BYTES)
+			{
+				*(void**) baseptr = b->head;
+				b->head = baseptr;
+				b->nblocks++;
+				return;
+			}
+			__sync_fetch_and_add (&_ncache_evictions, 1);
+		}
+	}
+	memkind_free (_kind[n], baseptr);
+}
+
 void * AllocatorMemkindPMEM::malloc (size_t size)
 {
 	int cpu = sched_getcpu();
@@ -61,7 +152,7 @@ void * AllocatorMemkindPMEM::malloc (size_t size)
 	DBG("Running on CPU %d - NUMA node %ld\n", cpu, n);
 
 	// Forward memory request to real malloc and reserve some space for the header
-	void * baseptr = memkind_malloc (_kind[n], Allocator::getTotalSize (size));
+	void * baseptr = alloc_block (n, Allocator::getTotalSize (size));
 	void * res = nullptr;
 
 	// If malloc succeded, then forge a header and the pointer points to the 
@@ -89,7 +180,7 @@ void * AllocatorMemkindPMEM::calloc (size_t nmemb, size_t size)
 
 	// Forward memory request to real malloc and request additional space to store
 	// the allocator and the basepointer
-	void * baseptr = memkind_malloc (_kind[n], Allocator::getTotalSize (nmemb * size));
+	void * baseptr = alloc_block (n, Allocator::getTotalSize (nmemb * size), true);
 	void * res = nullptr;
 
 	// If malloc succeded, then forge a header and the pointer points to the 
@@ -117,21 +208,27 @@ int AllocatorMemkindPMEM::posix_memalign (void **ptr, size_t align, size_t size)
 
 	DBG("Running on CPU %d - NUMA node %ld\n", cpu, n);
 
-	// Forward memory request to real malloc and request additional space to
-	// store the allocator and the basepointer
-	void * baseptr = memkind_malloc (_kind[n], Allocator::getTotalSize (size + align));
+	// Aligned entry points of the backend take no more than the object,
+	// otherwise request additional space to store the header in front of it
+	bool native = Allocator::nativeAlignment (align);
+	void * baseptr = nullptr;
+	if (!native)
+		baseptr = alloc_block (n, Allocator::getTotalSize (size + align));
+	else if (memkind_posix_memalign (_kind[n], &baseptr, align, size) != 0)
+		baseptr = nullptr;
 	void * res = nullptr;
 
 	// If malloc succeded, then forge a header and the pointer points to the 
 	// data space after the header
 	if (baseptr)
 	{
-		res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
+		res = native ? Allocator::generateAllocatorHeaderOnNative (baseptr, this, size)
+		             : Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
 		Allocator::pmemNode (res, n);
 
 		// Verbosity and emit statistics
 		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr %p, base %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), baseptr, name(), this);
-		_stats[n].record_aligned_malloc (size + align);
+		_stats[n].record_aligned_malloc (native ? size : size + align);
 
 		*ptr = res;
 		return 0;
@@ -145,7 +242,7 @@ void AllocatorMemkindPMEM::free (void *ptr)
 	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
 
 	// When freeing the memory, need to free the base pointe
-	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size, hdr->base_ptr);
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size(), hdr->base_ptr());
 	
 	// Recover memkind kind from AUX field and pass base pointer
 	bool gotnode;
@@ -153,8 +250,10 @@ void AllocatorMemkindPMEM::free (void *ptr)
 	assert (gotnode);
 	assert (0 <= n && n < _num_NUMA_nodes);
 
-	_stats[n].record_free (hdr->size);
-	memkind_free (_kind[n], hdr->base_ptr);
+	_stats[n].record_free (hdr->size());
+	void *base = hdr->base_ptr();
+	Allocator::releaseAllocatorHeader (ptr);
+	free_block (n, base);
 }
 
 void * AllocatorMemkindPMEM::realloc (void *ptr, size_t size)
@@ -165,8 +264,8 @@ void * AllocatorMemkindPMEM::realloc (void *ptr, size_t size)
 	{
 		// Search for previous allocation size through the header
 		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
-		size_t prev_size = prev_hdr->size;
-		void * prev_baseptr = prev_hdr->base_ptr;
+		size_t prev_size = prev_hdr->size();
+		void * prev_baseptr = prev_hdr->base_ptr();
 		// Recover memkind kind from AUX field and pass base pointer
 		bool gotnode;
 		int n = Allocator::pmemNode (ptr, gotnode);
@@ -174,9 +273,23 @@ void * AllocatorMemkindPMEM::realloc (void *ptr, size_t size)
 		assert (0 <= n && n < _num_NUMA_nodes);
 		uintptr_t extra_size = Allocator::getExtraSize (prev_hdr);
 
-		if (prev_size < size)
+		if (prev_size < size && !Allocator::growsInBackend (prev_hdr))
 		{
-			// Reallocate, from base pointer to fit the new size plus a new header
+			// Objects from aligned entry points may have to move, which malloc and free
+			// already account for
+			void *res = this->malloc (size);
+			if (res != nullptr)
+			{
+				this->memcpy (res, ptr, prev_size);
+				this->free (ptr);
+			}
+			return res;
+		}
+		else if (prev_size < size ||
+		         (Allocator::shrinks (prev_size, size) && Allocator::growsInBackend (prev_hdr)))
+		{
+			// Reallocate, from base pointer to fit the new size plus a new header.
+			// When shrinking, the backend gives the tail back to the kind.
 			void *new_baseptr = memkind_realloc (_kind[n], prev_baseptr, Allocator::getTotalSize (size + extra_size));
 			void *res = nullptr;
 
@@ -188,9 +301,14 @@ void * AllocatorMemkindPMEM::realloc (void *ptr, size_t size)
 				Allocator::pmemNode (res, n);
 
 				DBG("Reallocated (%ld->%ld [extra bytes = %lu]) from %p (base at %p, header at %p) into %p (base at %p, header at %p) w/ allocator %s (%p) on node %d\n", prev_size, size, extra_size, ptr, prev_baseptr, prev_hdr, res, new_baseptr, Allocator::getAllocatorHeader (res), name(), this, n);
+				if (res != ptr)
+					Allocator::releaseAllocatorHeader (ptr);
 			}
 
-			_stats[n].record_realloc (size, prev_size);
+			if (prev_size < size)
+				_stats[n].record_realloc (size, prev_size);
+			else
+				_stats[n].record_shrink_realloc (size, prev_size);
 
 			return res;
 		}
@@ -218,9 +336,9 @@ size_t AllocatorMemkindPMEM::malloc_usable_size (void * ptr)
 	// When checking for the usable size, return the size we requested originally, no matter
 	// what the underlying library did. This may alter execution behaviors, though.
 	VERBOSE_MSG(3, ALLOCATOR_NAME": Checking usable size on pointer %p w/ size - %lu (but base pointer located in %p)\n",
-	  ptr, hdr->size, hdr->base_ptr);
+	  ptr, hdr->size(), hdr->base_ptr());
 
-	return hdr->size;
+	return hdr->size();
 }
 
 void AllocatorMemkindPMEM::configure (const char *config)
@@ -339,6 +457,8 @@ void AllocatorMemkindPMEM::show_statistics (void) const
 		snprintf (node, sizeof(node), "node%ld", n);
 		_stats[n].show_statistics (ALLOCATOR_NAME, true, node);
 	}
+	VERBOSE_MSG(1, ALLOCATOR_NAME": Thread caches served %llu allocations, %llu missed and %llu freed blocks did not fit.\n",
+	  _ncache_hits, _ncache_misses, _ncache_evictions);
 }
 
 bool AllocatorMemkindPMEM::fits (size_t) const
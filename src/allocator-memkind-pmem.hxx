@@ -5,6 +5,7 @@
 #pragma once
 
 #include <memkind.h>
+#include <pthread.h>
 
 #if defined(PMDK_SUPPORTED)
 # include <libpmem.h>
@@ -14,13 +15,44 @@
 
 #include "allocator.hxx"
 
+// Allocator on top of one memkind PMEM kind per NUMA node. Every thread
+// keeps a cache of the blocks it frees, per node and power-of-two size
+// class, from which the next allocations of the class are served without
+// entering memkind. Each class holds up to CACHE_BIN_BYTES, and the cache
+// is given back to memkind when the thread exits.
 class AllocatorMemkindPMEM final : public Allocator
 {
 	private:
+	static const unsigned CACHE_MIN_SHIFT = 6;          // 64 bytes
+	static const unsigned CACHE_MAX_SHIFT = 20;         // 1 MByte
+	static const unsigned CACHE_CLASSES = CACHE_MAX_SHIFT - CACHE_MIN_SHIFT + 1;
+	static const size_t   CACHE_BIN_BYTES = 2UL << 20;
+
+	typedef struct
+	{
+		void *head;          // blocks linked through their first word
+		unsigned nblocks;
+	} bin_t;
+
+	typedef struct
+	{
+		AllocatorMemkindPMEM *allocator;
+		bin_t bins[];        // _num_NUMA_nodes x CACHE_CLASSES
+	} cache_t;
+
 	memkind_t *_kind;
 	AllocatorStatistics *_stats;
 	short *_cpu_2_NUMA;
 	int _num_NUMA_nodes;
+	pthread_key_t _cache_key;
+	unsigned long long _ncache_hits;
+	unsigned long long _ncache_misses;
+	unsigned long long _ncache_evictions;
+
+	static void cache_release (void *);
+	cache_t * cache (void);
+	void * alloc_block (long node, size_t total, bool zero = false);
+	void free_block (long node, void *baseptr);
 
 	public:
 	AllocatorMemkindPMEM (allocation_functions_t &af);
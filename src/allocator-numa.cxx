@@ -0,0 +1,393 @@
+// License: To determine
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "common.hxx"
+#include "allocator-numa.hxx"
+
+#define ALLOCATOR_NAME "numa"
+
+// Memory policies not known to older kernel headers
+static const int MEMPOLICY_PREFERRED_MANY = 5;
+static const int MEMPOLICY_WEIGHTED_INTERLEAVE = 6;
+
+// Huge page size, so that the stripes can still be backed by THP
+static const size_t STRIPE_GRANULE = 2UL << 20;
+
+AllocatorNUMA::AllocatorNUMA (allocation_functions_t &af)
+  : AllocatorArena (af), _nodemask (0), _policy (NUMA_POLICY_BIND)
+{
+	for (unsigned n = 0; n < MAX_NODES; ++n)
+	{
+		_arena_of_node[n] = -1;
+		_weights[n] = 1;
+	}
+}
+
+// Applies a memory policy to [p, p+size), so the pages are taken from the
+// nodes in mask when first touched
+static bool bind_region (void *p, size_t size, int mode, unsigned long mask)
+{
+	// The kernel expects the number of bits in the mask plus one
+	return syscall (SYS_mbind, p, size, mode, &mask, sizeof(mask)*8 + 1, 0) == 0;
+}
+
+AllocatorNUMA::~AllocatorNUMA ()
+{
+}
+
+// Parses a node list such as 0,2-3 into _nodemask, leaving *end after it
+bool AllocatorNUMA::parse_nodes (const char *nodes, const char **end)
+{
+	const char *p = nodes;
+	do
+	{
+		char *pEnd = nullptr;
+		long first = strtol (p, &pEnd, 10), last;
+		if (pEnd == p || first < 0 || first >= (long) MAX_NODES)
+			return false;
+		last = first;
+		p = pEnd;
+		if (*p == '-')
+		{
+			last = strtol (++p, &pEnd, 10);
+			if (pEnd == p || last < first || last >= (long) MAX_NODES)
+				return false;
+			p = pEnd;
+		}
+		for (long n = first; n <= last; ++n)
+			_nodemask |= 1UL << n;
+	} while (*p++ == ',');
+
+	*end = p - 1;
+	return true;
+}
+
+// Parses the weights of the nodes in the set, given in increasing node order
+bool AllocatorNUMA::parse_weights (const char *weights)
+{
+	const char *p = weights;
+	unsigned nweights = 0;
+	for (unsigned n = 0; n < MAX_NODES; ++n)
+		if (_nodemask & (1UL << n))
+		{
+			char *pEnd = nullptr;
+			long w = strtol (p, &pEnd, 10);
+			if (pEnd == p || w <= 0 || w > 255)
+				return false;
+			_weights[n] = w;
+			nweights++;
+			p = pEnd;
+			if (*p != ',')
+				break;
+			p++;
+		}
+	return *p == '\0' && nweights == (unsigned) __builtin_popcountl (_nodemask);
+}
+
+void * AllocatorNUMA::map_region (size_t size)
+{
+	void *p = mmap (nullptr, size, PROT_READ|PROT_WRITE,
+	  MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Could not map %lu MBytes (%s).\n",
+		  size >> 20, strerror (errno));
+		return nullptr;
+	}
+	return p;
+}
+
+// The kernel weighted interleave takes its weights from sysfs, which are
+// global to the system. They are only used if they are proportional to ours.
+bool AllocatorNUMA::kernel_weights_match (void) const
+{
+	unsigned first = __builtin_ctzl (_nodemask), kfirst = 0;
+	for (unsigned n = first; n < MAX_NODES; ++n)
+		if (_nodemask & (1UL << n))
+		{
+			char path[128];
+			snprintf (path, sizeof(path), "/sys/kernel/mm/mempolicy/weighted_interleave/node%u", n);
+			FILE *f = fopen (path, "r");
+			if (f == nullptr)
+				return false;
+			unsigned kw = 0;
+			bool read = fscanf (f, "%u", &kw) == 1;
+			fclose (f);
+			if (!read || kw == 0)
+				return false;
+			if (n == first)
+				kfirst = kw;
+			else if (kw * _weights[first] != kfirst * _weights[n])
+				return false;
+		}
+	return true;
+}
+
+// Spreads the region following the weights by applying a preferred policy
+// to consecutive stripes, e.g. with weights 3,1 the first three stripes go
+// to the first node and the fourth to the second. Each stripe becomes a
+// mapping on its own, so they are made large enough to bound their number.
+bool AllocatorNUMA::stripe_region (void *p, size_t size)
+{
+	size_t period = 0;
+	for (unsigned n = 0; n < MAX_NODES; ++n)
+		if (_nodemask & (1UL << n))
+			period += _weights[n];
+
+	size_t stripe = MAX(STRIPE_GRANULE,
+	  (size / MAX_STRIPES + STRIPE_GRANULE - 1) & ~(STRIPE_GRANULE - 1));
+
+	size_t offset = 0;
+	while (offset < size)
+		for (unsigned n = 0; n < MAX_NODES && offset < size; ++n)
+			if (_nodemask & (1UL << n))
+			{
+				size_t len = MIN(stripe * _weights[n], size - offset);
+				if (!bind_region ((char*) p + offset, len, MPOL_PREFERRED, 1UL << n))
+					return false;
+				offset += len;
+			}
+
+	VERBOSE_MSG(1, ALLOCATOR_NAME": Striped %lu MBytes in stripes of %lu KBytes.\n",
+	  size >> 20, stripe >> 10);
+	return true;
+}
+
+// Applies the interleave policies to the arena region. The weighted policies
+// depend on the kernel version, so if they cannot be applied the pages are
+// interleaved evenly instead.
+bool AllocatorNUMA::interleave_region (void *p, size_t size, char *label, size_t label_size)
+{
+	if (_policy == NUMA_POLICY_WEIGHTED_INTERLEAVE)
+	{
+		char weights[4*MAX_NODES] = "";
+		for (unsigned n = 0, l = 0; n < MAX_NODES; ++n)
+			if (_nodemask & (1UL << n))
+				l += snprintf (&weights[l], sizeof(weights) - l, "%s%u", l > 0 ? "," : "", _weights[n]);
+
+		if (kernel_weights_match() &&
+		    bind_region (p, size, MEMPOLICY_WEIGHTED_INTERLEAVE, _nodemask))
+		{
+			snprintf (label, label_size, "weighted-interleaved (%s) on node mask 0x%lx", weights, _nodemask);
+			return true;
+		}
+		VERBOSE_MSG(1, ALLOCATOR_NAME": Kernel weighted interleave is not available or its weights differ, striping instead.\n");
+		if (stripe_region (p, size))
+		{
+			snprintf (label, label_size, "striped (%s) on node mask 0x%lx", weights, _nodemask);
+			return true;
+		}
+		// The plain interleave below replaces the policy of the stripes already bound
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Could not stripe the arena (%s), falling back to plain interleave.\n",
+		  strerror (errno));
+	}
+	else if (_policy == NUMA_POLICY_PREFERRED_MANY)
+	{
+		if (bind_region (p, size, MEMPOLICY_PREFERRED_MANY, _nodemask))
+		{
+			snprintf (label, label_size, "preferring node mask 0x%lx", _nodemask);
+			return true;
+		}
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Kernel does not support preferred-many (%s), falling back to plain interleave.\n",
+		  strerror (errno));
+	}
+
+	snprintf (label, label_size, "interleaved on node mask 0x%lx", _nodemask);
+	return bind_region (p, size, MPOL_INTERLEAVE, _nodemask);
+}
+
+void AllocatorNUMA::configure (const char *config)
+{
+	const char * MEMORYCONFIG_SIZE = "Size ";
+	const char * MEMORYCONFIG_MBYTES_SUFFIX = " MBytes";
+	const char * MEMORYCONFIG_NODES = " Nodes ";
+	const char * MEMORYCONFIG_POLICY = " Policy ";
+	const char * MEMORYCONFIG_WEIGHTS = " Weights ";
+
+	if (strncmp (config, MEMORYCONFIG_SIZE, strlen(MEMORYCONFIG_SIZE)) == 0)
+	{
+		// Get given size after the Size marker
+		char *pEnd = nullptr;
+		long long s_size = strtoll (&config[strlen(MEMORYCONFIG_SIZE)], &pEnd, 10);
+		// Was text converted into s? If so, now look for suffix
+		if (pEnd != &config[strlen(MEMORYCONFIG_SIZE)])
+		{
+			if (strncmp (pEnd, MEMORYCONFIG_MBYTES_SUFFIX, strlen(MEMORYCONFIG_MBYTES_SUFFIX)) == 0)
+			{
+				size_t s;
+				if (s_size < 0)
+				{
+					VERBOSE_MSG(1, ALLOCATOR_NAME": Invalid given size.\n");
+					exit (1);
+				}
+				else
+					s = s_size;
+				VERBOSE_MSG(1, ALLOCATOR_NAME": Setting up size %lu MBytes per node.\n", s);
+				size (s << 20);
+
+				// Followed by the node list
+				const char *p = pEnd + strlen(MEMORYCONFIG_MBYTES_SUFFIX);
+				if (strncmp (p, MEMORYCONFIG_NODES, strlen(MEMORYCONFIG_NODES)) != 0 ||
+				    !parse_nodes (p + strlen(MEMORYCONFIG_NODES), &p))
+				{
+					VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid node list. Nodes are given as a list of numbers and ranges (e.g. 0,2-3).\n");
+					exit (1);
+				}
+
+				// And optionally by the memory policy
+				if (strncmp (p, MEMORYCONFIG_POLICY, strlen(MEMORYCONFIG_POLICY)) == 0)
+				{
+					p += strlen(MEMORYCONFIG_POLICY);
+					if (strcmp (p, "bind") == 0)
+						_policy = NUMA_POLICY_BIND;
+					else if (strcmp (p, "preferred") == 0)
+						_policy = NUMA_POLICY_PREFERRED;
+					else if (strcmp (p, "interleave") == 0)
+						_policy = NUMA_POLICY_INTERLEAVE;
+					else if (strcmp (p, "preferred-many") == 0)
+						_policy = NUMA_POLICY_PREFERRED_MANY;
+					else if (strncmp (p, "weighted-interleave", strlen("weighted-interleave")) == 0)
+					{
+						_policy = NUMA_POLICY_WEIGHTED_INTERLEAVE;
+						p += strlen("weighted-interleave");
+						// Optionally followed by the node weights, which default to 1
+						if (strncmp (p, MEMORYCONFIG_WEIGHTS, strlen(MEMORYCONFIG_WEIGHTS)) == 0)
+						{
+							if (!parse_weights (p + strlen(MEMORYCONFIG_WEIGHTS)))
+							{
+								VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid weights. Give one weight between 1 and 255 per node in the list.\n");
+								exit (1);
+							}
+						}
+						else if (*p != '\0')
+						{
+							VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid weights specification.\n");
+							exit (1);
+						}
+					}
+					else
+					{
+						VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid policy. Available policies are bind, preferred, interleave, weighted-interleave and preferred-many.\n");
+						exit (1);
+					}
+				}
+				else if (*p != '\0')
+				{
+					VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid policy specification.\n");
+					exit (1);
+				}
+			}
+			else
+			{
+				VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid size suffix.\n");
+				exit (1);
+			}
+		}
+		else
+		{
+			VERBOSE_MSG(0, ALLOCATOR_NAME": Could not parse given size.\n");
+			exit (1);
+		}
+	}
+	else
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Wrong configuration for the allocator. Available options include:\n"
+		               " Size <NUM> MBytes Nodes <LIST> [Policy bind|preferred|interleave|preferred-many]\n"
+		               " Size <NUM> MBytes Nodes <LIST> Policy weighted-interleave [Weights <LIST>]\n");
+		exit (1);
+	}
+
+	// Set up the arenas. Nodes missing in this machine are skipped, and if
+	// no arena can be created the objects are served through posix calls
+	size_t page_size = sysconf (_SC_PAGESIZE);
+	size_t node_size = (this->size() + page_size - 1) & ~(page_size - 1);
+	if (_policy != NUMA_POLICY_BIND && _policy != NUMA_POLICY_PREFERRED)
+	{
+		size_t region_size = node_size * __builtin_popcountl (_nodemask);
+		void *p = map_region (region_size);
+		if (p != nullptr)
+		{
+			char label[64];
+			if (interleave_region (p, region_size, label, sizeof(label)))
+				add_arena (p, region_size, label);
+			else
+			{
+				VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Could not apply the memory policy to %lu MBytes with node mask 0x%lx (%s).\n",
+				  region_size >> 20, _nodemask, strerror (errno));
+				munmap (p, region_size);
+			}
+		}
+	}
+	else
+	{
+		int mode = _policy == NUMA_POLICY_BIND ? MPOL_BIND : MPOL_PREFERRED;
+		for (unsigned n = 0; n < MAX_NODES; ++n)
+			if (_nodemask & (1UL << n))
+			{
+				void *p = map_region (node_size);
+				if (p != nullptr && !bind_region (p, node_size, mode, 1UL << n))
+				{
+					VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Could not apply the memory policy to %lu MBytes on node %u (%s).\n",
+					  node_size >> 20, n, strerror (errno));
+					munmap (p, node_size);
+				}
+				else if (p != nullptr)
+				{
+					char label[64];
+					snprintf (label, sizeof(label), "%s node %u",
+					  _policy == NUMA_POLICY_BIND ? "bound to" : "preferring", n);
+					_arena_of_node[n] = _narenas;
+					add_arena (p, node_size, label);
+				}
+			}
+	}
+	if (_narenas == 0)
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! No arena could be set up. Allocations will be served through posix calls.\n");
+
+	_is_ready = true;
+}
+
+// The pages of the arenas follow the configured policy. Those that mbind
+// does not take with several nodes are approximated by interleaving them.
+bool AllocatorNUMA::mempolicy (int &mode, unsigned long &nodemask)
+{
+	if (!_is_ready || _nodemask == 0)
+		return false;
+
+	nodemask = _nodemask;
+	if (_policy == NUMA_POLICY_BIND)
+		mode = MPOL_BIND;
+	else if (_policy == NUMA_POLICY_PREFERRED && __builtin_popcountl (_nodemask) == 1)
+		mode = MPOL_PREFERRED;
+	else
+		mode = MPOL_INTERLEAVE;
+	return true;
+}
+
+// Try first the node of the calling CPU, so that with several nodes in the
+// set each thread fills its local one before spilling into the others
+unsigned AllocatorNUMA::preferred_arena (void) const
+{
+	unsigned cpu, node;
+	if (syscall (SYS_getcpu, &cpu, &node, nullptr) == 0 &&
+	    node < MAX_NODES && _arena_of_node[node] >= 0)
+		return _arena_of_node[node];
+	return 0;
+}
+
+const char * AllocatorNUMA::name (void) const
+{
+	return ALLOCATOR_NAME;
+}
+
+const char * AllocatorNUMA::description (void) const
+{
+	return "Allocator based on arenas bound to NUMA nodes (mbind)";
+}
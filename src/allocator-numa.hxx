@@ -0,0 +1,48 @@
+// License: To determine
+
+#pragma once
+
+#include "allocator-arena.hxx"
+
+// Allocator that places the objects in arenas whose pages are bound to a
+// set of NUMA nodes through mbind, no matter which thread allocates them.
+// With the bind and preferred policies there is one arena per node (each
+// limited to the given size), and the arena of the node of the calling CPU
+// is tried first if it belongs to the set. With the interleave policies the
+// pages of a single arena are spread across the nodes in the set, either
+// evenly or following per-node weights (e.g. to split the bandwidth-bound
+// objects between DRAM and CXL or HBM nodes in a chosen ratio).
+class AllocatorNUMA final : public AllocatorArena
+{
+	public:
+	typedef enum { NUMA_POLICY_BIND, NUMA_POLICY_PREFERRED, NUMA_POLICY_INTERLEAVE,
+	  NUMA_POLICY_WEIGHTED_INTERLEAVE, NUMA_POLICY_PREFERRED_MANY } numa_policy_t;
+
+	private:
+	static const unsigned MAX_NODES = 64;
+	static const size_t MAX_STRIPES = 4096; // bounds the mappings created when striping
+
+	unsigned long _nodemask;
+	numa_policy_t _policy;
+	int _arena_of_node[MAX_NODES]; // arena index for each node, or -1
+	unsigned _weights[MAX_NODES];  // for the weighted interleave policy
+
+	bool parse_nodes (const char *, const char **);
+	bool parse_weights (const char *);
+	void * map_region (size_t);
+	bool kernel_weights_match (void) const;
+	bool stripe_region (void *, size_t);
+	bool interleave_region (void *, size_t, char *, size_t);
+
+	protected:
+	unsigned preferred_arena (void) const;
+
+	public:
+	AllocatorNUMA (allocation_functions_t &);
+	~AllocatorNUMA();
+
+	void   configure (const char *);
+	bool   mempolicy (int &, unsigned long &);
+	const char * name (void) const;
+	const char * description (void) const;
+};
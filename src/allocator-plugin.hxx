@@ -0,0 +1,40 @@
+// License: To determine
+
+#pragma once
+
+#include <new>
+#include "plugin-abi.hxx"
+#include "allocator.hxx"
+
+class Allocators;
+
+// Interface for the allocators built as shared libraries and loaded at
+// run-time from the memory definitions file through
+//
+//   # Allocator plugin /path/to/libmyallocator.so
+//
+// A plugin implements an Allocator subclass against these headers and
+// declares it once with FLEXMALLOC_ALLOCATOR_PLUGIN(MyAllocator). Its
+// symbols (AllocatorStatistics, options, ...) are resolved against the
+// FlexMalloc library already loaded in the process. Once loaded, the
+// allocator is configured and referenced by its name() as any other one.
+// Plugins built for a different ABI version (see plugin-abi.hxx) or with
+// another size of Allocator are refused.
+
+typedef struct
+{
+	unsigned abi_version;
+	size_t allocator_size; // sizeof(Allocator) seen by the plugin
+	// Constructs the allocator. The Allocators are given so that the
+	// allocator may build on the ones defined before it.
+	Allocator * (*create) (allocation_functions_t &, Allocators *);
+} flexmalloc_plugin_t;
+
+#define FLEXMALLOC_ALLOCATOR_PLUGIN(CLASS) \
+	static Allocator * flexmalloc_plugin_create_##CLASS (allocation_functions_t &af, Allocators *allocators) \
+	{ \
+		void *p = af.malloc (sizeof(CLASS)); \
+		return p != nullptr ? new (p) CLASS (af, allocators) : nullptr; \
+	} \
+	extern "C" const flexmalloc_plugin_t flexmalloc_allocator_plugin = \
+	  { FLEXMALLOC_PLUGIN_ABI_VERSION, sizeof(Allocator), flexmalloc_plugin_create_##CLASS };
@@ -2,18 +2,31 @@
 // Date: Feb 10, 2017
 // License: To determine
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/mempolicy.h>
 
 #include "common.hxx"
 #include "allocator-posix.hxx"
 
 #define ALLOCATOR_NAME "posix"
 
+// Macro to align an address to the nearest power of two
+#ifndef align_to
+# define align_to(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
+#endif
+
 AllocatorPOSIX::AllocatorPOSIX (allocation_functions_t &af)
-  : Allocator (af)
+  : Allocator (af), _page_size (sysconf (_SC_PAGESIZE)), _nmapped (0), _nremapped (0),
+    _remapped_bytes (0)
 {
 }
 
@@ -21,10 +34,67 @@ AllocatorPOSIX::~AllocatorPOSIX ()
 {
 }
 
+// Length of the mapping holding ptr, which starts at hdr->base_ptr()
+size_t AllocatorPOSIX::length (const Allocator::Header_t *hdr, const void *ptr) const
+{
+	return align_to ((uintptr_t) ptr - (uintptr_t) hdr->base_ptr() + hdr->size(), _page_size);
+}
+
+void * AllocatorPOSIX::map_object (size_t total)
+{
+	void *p = mmap (nullptr, align_to (total, _page_size), PROT_READ|PROT_WRITE,
+	  MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return nullptr;
+	_nmapped++;
+	return p;
+}
+
+// Gives back the pages mapped for the object at base beyond those that
+// length() accounts for, as with the room for the alignment
+void AllocatorPOSIX::trim_object (void *base, size_t total, const Allocator::Header_t *hdr, const void *ptr)
+{
+	size_t mapped = align_to (total, _page_size), len = length (hdr, ptr);
+	if (len < mapped)
+		munmap ((char*) base + len, mapped - len);
+}
+
+// Grows the mapping of the object at ptr, in place if the address space
+// after it is free and otherwise by moving its pages to a new range, so the
+// contents are never copied
+void * AllocatorPOSIX::remap_object (void *ptr, Allocator::Header_t *hdr, size_t size)
+{
+	void *prev_baseptr = hdr->base_ptr();
+	size_t prev_size = hdr->size();
+	size_t prev_len = length (hdr, ptr);
+	uintptr_t extra_size = Allocator::getExtraSize (hdr);
+	size_t len = align_to (Allocator::getTotalSize (size + extra_size), _page_size);
+
+	if (len == prev_len)
+	{
+		hdr->size (size);
+		return ptr;
+	}
+
+	void *new_baseptr = mremap (prev_baseptr, prev_len, len, MREMAP_MAYMOVE);
+	if (new_baseptr == MAP_FAILED)
+		return nullptr;
+	_nremapped++;
+	_remapped_bytes += prev_size;
+
+	void *res = Allocator::generateAllocatorHeader (new_baseptr, extra_size, this, size);
+	DBG("Remapped (%ld->%ld [extra bytes = %lu]) from %p (base at %p) into %p (base at %p) w/ allocator %s (%p)\n", prev_size, size, extra_size, ptr, prev_baseptr, res, new_baseptr, name(), this);
+	if (res != ptr)
+		Allocator::releaseAllocatorHeader (ptr);
+	return res;
+}
+
 void * AllocatorPOSIX::malloc (size_t size)
 {
-	// Forward memory request to real malloc and reserve some space for the header
-	void * baseptr = _af.malloc (Allocator::getTotalSize (size));
+	// Forward memory request to real malloc, or map it if large, and reserve
+	// some space for the header
+	void * baseptr = is_mapped (size) ? map_object (Allocator::getTotalSize (size))
+	                                  : _af.malloc (Allocator::getTotalSize (size));
 	void * res = nullptr;
 
 	// If malloc succeded, then forge a header and the pointer points to the 
@@ -43,9 +113,11 @@ void * AllocatorPOSIX::malloc (size_t size)
 
 void * AllocatorPOSIX::calloc (size_t nmemb, size_t size)
 {
-	// Forward memory request to real malloc and request additional space to store
-	// the allocator and the basepointer
-	void * baseptr = _af.malloc (Allocator::getTotalSize (nmemb * size));
+	// Forward memory request to real calloc, which does not clear the memory it
+	// knows to be zero, and request additional space to store the allocator and
+	// the basepointer. Fresh mappings are already zeroed.
+	void * baseptr = is_mapped (nmemb * size) ? map_object (Allocator::getTotalSize (nmemb * size))
+	                                          : _af.calloc (1, Allocator::getTotalSize (nmemb * size));
 	void * res = nullptr;
 
 	// If malloc succeded, then forge a header and the pointer points to the 
@@ -66,19 +138,44 @@ int AllocatorPOSIX::posix_memalign (void **ptr, size_t align, size_t size)
 {
 	assert (ptr != nullptr);
 
-	// Forward memory request to real malloc and request additional space to
-	// store the allocator and the basepointer
-	void * baseptr = _af.malloc (Allocator::getTotalSize (size + align));
+	// Aligned entry points of the backend take no more than the object,
+	// otherwise request additional space to store the header in front of it
+	bool native = Allocator::nativeAlignment (align);
+	bool mapped = is_mapped (size);
+	size_t total = native ? size : Allocator::getTotalSize (size + align);
+	void * baseptr = nullptr;
+	if (mapped)
+	{
+		// Mappings are page aligned, and the native ones start right at the
+		// alignment, so the range in front of it is given back
+		size_t lead = native && align > _page_size ? align : 0;
+		baseptr = map_object (total + lead);
+		if (baseptr != nullptr && lead > 0)
+		{
+			char *aligned = (char*) align_to ((uintptr_t) baseptr, align);
+			if (aligned > (char*) baseptr)
+				munmap (baseptr, aligned - (char*) baseptr);
+			total += lead - (aligned - (char*) baseptr);
+			baseptr = aligned;
+		}
+	}
+	else if (!native)
+		baseptr = _af.malloc (total);
+	else if (_af.posix_memalign (&baseptr, align, size) != 0)
+		baseptr = nullptr;
 	void * res = nullptr;
 	// If malloc succeded, then forge a header and the pointer points to the 
 	// data space after the header
 	if (baseptr)
 	{
-		res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
+		res = native ? Allocator::generateAllocatorHeaderOnNative (baseptr, this, size)
+		             : Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
+		if (mapped)
+			trim_object (baseptr, total, Allocator::getAllocatorHeader (res), res);
 
 		// Verbosity and emit statistics
 		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr %p, base %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), baseptr, name(), this);
-		_stats.record_aligned_malloc (size + align);
+		_stats.record_aligned_malloc (native ? size : size + align);
 
 		*ptr = res;
 		return 0;
@@ -92,10 +189,16 @@ void AllocatorPOSIX::free (void *ptr)
 	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
 
 	// When freeing the memory, need to free the base pointe
-	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size, hdr->base_ptr);
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size(), hdr->base_ptr());
 	
-	_stats.record_free (hdr->size);
-	_af.free (hdr->base_ptr);
+	_stats.record_free (hdr->size());
+	void *base = hdr->base_ptr();
+	size_t len = is_mapped (hdr->size()) ? length (hdr, ptr) : 0;
+	Allocator::releaseAllocatorHeader (ptr);
+	if (len > 0)
+		munmap (base, len);
+	else
+		_af.free (base);
 }
 
 void * AllocatorPOSIX::realloc (void *ptr, size_t size)
@@ -106,13 +209,67 @@ void * AllocatorPOSIX::realloc (void *ptr, size_t size)
 	{
 		// Search for previous allocation size through the header
 		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
-		size_t prev_size = prev_hdr->size;
-		void * prev_baseptr = prev_hdr->base_ptr;
+		size_t prev_size = prev_hdr->size();
+		void * prev_baseptr = prev_hdr->base_ptr();
 		uintptr_t extra_size = Allocator::getExtraSize (prev_hdr);
 
-		if (prev_size < size)
+		if (prev_size < size && !Allocator::growsInBackend (prev_hdr))
 		{
-			// Reallocate, from base pointer to fit the new size plus a new header
+			// Objects from aligned entry points may have to move, which malloc and free
+			// already account for
+			void *res = this->malloc (size);
+			if (res != nullptr)
+			{
+				this->memcpy (res, ptr, prev_size);
+				this->free (ptr);
+			}
+			return res;
+		}
+		else if (prev_size < size && is_mapped (prev_size))
+		{
+			void *res = remap_object (ptr, prev_hdr, size);
+			_stats.record_realloc (size, prev_size);
+			return res;
+		}
+		else if (prev_size < size && is_mapped (size))
+		{
+			// Objects crossing the threshold move from the heap into a mapping
+			void *res = this->malloc (size);
+			if (res != nullptr)
+			{
+				this->memcpy (res, ptr, prev_size);
+				this->free (ptr);
+			}
+			return res;
+		}
+		else if (Allocator::shrinks (prev_size, size) && is_mapped (size))
+		{
+			// The tail of the mapping is unmapped, the object stays in place
+			size_t len = align_to ((uintptr_t) ptr - (uintptr_t) prev_baseptr + size, _page_size);
+			size_t prev_len = length (prev_hdr, ptr);
+			if (len < prev_len)
+				munmap ((char*) prev_baseptr + len, prev_len - len);
+			prev_hdr->size (size);
+			_stats.record_shrink_realloc (size, prev_size);
+			return ptr;
+		}
+		else if (Allocator::shrinks (prev_size, size) &&
+		         (is_mapped (prev_size) || !Allocator::growsInBackend (prev_hdr)))
+		{
+			// Objects falling below the threshold move back to the heap, as do
+			// those from aligned entry points, or are left untouched if they
+			// cannot
+			void *res = this->malloc (size);
+			if (res == nullptr)
+				return ptr;
+			this->memcpy (res, ptr, size);
+			this->free (ptr);
+			return res;
+		}
+		else if (prev_size < size || Allocator::shrinks (prev_size, size))
+		{
+			// Reallocate, from base pointer to fit the new size plus a new header.
+			// When shrinking, libc gives the tail back to the heap.
 			void *new_baseptr = _af.realloc (prev_baseptr, Allocator::getTotalSize (size + extra_size));
 			void *res = nullptr;
 
@@ -122,9 +279,14 @@ void * AllocatorPOSIX::realloc (void *ptr, size_t size)
 			{
 				res = Allocator::generateAllocatorHeader (new_baseptr, extra_size, this, size);
 				DBG("Reallocated (%ld->%ld [extra bytes = %lu]) from %p (base at %p, header at %p) into %p (base at %p, header at %p) w/ allocator %s (%p)\n", prev_size, size, extra_size, ptr, prev_baseptr, prev_hdr, res, new_baseptr, Allocator::getAllocatorHeader (res), name(), this);
+				if (res != ptr)
+					Allocator::releaseAllocatorHeader (ptr);
 			}
 
-			_stats.record_realloc (size, prev_size);
+			if (prev_size < size)
+				_stats.record_realloc (size, prev_size);
+			else
+				_stats.record_shrink_realloc (size, prev_size);
 
 			return res;
 		}
@@ -150,9 +312,9 @@ size_t AllocatorPOSIX::malloc_usable_size (void* ptr)
 	// When checking for the usable size, return the size we requested originally, no matter
 	// what the underlying library did. This may alter execution behaviors, though.
 	VERBOSE_MSG(3, ALLOCATOR_NAME": Checking usable size on pointer %p w/ size - %lu (but base pointer located in %p)\n",
-	  ptr, hdr->size, hdr->base_ptr);
+	  ptr, hdr->size(), hdr->base_ptr());
 
-	return hdr->size;
+	return hdr->size();
 }
 
 void AllocatorPOSIX::configure (const char *config)
@@ -203,6 +365,14 @@ void AllocatorPOSIX::configure (const char *config)
 	_is_ready = true;
 }
 
+// Regular allocations follow the default (local) policy of the process
+bool AllocatorPOSIX::mempolicy (int &mode, unsigned long &nodemask)
+{
+	mode = MPOL_DEFAULT;
+	nodemask = 0;
+	return true;
+}
+
 const char * AllocatorPOSIX::name (void) const
 {
 	return ALLOCATOR_NAME;
@@ -216,6 +386,9 @@ const char * AllocatorPOSIX::description (void) const
 void AllocatorPOSIX::show_statistics (void) const
 {
 	_stats.show_statistics (ALLOCATOR_NAME, true);
+	if (_nmapped > 0)
+		VERBOSE_MSG(1, ALLOCATOR_NAME": %llu objects mapped on their own, %llu grown through mremap (%llu MBytes not copied).\n",
+		  _nmapped, _nremapped, _remapped_bytes >> 20);
 }
 
 bool AllocatorPOSIX::fits (size_t s) const
@@ -7,10 +7,25 @@
 #include "allocator.hxx"
 #include <string.h>
 
+// Objects above the mmap threshold are given a mapping of their own, so that
+// realloc grows them by remapping their pages rather than copying them. They
+// are told apart from the objects of the libc heap through their size, so
+// they move between the heap and a mapping when realloc crosses it.
 class AllocatorPOSIX final : public Allocator
 {
 	private:
 	AllocatorStatistics _stats;
+	size_t _page_size;
+	unsigned long long _nmapped;
+	unsigned long long _nremapped;
+	unsigned long long _remapped_bytes; // not copied thanks to mremap
+
+	bool is_mapped (size_t size) const
+	  { return options.mmapThreshold() > 0 && size >= options.mmapThreshold(); }
+	size_t length (const Allocator::Header_t *, const void *) const;
+	void * map_object (size_t);
+	void trim_object (void *base, size_t total, const Allocator::Header_t *, const void *);
+	void * remap_object (void *, Allocator::Header_t *, size_t);
 
 	public:
 	AllocatorPOSIX(allocation_functions_t &);
@@ -24,6 +39,7 @@ class AllocatorPOSIX final : public Allocator
 	size_t malloc_usable_size (void*);
 
 	void   configure (const char *);
+	bool   mempolicy (int &, unsigned long &);
 	const char * name (void) const;
 	const char * description (void) const;
 	void show_statistics (void) const;
@@ -32,6 +48,14 @@ class AllocatorPOSIX final : public Allocator
 	  { return ::memcpy (dest, src, n); }
 
 	bool fits (size_t s) const;
+	size_t available (void) const
+	  { return _stats.water_mark() < this->size() ? this->size() - _stats.water_mark() : 0; }
+	bool owns_pages (void *ptr)
+	  { return is_mapped (Allocator::getAllocatorHeader (ptr)->size()); }
+	void charge (size_t s)
+	  { _stats.record_charge (s); }
+	void discharge (size_t s)
+	  { _stats.record_discharge (s); }
 	size_t hwm (void) const
 	  { return _stats.water_mark(); }
 	void record_unfitted_malloc (size_t s)
@@ -0,0 +1,588 @@
+// License: To determine
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "common.hxx"
+#include "allocators.hxx"
+#include "allocator-slab.hxx"
+
+#define ALLOCATOR_NAME "slab"
+
+// Macro to align an address to the nearest power of two
+#ifndef align_to
+# define align_to(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
+#endif
+
+AllocatorSlab::AllocatorSlab (allocation_functions_t &af, Allocators *allocators)
+  : Allocator (af), _allocators (allocators), _backing (nullptr),
+    _abandoned (nullptr), _empty (nullptr), _carve (nullptr), _ncarve (0),
+    _table (nullptr), _table_mask (0), _nchunks (0), _nheaps (0),
+    _nremote_frees (0), _nlarge (0)
+{
+	pthread_mutex_init (&_mtx, nullptr);
+	pthread_key_create (&_heap_key, AllocatorSlab::heap_release);
+}
+
+AllocatorSlab::~AllocatorSlab ()
+{
+}
+
+// Size classes are 16-byte spaced up to 256 bytes, and then 4 classes per
+// power of two up to MAX_SMALL_SIZE. Sizes include the allocator header.
+unsigned AllocatorSlab::size_class (size_t total)
+{
+	if (total <= 256)
+		return (total + 15) / 16 - 1;
+	unsigned lg = 63 - __builtin_clzl (total - 1);
+	unsigned quarter = ((total - 1) >> (lg - 2)) & 3;
+	return 16 + (lg - 8) * 4 + quarter;
+}
+
+size_t AllocatorSlab::class_size (unsigned c)
+{
+	if (c < 16)
+		return (c + 1) * 16;
+	unsigned lg = 8 + (c - 16) / 4;
+	return (1UL << lg) + ((c - 16) % 4 + 1) * (1UL << (lg - 2));
+}
+
+// Invoked at thread exit. The heap keeps its slabs (there may be objects
+// still in use by other threads) and is handed to the next new thread.
+void AllocatorSlab::heap_release (void *p)
+{
+	heap_t *h = (heap_t*) p;
+	AllocatorSlab *a = h->allocator;
+
+	pthread_mutex_lock (&a->_mtx);
+	h->next = a->_abandoned;
+	a->_abandoned = h;
+	pthread_mutex_unlock (&a->_mtx);
+}
+
+AllocatorSlab::heap_t * AllocatorSlab::heap (void)
+{
+	heap_t *h = (heap_t*) pthread_getspecific (_heap_key);
+	if (LIKELY(h != nullptr))
+		return h;
+
+	pthread_mutex_lock (&_mtx);
+	if (_abandoned != nullptr)
+	{
+		h = _abandoned;
+		_abandoned = h->next;
+	}
+	else
+	{
+		h = (heap_t*) _af.calloc (1, sizeof(heap_t));
+		if (h != nullptr)
+		{
+			h->allocator = this;
+			_nheaps++;
+		}
+	}
+	pthread_mutex_unlock (&_mtx);
+
+	if (h != nullptr)
+		pthread_setspecific (_heap_key, h);
+	return h;
+}
+
+// Slabs are never given back to the backing tier, so the table only grows
+// and can be read without locking.
+AllocatorSlab::slab_t * AllocatorSlab::lookup (const void *p) const
+{
+	if (_table == nullptr)
+		return nullptr;
+
+	uintptr_t index = (uintptr_t) p >> SLAB_SHIFT;
+	for (unsigned u = index & _table_mask; _table[u] != nullptr; u = (u + 1) & _table_mask)
+		if ((_table[u]->base >> SLAB_SHIFT) == index)
+			return _table[u];
+	return nullptr;
+}
+
+void AllocatorSlab::register_slab (slab_t *s)
+{
+	unsigned u = (s->base >> SLAB_SHIFT) & _table_mask;
+	while (_table[u] != nullptr)
+		u = (u + 1) & _table_mask;
+	__sync_synchronize ();
+	_table[u] = s;
+}
+
+// Requests a new chunk from the backing tier, unless this would exceed the
+// size given to this allocator. Called with _mtx held.
+bool AllocatorSlab::new_chunk (void)
+{
+	if ((_nchunks + 1) * CHUNK_SIZE > size())
+		return false;
+
+	void *p = _backing->malloc (CHUNK_SIZE + SLAB_SIZE);
+	if (p == nullptr)
+		return false;
+
+	slab_t *slabs = (slab_t*) _af.calloc (SLABS_PER_CHUNK, sizeof(slab_t));
+	if (slabs == nullptr)
+	{
+		_backing->free (p);
+		return false;
+	}
+
+	uintptr_t base = align_to ((uintptr_t) p, SLAB_SIZE);
+	for (unsigned u = 0; u < SLABS_PER_CHUNK; ++u)
+	{
+		slabs[u].base = base + u * SLAB_SIZE;
+		register_slab (&slabs[u]);
+	}
+	_carve = slabs;
+	_ncarve = SLABS_PER_CHUNK;
+	_nchunks++;
+
+	VERBOSE_MSG(2, ALLOCATOR_NAME": Obtained chunk %u at %p from %s\n", _nchunks, p, _backing->name());
+	return true;
+}
+
+AllocatorSlab::slab_t * AllocatorSlab::new_slab (heap_t *h, unsigned c)
+{
+	slab_t *s = nullptr;
+
+	pthread_mutex_lock (&_mtx);
+	if (_empty != nullptr)
+	{
+		s = _empty;
+		_empty = s->next;
+	}
+	else if (_ncarve > 0 || new_chunk ())
+	{
+		s = _carve++;
+		_ncarve--;
+	}
+	pthread_mutex_unlock (&_mtx);
+
+	if (s != nullptr)
+	{
+		s->owner = h;
+		s->sclass = c;
+		s->obj_size = class_size (c);
+		s->capacity = SLAB_SIZE / s->obj_size;
+		s->nused = s->bump = 0;
+		s->free = nullptr;
+		s->listed = false;
+		link (h, s);
+	}
+	return s;
+}
+
+void AllocatorSlab::link (heap_t *h, slab_t *s)
+{
+	s->prev = nullptr;
+	s->next = h->partial[s->sclass];
+	if (s->next != nullptr)
+		s->next->prev = s;
+	h->partial[s->sclass] = s;
+	s->listed = true;
+}
+
+void AllocatorSlab::unlink (heap_t *h, slab_t *s)
+{
+	if (s->prev != nullptr)
+		s->prev->next = s->next;
+	else
+		h->partial[s->sclass] = s->next;
+	if (s->next != nullptr)
+		s->next->prev = s->prev;
+	s->listed = false;
+}
+
+void AllocatorSlab::drain_remote (heap_t *h)
+{
+	void *obj = __sync_lock_test_and_set (&h->remote, nullptr);
+	while (obj != nullptr)
+	{
+		void *next = *(void**) obj;
+		local_free (h, lookup (obj), obj);
+		obj = next;
+	}
+}
+
+// Returns an object able to hold total bytes (header included) from the
+// thread heap, or nullptr if the slabs are exhausted.
+void * AllocatorSlab::alloc_object (size_t total)
+{
+	heap_t *h = heap ();
+	if (UNLIKELY(h == nullptr))
+		return nullptr;
+
+	if (h->remote != nullptr)
+		drain_remote (h);
+
+	unsigned c = size_class (total);
+	slab_t *s = h->partial[c];
+	while (s != nullptr)
+	{
+		void *obj = s->free;
+		if (obj != nullptr)
+		{
+			s->free = *(void**) obj;
+			s->nused++;
+			return obj;
+		}
+		if (s->bump < s->capacity)
+		{
+			s->nused++;
+			return (void*) (s->base + (s->bump++) * s->obj_size);
+		}
+		// Full slab, it will be linked again when any of its objects is freed
+		unlink (h, s);
+		s = h->partial[c];
+	}
+
+	s = new_slab (h, c);
+	if (s == nullptr)
+		return nullptr;
+	s->nused++;
+	return (void*) (s->base + (s->bump++) * s->obj_size);
+}
+
+void AllocatorSlab::local_free (heap_t *h, slab_t *s, void *obj)
+{
+	*(void**) obj = s->free;
+	s->free = obj;
+	s->nused--;
+
+	if (!s->listed)
+		link (h, s);
+	else if (s->nused == 0 && h->partial[s->sclass] != s)
+	{
+		// Keep the first slab of the class, hand the rest to other classes
+		unlink (h, s);
+		s->owner = nullptr;
+		pthread_mutex_lock (&_mtx);
+		s->next = _empty;
+		_empty = s;
+		pthread_mutex_unlock (&_mtx);
+	}
+}
+
+void AllocatorSlab::free_object (slab_t *s, void *obj)
+{
+	heap_t *owner = s->owner;
+	if (owner == (heap_t*) pthread_getspecific (_heap_key))
+		local_free (owner, s, obj);
+	else
+	{
+		void *head;
+		do
+		{
+			head = owner->remote;
+			*(void**) obj = head;
+		} while (!__sync_bool_compare_and_swap (&owner->remote, head, obj));
+		__sync_fetch_and_add (&_nremote_frees, 1);
+	}
+}
+
+void * AllocatorSlab::malloc (size_t size)
+{
+	size_t total = Allocator::getTotalSize (size);
+	void * baseptr = nullptr;
+	void * res = nullptr;
+
+	if (total <= MAX_SMALL_SIZE)
+		baseptr = alloc_object (total);
+	if (baseptr == nullptr)
+	{
+		// Too large for the slabs (or out of slabs), use the backing tier
+		baseptr = _backing->malloc (total);
+		__sync_fetch_and_add (&_nlarge, 1);
+	}
+
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeader (baseptr, this, size);
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr & base at %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), name(), this);
+		_stats.record_malloc (size);
+	}
+
+	return res;
+}
+
+void * AllocatorSlab::calloc (size_t nmemb, size_t size)
+{
+	size_t total = Allocator::getTotalSize (nmemb * size);
+	void * baseptr = nullptr;
+	void * res = nullptr;
+
+	if (total <= MAX_SMALL_SIZE)
+	{
+		// Slab objects may be reused, so these need to be cleared
+		baseptr = alloc_object (total);
+		if (baseptr != nullptr)
+			::memset ((char*) baseptr + (total - nmemb * size), 0, nmemb * size);
+	}
+	if (baseptr == nullptr)
+	{
+		baseptr = _backing->calloc (1, total);
+		__sync_fetch_and_add (&_nlarge, 1);
+	}
+
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeader (baseptr, this, nmemb * size);
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr & base %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), name(), this);
+		_stats.record_calloc (nmemb * size);
+	}
+
+	return res;
+}
+
+int AllocatorSlab::posix_memalign (void **ptr, size_t align, size_t size)
+{
+	assert (ptr != nullptr);
+
+	size_t total = Allocator::getTotalSize (size + align);
+	void * baseptr = nullptr;
+	void * res = nullptr;
+
+	if (total <= MAX_SMALL_SIZE)
+		baseptr = alloc_object (total);
+	if (baseptr == nullptr)
+	{
+		baseptr = _backing->malloc (total);
+		__sync_fetch_and_add (&_nlarge, 1);
+	}
+
+	if (baseptr)
+	{
+		res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, this, size);
+
+		// Verbosity and emit statistics
+		VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p (hdr %p, base %p) w/ allocator %s (%p)\n", size, res, Allocator::getAllocatorHeader (res), baseptr, name(), this);
+		_stats.record_aligned_malloc (size + align);
+
+		*ptr = res;
+		return 0;
+	}
+	else
+		return ENOMEM;
+}
+
+void AllocatorSlab::free (void *ptr)
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (base pointer located in %p)\n", ptr, hdr, hdr->size(), hdr->base_ptr());
+
+	_stats.record_free (hdr->size());
+	// Large objects share the address with the header of the backing tier
+	void *base = hdr->base_ptr();
+	Allocator::releaseAllocatorHeader (ptr);
+	slab_t *s = lookup (base);
+	if (s != nullptr)
+		free_object (s, base);
+	else
+		_backing->free (base);
+}
+
+void * AllocatorSlab::realloc (void *ptr, size_t size)
+{
+	// If previous pointer is not null, behave normally. otherwise, behave like a malloc but
+	// without calling information
+	if (ptr)
+	{
+		// Search for previous allocation size through the header
+		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
+		size_t prev_size = prev_hdr->size();
+		void * prev_baseptr = prev_hdr->base_ptr();
+		uintptr_t extra_size = Allocator::getExtraSize (prev_hdr);
+
+		if (prev_size < size)
+		{
+			void *res = nullptr;
+			slab_t *s = lookup (prev_baseptr);
+
+			if (s != nullptr && (uintptr_t) prev_baseptr + s->obj_size - (uintptr_t) ptr >= size)
+			{
+				// The object still fits in its slot
+				prev_hdr->size (size);
+				res = ptr;
+			}
+			else if (s == nullptr && extra_size == 0)
+			{
+				// Large object, let the backing tier grow it
+				Allocator::Header_t h = *prev_hdr;
+				Allocator::releaseAllocatorHeader (ptr);
+				void *new_baseptr = _backing->realloc (prev_baseptr, Allocator::getTotalSize (size));
+				if (new_baseptr)
+					res = Allocator::generateAllocatorHeader (new_baseptr, this, size);
+				else
+					Allocator::restoreAllocatorHeader (ptr, h);
+			}
+			else
+			{
+				res = this->malloc (size);
+				if (res)
+				{
+					this->memcpy (res, ptr, prev_size);
+					this->free (ptr);
+				}
+			}
+			DBG("Reallocated (%ld->%ld [extra bytes = %lu]) from %p (base at %p, header at %p) into %p w/ allocator %s (%p)\n", prev_size, size, extra_size, ptr, prev_baseptr, prev_hdr, res, name(), this);
+
+			_stats.record_realloc (size, prev_size);
+
+			return res;
+		}
+		else if (Allocator::shrinks (prev_size, size) && extra_size == 0 && lookup (prev_baseptr) == nullptr)
+		{
+			// Large object, let the backing tier shrink it. Objects in slots
+			// have nothing to give back.
+			void *res = ptr;
+			Allocator::Header_t h = *prev_hdr;
+			Allocator::releaseAllocatorHeader (ptr);
+			void *new_baseptr = _backing->realloc (prev_baseptr, Allocator::getTotalSize (size));
+			if (new_baseptr)
+			{
+				res = Allocator::generateAllocatorHeader (new_baseptr, this, size);
+				_stats.record_shrink_realloc (size, prev_size);
+			}
+			else
+				Allocator::restoreAllocatorHeader (ptr, h);
+			DBG("Shrunk (%ld->%ld) from %p into %p w/ allocator %s (%p)\n", prev_size, size, ptr, res, name(), this);
+
+			return res;
+		}
+		else
+		{
+			DBG("Reallocated (%ld->%ld) from %p but not touching as new size is smaller w/ allocator %s (%p)\n", prev_size, size, ptr, name(), this);
+			return ptr;
+		}
+	}
+	else
+	{
+		VERBOSE_MSG(3, ALLOCATOR_NAME": realloc (NULL, ...) forwarded to malloc\n");
+		_stats.record_realloc_forward_malloc();
+
+		return this->malloc (size);
+	}
+}
+
+size_t AllocatorSlab::malloc_usable_size (void *ptr)
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+
+	// When checking for the usable size, return the size we requested originally, no matter
+	// what the underlying library did. This may alter execution behaviors, though.
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Checking usable size on pointer %p w/ size - %lu (but base pointer located in %p)\n",
+	  ptr, hdr->size(), hdr->base_ptr());
+
+	return hdr->size();
+}
+
+void AllocatorSlab::configure (const char *config)
+{
+	const char * MEMORYCONFIG_SIZE = "Size ";
+	const char * MEMORYCONFIG_MBYTES_SUFFIX = " MBytes";
+	const char * MEMORYCONFIG_BACKING = " @ ";
+	const char * backing = "posix";
+
+	if (strncmp (config, MEMORYCONFIG_SIZE, strlen(MEMORYCONFIG_SIZE)) == 0)
+	{
+		// Get given size after the Size marker
+		char *pEnd = nullptr;
+		long long s_size = strtoll (&config[strlen(MEMORYCONFIG_SIZE)], &pEnd, 10);
+		// Was text converted into s? If so, now look for suffix
+		if (pEnd != &config[strlen(MEMORYCONFIG_SIZE)])
+		{
+			if (strncmp (pEnd, MEMORYCONFIG_MBYTES_SUFFIX, strlen(MEMORYCONFIG_MBYTES_SUFFIX)) == 0)
+			{
+				size_t s;
+				if (s_size < 0)
+				{
+					VERBOSE_MSG(1, ALLOCATOR_NAME": Invalid given size.\n");
+					exit (1);
+				}
+				else
+					s = s_size;
+				VERBOSE_MSG(1, ALLOCATOR_NAME": Setting up size %lu MBytes.\n", s);
+				size (s << 20);
+
+				// Optionally followed by the backing allocator
+				pEnd += strlen(MEMORYCONFIG_MBYTES_SUFFIX);
+				if (strncmp (pEnd, MEMORYCONFIG_BACKING, strlen(MEMORYCONFIG_BACKING)) == 0)
+					backing = pEnd + strlen(MEMORYCONFIG_BACKING);
+				else if (*pEnd != '\0')
+				{
+					VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid backing allocator specification.\n");
+					exit (1);
+				}
+			}
+			else
+			{
+				VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid size suffix.\n");
+				exit (1);
+			}
+		}
+		else
+		{
+			VERBOSE_MSG(0, ALLOCATOR_NAME": Could not parse given size.\n");
+			exit (1);
+		}
+	}
+	else
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Wrong configuration for the allocator. Available options include:\n"
+		               " Size <NUM> MBytes [@ <backing allocator>]\n");
+		exit (1);
+	}
+
+	_backing = _allocators->get (backing);
+	if (_backing == nullptr || _backing == this)
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Invalid backing allocator '%s'.\n", backing);
+		exit (1);
+	}
+	VERBOSE_MSG(1, ALLOCATOR_NAME": Using allocator %s as backing tier.\n", _backing->name());
+	_backing->used (true);
+
+	// Room for twice the slabs that fit in the given size
+	unsigned nslabs = (size() + CHUNK_SIZE - 1) / CHUNK_SIZE * SLABS_PER_CHUNK;
+	unsigned tsize = 1;
+	while (tsize < 2 * nslabs)
+		tsize <<= 1;
+	_table = (slab_t * volatile *) _af.calloc (tsize, sizeof(slab_t*));
+	assert (_table != nullptr);
+	_table_mask = tsize - 1;
+
+	_is_ready = true;
+}
+
+const char * AllocatorSlab::name (void) const
+{
+	return ALLOCATOR_NAME;
+}
+
+const char * AllocatorSlab::description (void) const
+{
+	return "Size-class slab allocator with per-thread caches on top of another allocator";
+}
+
+void AllocatorSlab::show_statistics (void) const
+{
+	_stats.show_statistics (ALLOCATOR_NAME, true);
+	VERBOSE_MSG(1, ALLOCATOR_NAME": %u chunks of %lu MBytes from %s, %u thread caches, %llu remote frees, %llu objects forwarded to %s.\n",
+	  _nchunks, CHUNK_SIZE >> 20, _backing != nullptr ? _backing->name() : "-", _nheaps,
+	  _nremote_frees, _nlarge, _backing != nullptr ? _backing->name() : "-");
+}
+
+bool AllocatorSlab::fits (size_t s) const
+{
+	return _stats.water_mark() + s <= this->size();
+}
@@ -0,0 +1,128 @@
+// License: To determine
+
+#pragma once
+
+#include <pthread.h>
+#include <string.h>
+
+#include "allocator.hxx"
+
+class Allocators;
+
+// Size-class slab allocator layered over another allocator (the backing
+// tier). Memory is requested from the backing tier in large chunks that are
+// split into slabs, each of them holding objects of a single size class.
+// Every thread owns a cache (heap) with the slabs it allocates from, so the
+// allocation fast path takes no lock. Objects freed by a thread other than
+// the owner are pushed into the owner's remote-free queue, which the owner
+// drains on its next allocation. Objects larger than the biggest size class
+// are forwarded to the backing tier.
+class AllocatorSlab final : public Allocator
+{
+	private:
+	static const unsigned SLAB_SHIFT = 16;                  // 64 KBytes slabs
+	static const size_t   SLAB_SIZE = 1UL << SLAB_SHIFT;
+	static const unsigned SLABS_PER_CHUNK = 64;             // 4 MBytes chunks
+	static const size_t   CHUNK_SIZE = SLABS_PER_CHUNK * SLAB_SIZE;
+	static const size_t   MAX_SMALL_SIZE = 16384;           // incl. header
+	static const unsigned NUM_CLASSES = 40;
+
+	struct heap_st;
+
+	typedef struct slab_st
+	{
+		uintptr_t base;
+		struct heap_st *owner;
+		unsigned sclass;
+		unsigned obj_size;
+		unsigned capacity;
+		unsigned nused;      // objects not freed into this slab yet
+		unsigned bump;       // objects ever carved from this slab
+		void *free;          // free objects, only touched by the owner
+		bool listed;         // within owner->partial[sclass]
+		struct slab_st *prev, *next;
+	} slab_t;
+
+	typedef struct heap_st
+	{
+		AllocatorSlab *allocator;
+		slab_t *partial[NUM_CLASSES]; // slabs that may have free objects
+		void * volatile remote;       // objects freed by other threads
+		struct heap_st *next;         // in the abandoned heaps list
+	} heap_t;
+
+	AllocatorStatistics _stats;
+	Allocators * const _allocators;
+	Allocator * _backing;
+
+	pthread_mutex_t _mtx;         // protects the fields below
+	pthread_key_t _heap_key;
+	heap_t *_abandoned;           // heaps from finished threads, reused
+	slab_t *_empty;               // slabs not owned by any heap
+	slab_t *_carve;               // slabs of the last chunk not handed out yet
+	unsigned _ncarve;
+	slab_t * volatile * _table;   // slab index -> slab, open addressing
+	unsigned _table_mask;
+	unsigned _nchunks;
+	unsigned _nheaps;
+
+	unsigned long long _nremote_frees;
+	unsigned long long _nlarge;
+
+	static unsigned size_class (size_t total);
+	static size_t class_size (unsigned c);
+	static void heap_release (void *);
+
+	heap_t * heap (void);
+	slab_t * lookup (const void *p) const;
+	void register_slab (slab_t *s);
+	bool new_chunk (void);
+	slab_t * new_slab (heap_t *h, unsigned c);
+	void link (heap_t *h, slab_t *s);
+	void unlink (heap_t *h, slab_t *s);
+	void * alloc_object (size_t total);
+	void free_object (slab_t *s, void *obj);
+	void local_free (heap_t *h, slab_t *s, void *obj);
+	void drain_remote (heap_t *h);
+
+	public:
+	AllocatorSlab (allocation_functions_t &, Allocators *);
+	~AllocatorSlab();
+
+	void*  malloc (size_t);
+	void*  calloc (size_t, size_t);
+	int    posix_memalign (void **, size_t, size_t);
+	void   free (void *);
+	void*  realloc (void *, size_t);
+	size_t malloc_usable_size (void*);
+
+	void   configure (const char *);
+	const char * name (void) const;
+	const char * description (void) const;
+	void show_statistics (void) const;
+
+	void *memcpy (void *dest, const void *src, size_t n)
+	  { return _backing != nullptr ? _backing->memcpy (dest, src, n) : ::memcpy (dest, src, n); }
+
+	bool fits (size_t s) const;
+	size_t hwm (void) const
+	  { return _stats.water_mark(); }
+	void record_unfitted_malloc (size_t s)
+	  { _stats.record_unfitted_malloc (s); } ;
+	void record_unfitted_calloc (size_t s)
+	  { _stats.record_unfitted_calloc (s); } ;
+	void record_unfitted_aligned_malloc (size_t s)
+	  { _stats.record_unfitted_aligned_malloc (s); } ;
+	void record_unfitted_realloc (size_t s)
+	  { _stats.record_unfitted_realloc (s); } ;
+
+	void record_source_realloc (size_t s)
+	  { _stats.record_source_realloc (s); };
+	void record_target_realloc (size_t s)
+	  { _stats.record_target_realloc (s); };
+	void record_self_realloc (size_t s)
+	  { _stats.record_self_realloc (s); };
+
+	void record_realloc_forward_malloc (void)
+	  { _stats.record_realloc_forward_malloc (); }
+};
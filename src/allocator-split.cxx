@@ -0,0 +1,395 @@
+// License: To determine
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "common.hxx"
+#include "allocator-split.hxx"
+
+#define ALLOCATOR_NAME "split"
+
+// Macro to align an address to the nearest power of two
+#ifndef align_to
+# define align_to(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
+#endif
+
+AllocatorSplit::AllocatorSplit (allocation_functions_t &af, Allocator *fallback)
+  : Allocator (af), _fallback (fallback), _page_size (sysconf (_SC_PAGESIZE)),
+    _npolicies (0), _nsplit (0), _nunsplittable (0), _lead_bytes (0), _tail_bytes (0),
+    _nmigrated (0), _migrated_bytes (0)
+{
+	_is_ready = true;
+}
+
+AllocatorSplit::~AllocatorSplit ()
+{
+}
+
+// Memory policies are queried once per allocator, as some of them need to
+// allocate and touch memory to tell. The table has room for every allocator
+// that can be registered.
+AllocatorSplit::policy_t * AllocatorSplit::policy (Allocator *a)
+{
+	for (unsigned u = 0; u < _npolicies; ++u)
+		if (_policies[u].allocator == a)
+			return &_policies[u];
+
+	assert (_npolicies < MAX_POLICIES);
+	policy_t *p = &_policies[_npolicies++];
+	p->allocator = a;
+	p->valid = a->mempolicy (p->mode, p->nodemask);
+	p->warned = false;
+	return p;
+}
+
+bool AllocatorSplit::bind (void *p, size_t len, const policy_t *policy, unsigned flags) const
+{
+	unsigned long mask = policy->nodemask;
+	// The kernel expects the number of bits in the mask plus one
+	return syscall (SYS_mbind, p, len, policy->mode, &mask, sizeof(mask)*8 + 1, flags) == 0;
+}
+
+// mbind does not move the pages under the default policy, so they are moved
+// to the node of the calling CPU, where they would have been first touched
+void AllocatorSplit::move_to_local_node (char *p, size_t len) const
+{
+	static const unsigned BATCH = 512;
+	void *pages[BATCH];
+	int nodes[BATCH], status[BATCH];
+	unsigned cpu, node;
+
+	if (syscall (SYS_getcpu, &cpu, &node, nullptr) != 0)
+		return;
+
+	for (size_t done = 0; done < len; )
+	{
+		unsigned n;
+		for (n = 0; n < BATCH && done < len; n++, done += _page_size)
+		{
+			pages[n] = p + done;
+			nodes[n] = node;
+		}
+		// Pages that cannot be moved are left where they are
+		syscall (SYS_move_pages, 0, n, pages, nodes, status, MPOL_MF_MOVE);
+	}
+}
+
+void * AllocatorSplit::allocate (Allocator *fast, Allocator *slow, size_t size, size_t align)
+{
+	size_t length = align_to (RECORD_SZ + Allocator::getTotalSize (size + align), _page_size);
+	size_t lead = MIN(fast->available() & ~(_page_size - 1), length - _page_size);
+	if (lead < MIN_LEAD)
+	{
+		_nunsplittable++;
+		return nullptr;
+	}
+
+	policy_t *fast_policy = policy (fast), *slow_policy = policy (slow);
+	if (!fast_policy->valid || !slow_policy->valid)
+	{
+		policy_t *p = fast_policy->valid ? slow_policy : fast_policy;
+		if (!p->warned)
+			VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Objects cannot be split on allocator %s as it does not place its memory through a memory policy.\n", p->allocator->name());
+		p->warned = true;
+		_nunsplittable++;
+		return nullptr;
+	}
+
+	char *base = (char*) mmap (nullptr, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return nullptr;
+	if (!bind (base, lead, fast_policy) || !bind (base + lead, length - lead, slow_policy))
+	{
+		VERBOSE_MSG(0, ALLOCATOR_NAME": Warning! Could not apply the memory policies of %s and %s (%s).\n",
+		  fast->name(), slow->name(), strerror (errno));
+		munmap (base, length);
+		_nunsplittable++;
+		return nullptr;
+	}
+
+	split_t *s = (split_t*) base;
+	s->fast = fast;
+	s->slow = slow;
+	s->lead = lead;
+	s->length = length;
+	fast->charge (lead);
+	slow->charge (length - lead);
+
+	void *res;
+	if (align > 0)
+	{
+		res = Allocator::generateAllocatorHeaderOnAligned (base + RECORD_SZ, align, this, size);
+		_stats.record_aligned_malloc (size + align);
+	}
+	else
+	{
+		res = Allocator::generateAllocatorHeader (base + RECORD_SZ, this, size);
+		_stats.record_malloc (size);
+	}
+
+	used (true);
+	_nsplit++;
+	_lead_bytes += lead;
+	_tail_bytes += length - lead;
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Allocated %lu bytes in %p with %lu bytes on %s and %lu bytes on %s\n",
+	  size, res, lead, fast->name(), length - lead, slow->name());
+
+	return res;
+}
+
+void * AllocatorSplit::migrate (Allocator *from, Allocator *to, void *ptr, size_t size, size_t new_size, bool &moved)
+{
+	size_t copied = MIN(size, new_size);
+	uintptr_t first = align_to ((uintptr_t) ptr, _page_size);
+	uintptr_t last = ((uintptr_t) ptr + copied) & ~(_page_size - 1);
+	moved = false;
+	if (last < first + MIN_MIGRATION)
+		return nullptr;
+
+	// Pages shared with the heap of a library, as the one of the libc or of
+	// memkind, cannot be taken from it
+	if (!from->owns_pages (ptr))
+		return nullptr;
+
+	// The pages left behind are replaced by fresh ones placed like from does,
+	// which need no policy when they belong to one of our own mappings
+	const policy_t *to_policy = policy (to);
+	const policy_t *from_policy = from != this ? policy (from) : nullptr;
+	if (!to_policy->valid || (from_policy != nullptr && !from_policy->valid))
+		return nullptr;
+
+	// The object keeps its offset within the page, so that the whole pages
+	// of both objects match
+	size_t header = Allocator::getTotalSize (copied) - copied;
+	size_t extra = ((uintptr_t) ptr - RECORD_SZ - header) & (_page_size - 1);
+	size_t length = align_to (RECORD_SZ + header + extra + new_size, _page_size);
+
+	char *base = (char*) mmap (nullptr, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return nullptr;
+	if (!bind (base, length, to_policy))
+	{
+		munmap (base, length);
+		return nullptr;
+	}
+
+	split_t *s = (split_t*) base;
+	s->fast = s->slow = to;
+	s->lead = s->length = length;
+	to->charge (length);
+
+	char *res = (char*) Allocator::generateAllocatorHeader (base + RECORD_SZ, extra, this, new_size);
+	assert ((((uintptr_t) res - (uintptr_t) ptr) & (_page_size - 1)) == 0);
+	char *dest = res + (first - (uintptr_t) ptr);
+
+	// mremap fails if the pages span several mappings, in which case the
+	// caller copies the object as a whole
+	if (mremap ((void*) first, last - first, last - first, MREMAP_MAYMOVE|MREMAP_FIXED, dest) == MAP_FAILED)
+	{
+		VERBOSE_MSG(3, ALLOCATOR_NAME": Could not move the pages of %p (%s), copying it instead\n", ptr, strerror (errno));
+	}
+	else
+	{
+		if (mmap ((void*) first, last - first, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED ||
+		    (from_policy != nullptr && !bind ((void*) first, last - first, from_policy)))
+		{
+			VERBOSE_MSG(0, ALLOCATOR_NAME": Could not replace the pages moved out of %s (%s). Exiting...\n", from->name(), strerror (errno));
+			exit (1);
+		}
+
+		// The moved pages keep the policy of their former mapping until
+		// they are bound again
+		if (to_policy->mode == MPOL_DEFAULT)
+		{
+			bind (dest, last - first, to_policy);
+			move_to_local_node (dest, last - first);
+		}
+		else
+			bind (dest, last - first, to_policy, MPOL_MF_MOVE);
+
+		this->memcpy (res, ptr, first - (uintptr_t) ptr);
+		this->memcpy (dest + (last - first), (void*) last, (uintptr_t) ptr + copied - last);
+		_nmigrated++;
+		_migrated_bytes += last - first;
+		moved = true;
+	}
+
+	// The object arrives through a realloc
+	_stats.record_realloc (new_size, 0);
+	used (true);
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Migrated %lu bytes from %p on %s to %p on %s\n",
+	  copied, ptr, from->name(), res, to->name());
+
+	return res;
+}
+
+size_t AllocatorSplit::lead_size (void *ptr) const
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+	split_t *s = record (hdr);
+	size_t offset = (uintptr_t) ptr - (uintptr_t) s;
+	return s->lead > offset ? MIN(s->lead - offset, hdr->size()) : 0;
+}
+
+Allocator * AllocatorSplit::owner (void *ptr) const
+{
+	split_t *s = record (Allocator::getAllocatorHeader (ptr));
+	return s->lead == s->length ? s->fast : const_cast<AllocatorSplit*>(this);
+}
+
+// Grows the mapping of an object placed on a single tier, in place if the
+// address space after it is free and otherwise by moving its pages, and
+// places and charges the new pages like the tier does. The pages brought in
+// by a migration make a mapping of their own, which mremap cannot extend
+// together with the rest, so such objects are copied to a new mapping.
+void * AllocatorSplit::grow (void *ptr, Allocator::Header_t *hdr, size_t size)
+{
+	split_t *s = record (hdr);
+	size_t offset = (uintptr_t) ptr - (uintptr_t) s;
+	size_t length = align_to (offset + size, _page_size);
+	if (length <= s->length)
+	{
+		hdr->size (size);
+		return ptr;
+	}
+
+	Allocator *tier = s->fast;
+	const policy_t *tier_policy = policy (tier);
+	if (!tier_policy->valid || tier->available() < length - s->length)
+		return nullptr;
+	uintptr_t extra_size = Allocator::getExtraSize (hdr);
+	size_t prev_length = s->length;
+	split_t *prev = nullptr;
+	char *base = (char*) mremap (s, prev_length, length, MREMAP_MAYMOVE);
+	if (base != MAP_FAILED)
+	{
+		if (!bind (base + prev_length, length - prev_length, tier_policy))
+			VERBOSE_MSG(3, ALLOCATOR_NAME": Could not apply the memory policy of %s (%s)\n", tier->name(), strerror (errno));
+	}
+	else
+	{
+		base = (char*) mmap (nullptr, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+			return nullptr;
+		if (!bind (base, length, tier_policy))
+		{
+			munmap (base, length);
+			return nullptr;
+		}
+		this->memcpy (base, s, offset + hdr->size());
+		prev = s;
+	}
+
+	s = (split_t*) base;
+	tier->charge (length - prev_length);
+	s->lead = s->length = length;
+
+	void *res = Allocator::generateAllocatorHeader (base + RECORD_SZ, extra_size, this, size);
+	if (res != ptr)
+		Allocator::releaseAllocatorHeader (ptr);
+	if (prev != nullptr)
+		munmap (prev, prev_length);
+	return res;
+}
+
+// Objects only get here through allocate(). The regular calls, which may be
+// issued on realloc, are served by the fallback allocator.
+void * AllocatorSplit::malloc (size_t size)
+{
+	return _fallback->malloc (size);
+}
+
+void * AllocatorSplit::calloc (size_t nmemb, size_t size)
+{
+	return _fallback->calloc (nmemb, size);
+}
+
+int AllocatorSplit::posix_memalign (void **ptr, size_t align, size_t size)
+{
+	return _fallback->posix_memalign (ptr, align, size);
+}
+
+void AllocatorSplit::free (void *ptr)
+{
+	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+	split_t *s = record (hdr);
+
+	VERBOSE_MSG(3, ALLOCATOR_NAME": Freeing up pointer %p (hdr %p) w/ size - %lu (split at %lu bytes of %lu)\n", ptr, hdr, hdr->size(), s->lead, s->length);
+
+	_stats.record_free (hdr->size());
+	Allocator::releaseAllocatorHeader (ptr);
+	s->fast->discharge (s->lead);
+	s->slow->discharge (s->length - s->lead);
+	munmap (s, s->length);
+}
+
+void * AllocatorSplit::realloc (void *ptr, size_t size)
+{
+	if (ptr)
+	{
+		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
+		size_t prev_size = prev_hdr->size();
+
+		if (prev_size < size)
+		{
+			// Objects on a single tier keep growing there while it has room,
+			// and the others are moved to the fallback allocator
+			void *res = nullptr;
+			if (owner (ptr) != this)
+				res = grow (ptr, prev_hdr, size);
+			if (res == nullptr && (res = _fallback->malloc (size)) != nullptr)
+			{
+				this->memcpy (res, ptr, prev_size);
+				this->free (ptr);
+			}
+			_stats.record_realloc (size, prev_size);
+			return res;
+		}
+		else
+		{
+			DBG("Reallocated (%ld->%ld) from %p but not touching as new size is smaller w/ allocator %s (%p)\n", prev_size, size, ptr, name(), this);
+			return ptr;
+		}
+	}
+	else
+	{
+		_stats.record_realloc_forward_malloc();
+		return this->malloc (size);
+	}
+}
+
+size_t AllocatorSplit::malloc_usable_size (void *ptr)
+{
+	return Allocator::getAllocatorHeader (ptr)->size();
+}
+
+void AllocatorSplit::configure (const char *)
+{
+	VERBOSE_MSG(0, ALLOCATOR_NAME": This allocator cannot be configured.\n");
+	exit (1);
+}
+
+const char * AllocatorSplit::name (void) const
+{
+	return ALLOCATOR_NAME;
+}
+
+const char * AllocatorSplit::description (void) const
+{
+	return "Internal allocator for the objects split across two allocators";
+}
+
+void AllocatorSplit::show_statistics (void) const
+{
+	_stats.show_statistics (ALLOCATOR_NAME, true);
+	VERBOSE_MSG(1, ALLOCATOR_NAME": %llu objects split with %llu MBytes on the requested allocators and %llu MBytes on the fallback, %llu objects could not be split.\n",
+	  _nsplit, _lead_bytes >> 20, _tail_bytes >> 20, _nunsplittable);
+	VERBOSE_MSG(1, ALLOCATOR_NAME": %llu objects migrated across allocators on realloc (%llu MBytes not copied).\n",
+	  _nmigrated, _migrated_bytes >> 20);
+}
@@ -0,0 +1,121 @@
+// License: To determine
+
+#pragma once
+
+#include "allocator.hxx"
+#include <string.h>
+
+// Internal allocator for the objects that do not fit their allocator and
+// whose location asks to split them. Each object is given a mapping of its
+// own whose leading pages are placed like the requested allocator does and
+// the rest like the fallback allocator, and both are charged for their part.
+// It also takes the objects that a realloc moves across tiers by migrating
+// their pages, which are placed on a single tier and are otherwise handled
+// as objects of that tier. It is not listed in the memory definitions.
+class AllocatorSplit final : public Allocator
+{
+	private:
+	static const size_t MIN_LEAD = 2UL << 20; // smaller leads are not worth it
+	static const size_t MIN_MIGRATION = 2UL << 20; // smaller moves are copied
+	static const size_t RECORD_SZ = 32;       // room for split_t before the header
+	static const unsigned MAX_POLICIES = Allocator::MAX_ALLOCATORS; // one per allocator
+
+	typedef struct split_st
+	{
+		Allocator *fast;
+		Allocator *slow;
+		size_t lead;                 // bytes of the mapping placed like fast
+		size_t length;               // bytes of the mapping, lead if on fast alone
+	} split_t;
+
+	typedef struct policy_st
+	{
+		Allocator *allocator;
+		bool valid;
+		int mode;
+		unsigned long nodemask;
+		bool warned;
+	} policy_t;
+
+	AllocatorStatistics _stats;
+	Allocator * const _fallback;
+	size_t _page_size;
+	policy_t _policies[MAX_POLICIES]; // memory policies already queried
+	unsigned _npolicies;
+	unsigned long long _nsplit;
+	unsigned long long _nunsplittable;
+	unsigned long long _lead_bytes;
+	unsigned long long _tail_bytes;
+	unsigned long long _nmigrated;
+	unsigned long long _migrated_bytes;
+
+	static split_t * record (const Allocator::Header_t *hdr)
+	  { return (split_t*) ((uintptr_t) hdr->base_ptr() - RECORD_SZ); }
+	policy_t * policy (Allocator *);
+	bool bind (void *, size_t, const policy_t *, unsigned flags = 0) const;
+	void move_to_local_node (char *, size_t) const;
+	void * grow (void *, Allocator::Header_t *, size_t);
+
+	public:
+	AllocatorSplit (allocation_functions_t &, Allocator *fallback);
+	~AllocatorSplit();
+
+	// Places an object of size bytes (aligned to align, if not 0) partly as
+	// fast and the rest as slow does. Returns nullptr if fast has not enough
+	// room left or any of them cannot tell how it places its memory.
+	void * allocate (Allocator *fast, Allocator *slow, size_t size, size_t align);
+	// Moves the object at ptr, of size bytes and allocated by from, into a
+	// mapping of its own placed like to does, where it takes new_size bytes.
+	// Its whole pages are moved into the mapping and migrated to the nodes
+	// of to, so that only the partial pages at its ends are copied, and moved
+	// tells whether they were. Otherwise the caller copies the object. The
+	// caller still frees ptr. The mapping is charged to to. Returns nullptr
+	// if the object is too small, its pages are not owned by from alone, or
+	// any of the allocators cannot tell how it places its memory.
+	void * migrate (Allocator *from, Allocator *to, void *ptr, size_t size, size_t new_size, bool &moved);
+	// Bytes of the object placed like the fast allocator does
+	size_t lead_size (void *ptr) const;
+	// Allocator holding the whole object at ptr, or this one if the object
+	// is split across two of them
+	Allocator * owner (void *ptr) const;
+
+	void*  malloc (size_t);
+	void*  calloc (size_t, size_t);
+	int    posix_memalign (void **, size_t, size_t);
+	void   free (void *);
+	void*  realloc (void *, size_t);
+	size_t malloc_usable_size (void*);
+
+	void   configure (const char *);
+	const char * name (void) const;
+	const char * description (void) const;
+	void show_statistics (void) const;
+
+	void *memcpy (void *dest, const void *src, size_t n)
+	  { return ::memcpy (dest, src, n); }
+
+	bool fits (size_t) const
+	  { return true; }
+	bool owns_pages (void *)
+	  { return true; }
+	size_t hwm (void) const
+	  { return _stats.water_mark(); }
+	void record_unfitted_malloc (size_t s)
+	  { _stats.record_unfitted_malloc (s); } ;
+	void record_unfitted_calloc (size_t s)
+	  { _stats.record_unfitted_calloc (s); } ;
+	void record_unfitted_aligned_malloc (size_t s)
+	  { _stats.record_unfitted_aligned_malloc (s); } ;
+	void record_unfitted_realloc (size_t s)
+	  { _stats.record_unfitted_realloc (s); } ;
+
+	void record_source_realloc (size_t s)
+	  { _stats.record_source_realloc (s); };
+	void record_target_realloc (size_t s)
+	  { _stats.record_target_realloc (s); };
+	void record_self_realloc (size_t s)
+	  { _stats.record_self_realloc (s); };
+
+	void record_realloc_forward_malloc (void)
+	  { _stats.record_realloc_forward_malloc (); }
+};
@@ -34,6 +34,7 @@ AllocatorStatistics::AllocatorStatistics () :
 	n_source_realloc (0), source_realloc_size (0),
 	n_target_realloc (0), target_realloc_size (0),
 	n_self_realloc (0), self_realloc_size (0),
+	n_shrink_realloc (0), shrink_realloc_size (0),
 	n_realloc_fwd_malloc (0)
 {
 }
@@ -103,6 +104,14 @@ void AllocatorStatistics::record_realloc (size_t size, size_t prev_size)
 		high_water_mark = current_water_mark;
 }
 
+// Realloc that gave the memory past size back
+void AllocatorStatistics::record_shrink_realloc (size_t size, size_t prev_size)
+{
+	record_realloc (size, prev_size);
+	n_shrink_realloc++;
+	shrink_realloc_size += prev_size - size;
+}
+
 void AllocatorStatistics::record_free (size_t s)
 {
 	n_free_calls++;
@@ -113,6 +122,23 @@ void AllocatorStatistics::record_free (size_t s)
 		current_water_mark = 0; // This should not happen
 }
 
+// Capacity used by memory the allocator does not allocate itself (e.g. the
+// parts of the objects split across tiers), only affects the water marks
+void AllocatorStatistics::record_charge (size_t s)
+{
+	current_water_mark += s;
+	if (current_water_mark > high_water_mark)
+		high_water_mark = current_water_mark;
+}
+
+void AllocatorStatistics::record_discharge (size_t s)
+{
+	if (current_water_mark > s)
+		current_water_mark -= s;
+	else
+		current_water_mark = 0; // This should not happen
+}
+
 void AllocatorStatistics::record_source_realloc (size_t s)
 {
 	n_source_realloc++;
@@ -227,6 +253,11 @@ void AllocatorStatistics::show_statistics (const char * allocator_name,
 			VERBOSE_MSG(1, "%s| - %u realloc on same allocator for a total of %lu copied bytes.\n",
 			  full_name, n_self_realloc, self_realloc_size);
 		}
+		if (n_shrink_realloc > 0)
+		{
+			VERBOSE_MSG(1, "%s| - %u realloc shrinking the object for a total of %lu released bytes.\n",
+			  full_name, n_shrink_realloc, shrink_realloc_size);
+		}
 		if (n_source_realloc > 0)
 		{
 			VERBOSE_MSG(1, "%s| - %u realloc as source allocator for a total of %lu copied bytes.\n",
@@ -42,6 +42,8 @@ class AllocatorStatistics
 	size_t target_realloc_size;
 	unsigned n_self_realloc;
 	size_t self_realloc_size;
+	unsigned n_shrink_realloc;
+	size_t shrink_realloc_size; // bytes given back
 	unsigned n_realloc_fwd_malloc; // number of realloc(null, X) forwarded to malloc (X)
 
 	public:
@@ -52,6 +54,7 @@ class AllocatorStatistics
 	void record_calloc (size_t);
 	void record_aligned_malloc (size_t);
 	void record_realloc (size_t size, size_t prev_size);
+	void record_shrink_realloc (size_t size, size_t prev_size);
 	void record_free (size_t);
 
 	void record_source_realloc (size_t s);
@@ -65,6 +68,9 @@ class AllocatorStatistics
 
 	void record_realloc_forward_malloc (void);
 
+	void record_charge (size_t);
+	void record_discharge (size_t);
+
 	void show_statistics (const char * allocator_name,
 	  bool show_high_water_mark, const char *extra_name = nullptr) const;
 
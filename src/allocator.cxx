@@ -3,48 +3,119 @@
 // License: To determine
 
 #include "allocator.hxx"
+#include "metadata-table.hxx"
+
+static_assert (sizeof(Allocator::Header_t) == 16, "allocation headers must keep 16-byte alignment");
 
 // Macro to align an address to the nearest power of two
 #ifndef align_to
 # define align_to(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
 #endif
 
+// When the metadata is kept out of band objects take no room for the header,
+// but at least one byte so that every object has an address of its own
 size_t Allocator::getTotalSize (size_t size)
 {
+	if (MetadataTable::enabled())
+		return size > 0 ? size : 1;
 	return size + ALLOCATOR_HEADER_SZ;
 }
 
+// With in-band metadata, only the objects from aligned entry points have
+// their header out of band, and they start on a NATIVE_ALIGNMENT_MIN boundary
+bool Allocator::mayBeOutOfBand (void *ptr)
+{
+	return ((uintptr_t) ptr & (NATIVE_ALIGNMENT_MIN - 1)) == 0 && !MetadataTable::empty();
+}
+
 Allocator::Header_t * Allocator::getAllocatorHeader (void * ptr)
 {
+	if (MetadataTable::enabled())
+		return MetadataTable::lookup (ptr);
+	if (mayBeOutOfBand (ptr))
+	{
+		Header_t *hdr = MetadataTable::find (ptr);
+		if (hdr != nullptr)
+			return hdr;
+	}
 	return (Header_t*) ((uintptr_t) ptr - ALLOCATOR_HEADER_SZ);
 }
 
-void * Allocator::generateAllocatorHeader (void *ptr, Allocator *a, size_t s)
+// Room for the header of the object at res, in front of it or in the table
+static Allocator::Header_t * newAllocatorHeader (void *res, Allocator *a, bool oob)
 {
-	// Calculate new storage address
-	void *res = (void*) (((uintptr_t) ptr) + ALLOCATOR_HEADER_SZ);
+	if (oob)
+	{
+		Allocator::Header_t *hdr = MetadataTable::insert (res, a);
+		if (hdr == nullptr)
+		{
+			VERBOSE_MSG(0, "Could not allocate the out-of-band header of %p. Exiting!\n", res);
+			exit (1);
+		}
+		return hdr;
+	}
+	return (Allocator::Header_t*) ((uintptr_t) res - sizeof(Allocator::Header_t));
+}
 
-	// Record the header contents
-	Header_t *hdr = getAllocatorHeader (res);
-	hdr->allocator = a;
-	hdr->base_ptr = ptr;
-	hdr->size = s;
-	hdr->aux.u64[0] = 0; // Reset AUX field
+void Allocator::releaseAllocatorHeader (void *ptr)
+{
+	if (MetadataTable::enabled())
+	{
+		bool found = MetadataTable::release (ptr);
+		assert (found);
+		(void) found;
+	}
+	else if (mayBeOutOfBand (ptr))
+		MetadataTable::release (ptr);
+}
 
-	return res;
+void Allocator::restoreAllocatorHeader (void *ptr, const Header_t &hdr)
+{
+	*newAllocatorHeader (ptr, hdr.allocator(), hdr.out_of_band()) = hdr;
+}
+
+// Records the header of the object at res, allocated from ptr
+void Allocator::fillAllocatorHeader (void *res, void *ptr, Allocator *a, size_t s, bool oob)
+{
+	uintptr_t gap = (uintptr_t) res - (uintptr_t) ptr;
+	if (!oob)
+		gap -= ALLOCATOR_HEADER_SZ;
+	assert (gap < (1UL << 39));
+	assert (s <= MAX_SIZE);
+
+	Header_t *hdr = newAllocatorHeader (res, a, oob);
+	hdr->_size = s;
+	hdr->_allocator = a != nullptr ? a->_index : 0;
+	hdr->_pmem_node = 0;
+	hdr->_location = 0;
+	hdr->_oob = oob;
+	hdr->_gap = gap;
+}
+
+void * Allocator::Header_st::base_ptr (void) const
+{
+	uintptr_t at = _oob ? (uintptr_t) MetadataTable::object (this) : (uintptr_t) this;
+	return (void*) (at - _gap);
+}
+
+void * Allocator::generateAllocatorHeader (void *ptr, Allocator *a, size_t s)
+{
+	return generateAllocatorHeader (ptr, 0, a, s, MetadataTable::enabled());
 }
 
 void * Allocator::generateAllocatorHeader (void *ptr, size_t extrabytes, Allocator *a, size_t s)
+{
+	return generateAllocatorHeader (ptr, extrabytes, a, s, MetadataTable::enabled());
+}
+
+void * Allocator::generateAllocatorHeader (void *ptr, size_t extrabytes, Allocator *a, size_t s, bool oob)
 {
 	// Calculate new storage address
-	void *res = (void*) (((uintptr_t) ptr) + ALLOCATOR_HEADER_SZ + extrabytes);
+	void *res = oob ? (void*) (((uintptr_t) ptr) + extrabytes)
+	                : (void*) (((uintptr_t) ptr) + ALLOCATOR_HEADER_SZ + extrabytes);
 
 	// Record the header contents
-	Header_t *hdr = getAllocatorHeader (res);
-	hdr->allocator = a;
-	hdr->base_ptr = ptr;
-	hdr->size = s;
-	hdr->aux.u64[0] = 0; // Reset AUX field
+	fillAllocatorHeader (res, ptr, a, s, oob);
 
 	return res;
 }
@@ -52,31 +123,57 @@ void * Allocator::generateAllocatorHeader (void *ptr, size_t extrabytes, Allocat
 void * Allocator::generateAllocatorHeaderOnAligned (void *ptr, size_t align, Allocator *a, size_t s)
 {
 	// Calculate new storage address
-	void * res = (void*) align_to (((uintptr_t) ptr + ALLOCATOR_HEADER_SZ), align);
+	bool oob = MetadataTable::enabled();
+	void * res = (void*) align_to (((uintptr_t) ptr + (oob ? 0 : ALLOCATOR_HEADER_SZ)), align);
 
 	// Well-aligned given the requested alignment
 	assert ( ( (uintptr_t) res & (align - 1) ) == 0);
 	// Ensure enough space for a header between newptr and baseptr
-	assert ( ( (uintptr_t) res - (uintptr_t) ptr ) >= ALLOCATOR_HEADER_SZ );
+	assert ( oob || ( (uintptr_t) res - (uintptr_t) ptr ) >= ALLOCATOR_HEADER_SZ );
 
 	// Record the header contents
-	Header_t *hdr = getAllocatorHeader (res);
-	hdr->allocator = a;
-	hdr->base_ptr = ptr;
-	hdr->size = s;
-	hdr->aux.u64[0] = 0; // Reset AUX field
+	fillAllocatorHeader (res, ptr, a, s, oob);
 
 	return res;
 }
 
+bool Allocator::nativeAlignment (size_t align)
+{
+	return MetadataTable::enabled() || align >= NATIVE_ALIGNMENT_MIN;
+}
+
+void * Allocator::generateAllocatorHeaderOnNative (void *ptr, Allocator *a, size_t s)
+{
+	fillAllocatorHeader (ptr, ptr, a, s, true);
+	return ptr;
+}
+
+bool Allocator::growsInBackend (const Header_t *hdr)
+{
+	return !hdr->out_of_band() || MetadataTable::enabled();
+}
+
+Allocator * Allocator::_registry[MAX_ALLOCATORS];
+unsigned Allocator::_nregistered = 1; // index 0 stands for no allocator
+
 Allocator::Allocator (allocation_functions_t &af)
   : _af(af), _has_size (false), _size(0), _used(false)
 {
 	_fallback = nullptr;
+
+	// Headers refer to allocators through their index
+	if (_nregistered >= MAX_ALLOCATORS)
+	{
+		VERBOSE_MSG(0, "Too many allocators, at most %u can be defined. Exiting!\n", MAX_ALLOCATORS - 1);
+		exit (1);
+	}
+	_index = _nregistered++;
+	_registry[_index] = this;
 }
 
 Allocator::~Allocator ()
 {
+	_registry[_index] = nullptr;
 }
 
 void Allocator::codeLocation (void *ptr, uint32_t CL)
@@ -84,7 +181,8 @@ void Allocator::codeLocation (void *ptr, uint32_t CL)
 	if (nullptr != ptr)
 	{
 		Header_t *hdr = getAllocatorHeader (ptr);
-		hdr->aux.u32[ALLOCATOR_HEADER_AUX_CALLSTACKID] = CL + 1;
+		assert (CL <= MAX_LOCATION);
+		hdr->_location = CL + 1;
 	}
 }
 
@@ -94,9 +192,9 @@ uint32_t Allocator::codeLocation (void *ptr, bool& valid)
 	if (nullptr != ptr)
 	{
 		Header_t *hdr = getAllocatorHeader (ptr);
-		valid = hdr->aux.u32[ALLOCATOR_HEADER_AUX_CALLSTACKID] > 0;
+		valid = hdr->_location > 0;
 		if (valid)
-			res = hdr->aux.u32[ALLOCATOR_HEADER_AUX_CALLSTACKID] - 1;
+			res = hdr->_location - 1;
 	}
 	else
 		valid = false;
@@ -108,7 +206,8 @@ void Allocator::pmemNode (void *ptr, uint32_t node)
 	if (nullptr != ptr)
 	{
 		Header_t *hdr = getAllocatorHeader (ptr);
-		hdr->aux.u32[ALLOCATOR_HEADER_AUX_PMEM_NODE] = 1+node;
+		assert (node <= MAX_PMEM_NODE);
+		hdr->_pmem_node = 1+node;
 	}
 }
 
@@ -118,9 +217,9 @@ uint32_t Allocator::pmemNode (void *ptr, bool& valid)
 	if (nullptr != ptr)
 	{
 		Header_t *hdr = getAllocatorHeader (ptr);
-		valid = hdr->aux.u32[ALLOCATOR_HEADER_AUX_PMEM_NODE] > 0;
+		valid = hdr->_pmem_node > 0;
 		if (valid)
-			res = hdr->aux.u32[ALLOCATOR_HEADER_AUX_PMEM_NODE] - 1;
+			res = hdr->_pmem_node - 1;
 	}
 	else
 		valid = false;
@@ -134,6 +233,5 @@ uint32_t Allocator::pmemNode (void *ptr, bool& valid)
 uintptr_t Allocator::getExtraSize (Header_t *hdr)
 {
 	assert (hdr != nullptr);
-	return (uintptr_t) hdr - ((uintptr_t) hdr->base_ptr);
+	return hdr->_gap;
 }
-
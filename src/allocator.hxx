@@ -12,27 +12,44 @@ class Allocator
 {
 	public:
 	// Internal header structure to hold information around the allocator used and other data.
+	// It is packed in 16 bytes so that the objects that follow it keep the 16-byte alignment.
 	// Contains:
-	// 	- (pos-1) Allocator pointer that should handle
-	// 	- (pos-2) Original allocated pointer -- for free, realloc. Needed as there may be a gap
-	// 	          when issuing aligned allocations
-	// 	- (pos-3) Requested size
-	// 	- (pos-4) Auxiliary field
+	// 	- Requested size (48 bits)
+	// 	- Index of the allocator that should handle it, 0 if none (8 bits)
+	// 	- PMEM node plus one, 0 if unset (8 bits)
+	// 	- Code location plus one, 0 if unset (24 bits)
+	// 	- Whether the header is kept out of band (1 bit)
+	// 	- Gap from the original allocated pointer to the header, or to the object if the
+	// 	  header is kept out of band (39 bits). The original pointer is needed for free,
+	// 	  realloc and derived from the gap, as there may be one when issuing aligned
+	// 	  allocations
 	typedef struct Header_st {
-		Allocator *allocator;
-		void      *base_ptr;
-		size_t    size;
-		union
-		{
-			uint64_t u64[1];
-			uint32_t u32[2];
-		} aux;
+		uint64_t _size      : 48;
+		uint64_t _allocator : 8;
+		uint64_t _pmem_node : 8;
+		uint64_t _location  : 24;
+		uint64_t _oob       : 1;
+		uint64_t _gap       : 39;
+
+		Allocator * allocator (void) const { return _registry[_allocator]; };
+		void * base_ptr (void) const;
+		size_t size (void) const { return _size; };
+		void size (size_t s) { assert (s <= MAX_SIZE); _size = s; };
+		bool out_of_band (void) const { return _oob; };
 	} Header_t;
 
-	enum ALLOCATOR_HEADER_AUX_IDX { ALLOCATOR_HEADER_AUX_PMEM_NODE = 0, ALLOCATOR_HEADER_AUX_CALLSTACKID };
+	static const size_t MAX_SIZE = (1UL << 48) - 1;
+	static const uint32_t MAX_LOCATION = (1U << 24) - 2;
+	static const uint32_t MAX_PMEM_NODE = (1U << 8) - 2;
+	static const unsigned MAX_ALLOCATORS = 1U << 8; // including none at index 0
 
 	private:
 	static const size_t ALLOCATOR_HEADER_SZ = sizeof(Header_t);
+	static const size_t NATIVE_ALIGNMENT_MIN = 4096;
+	static Allocator *_registry[MAX_ALLOCATORS];
+	static unsigned _nregistered;
+
+	unsigned _index; // within _registry
 
 	protected:
 	const allocation_functions_t _af;
@@ -52,6 +69,33 @@ class Allocator
 	static void * generateAllocatorHeaderOnAligned (void *ptr, size_t align, Allocator *a, size_t s);
 	static size_t getTotalSize (size_t size);
 	static uintptr_t getExtraSize (Header_t *hdr);
+	// Objects aligned to align are to be obtained from the aligned entry
+	// point of the backend, rather than by allocating align bytes more, when
+	// the header would otherwise take a whole alignment unit in front of
+	// them. Their header is then kept out of band.
+	static bool nativeAlignment (size_t align);
+	static void * generateAllocatorHeaderOnNative (void *ptr, Allocator *a, size_t s);
+	// Whether the object can be grown through the realloc of its backend.
+	// With in-band metadata, objects from aligned entry points cannot, as
+	// their header is found through the alignment a realloc may lose.
+	static bool growsInBackend (const Header_t *hdr);
+	// Whether a realloc from prev_size down to size is to give the memory
+	// past size back to the tier, rather than leave the object untouched
+	static bool shrinks (size_t prev_size, size_t size)
+	  { return options.shrinkThreshold() > 0 && size + options.shrinkThreshold() <= prev_size; }
+	// Headers kept out of band live until released, which allocators do
+	// when an object is freed or moved, before the memory is given back.
+	// Allocators that build on another one release their header before
+	// calling it, and restore a copy if the call fails.
+	static void releaseAllocatorHeader (void *ptr);
+	static void restoreAllocatorHeader (void *ptr, const Header_t &hdr);
+
+	private:
+	static void fillAllocatorHeader (void *res, void *ptr, Allocator *a, size_t s, bool oob);
+	static void * generateAllocatorHeader (void *ptr, size_t extrabytes, Allocator *a, size_t s, bool oob);
+	static bool mayBeOutOfBand (void *ptr);
+
+	public:
 
 	static void codeLocation (void *ptr, uint32_t codelocation);
 	static uint32_t codeLocation (void *ptr, bool& valid);
@@ -62,9 +106,14 @@ class Allocator
 	virtual const char * description (void) const = 0;
 
 	virtual void*  malloc (size_t) = 0;
+	// Returns zeroed memory. Allocators clear only the memory that is not
+	// already known to be zero, as fresh pages from the kernel.
 	virtual void*  calloc (size_t, size_t) = 0;
 	virtual int    posix_memalign (void **, size_t, size_t) = 0;
 	virtual void   free (void *) = 0;
+	// Reallocs for which shrinks() holds reduce the object to the new size,
+	// recorded in its header and statistics, while other reductions may
+	// leave it untouched
 	virtual void*  realloc (void *, size_t) = 0;
 	virtual size_t malloc_usable_size (void*) = 0;
 
@@ -73,6 +122,23 @@ class Allocator
 	virtual void configure (const char *) = 0;
 	virtual bool is_ready (void) const { return _is_ready; };
 
+	// Memory policy (mode and node mask, as given to mbind) that places pages
+	// where this allocator would place them. Allocators that cannot tell, or
+	// whose memory cannot be placed through a policy, return false.
+	virtual bool mempolicy (int &, unsigned long &) { return false; };
+
+	// Capacity still available and charging of the capacity taken by memory
+	// that is placed like this allocator does but not allocated through it,
+	// as the parts of the objects split or interleaved across tiers
+	virtual size_t available (void) const { return 0; };
+	virtual void charge (size_t) { };
+	virtual void discharge (size_t) { };
+
+	// Whether the whole pages of the object at ptr belong to a mapping that
+	// only this allocator manages, rather than to a heap shared with other
+	// objects or libraries, so that they may be moved out of it and replaced
+	virtual bool owns_pages (void *) { return false; };
+
 	void size (size_t s) { _size = s; _has_size = s > 0; };
 	size_t size (void) const { return _size; };
 	bool has_size (void) const { return _has_size; };
@@ -11,30 +11,43 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <dlfcn.h>
 #include <new>
 #include <algorithm>
 
 #include "common.hxx"
 
 #include "allocators.hxx"
+#include "allocator-plugin.hxx"
 #include "allocator-posix.hxx"
+#include "allocator-slab.hxx"
+#include "allocator-hugetlb.hxx"
+#include "allocator-numa.hxx"
+#include "allocator-interleave.hxx"
 #if defined(MEMKIND_SUPPORTED)
 # include "allocator-memkind-hbwmalloc.hxx"
 # include "allocator-memkind-pmem.hxx"
 #endif
 
 Allocators::Allocators (allocation_functions_t &af, const char *definitions)
+	: _af(af), allocators(nullptr), nallocators(0)
 {
-	unsigned indx = 0;
 #if defined(MEMKIND_SUPPORTED)
 	void *a_memkind_hbwmalloc = (AllocatorMemkindHBWMalloc*) malloc (sizeof(AllocatorMemkindHBWMalloc));
 	void *a_memkind_pmem = (AllocatorMemkindPMEM*) malloc (sizeof(AllocatorMemkindPMEM));
-	allocators[indx++] = new (a_memkind_hbwmalloc) AllocatorMemkindHBWMalloc(af);
-	allocators[indx++] = new (a_memkind_pmem) AllocatorMemkindPMEM(af);
+	add (new (a_memkind_hbwmalloc) AllocatorMemkindHBWMalloc(af));
+	add (new (a_memkind_pmem) AllocatorMemkindPMEM(af));
 #endif
 	void *a_posix = (AllocatorPOSIX*) malloc (sizeof(AllocatorPOSIX));
-	allocators[indx++] = new (a_posix) AllocatorPOSIX(af);
-	allocators[indx]   = nullptr;
+	add (new (a_posix) AllocatorPOSIX(af));
+	void *a_slab = (AllocatorSlab*) malloc (sizeof(AllocatorSlab));
+	add (new (a_slab) AllocatorSlab(af, this));
+	void *a_hugetlb = (AllocatorHugeTLB*) malloc (sizeof(AllocatorHugeTLB));
+	add (new (a_hugetlb) AllocatorHugeTLB(af));
+	void *a_numa = (AllocatorNUMA*) malloc (sizeof(AllocatorNUMA));
+	add (new (a_numa) AllocatorNUMA(af));
+	void *a_interleave = (AllocatorInterleave*) malloc (sizeof(AllocatorInterleave));
+	add (new (a_interleave) AllocatorInterleave(af, this));
 
 	// Objects have been already initialized when constructing (allocating them) -- just use
 	// this function to list them
@@ -95,11 +108,23 @@ Allocators::Allocators (allocation_functions_t &af, const char *definitions)
 		char allocatorname[256] = {0};
 		const char blankchars[] = "\n\r\t\f\v";	// only allow single space as blank in the allocator's name
 		const char * MEMORYCONFIG_ALLOCATOR = "# Memory configuration for allocator ";
+		const char * PLUGIN_ALLOCATOR = "# Allocator plugin ";
 		bool has_memoryconfig_allocator = false;
 		size_t count = 0;
 
+		// Have we found a plugin to load? It adds an allocator to be
+		// configured and used as the built-in ones
+		if (strncmp (defs, PLUGIN_ALLOCATOR, strlen (PLUGIN_ALLOCATOR)) == 0)
+		{
+			char path[PATH_MAX] = {0};
+			const char *in = &defs[strlen(PLUGIN_ALLOCATOR)];
+			count = std::min (strcspn (in, blankchars), sizeof (path)-1);
+			memcpy (path, in, count);
+			path[count] = '\0';
+			load_plugin (path);
+		}
 		// Have we found an entry for a memory allocator configuration?
-		if (strncmp (defs, MEMORYCONFIG_ALLOCATOR, strlen (MEMORYCONFIG_ALLOCATOR)) == 0)
+		else if (strncmp (defs, MEMORYCONFIG_ALLOCATOR, strlen (MEMORYCONFIG_ALLOCATOR)) == 0)
 		{
 			const char *in = &defs[strlen(MEMORYCONFIG_ALLOCATOR)];
 			count = std::min (strcspn (in, blankchars), sizeof (allocatorname)-1);
@@ -139,6 +164,60 @@ Allocators::~Allocators (void)
 {
 }
 
+void Allocators::add (Allocator *a)
+{
+	allocators = (Allocator**) _af.realloc (allocators, sizeof(Allocator*)*(nallocators+2));
+	assert (allocators != nullptr);
+	allocators[nallocators++] = a;
+	allocators[nallocators] = nullptr;
+}
+
+void Allocators::load_plugin (const char *path)
+{
+	VERBOSE_MSG(1, "Loading allocator plugin %s\n", path);
+
+	void *handle = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+	if (handle == nullptr)
+	{
+		VERBOSE_MSG(0, "Error! Could not load allocator plugin %s (%s).\n", path, dlerror());
+		exit (1);
+	}
+
+	const flexmalloc_plugin_t *plugin = (const flexmalloc_plugin_t*) dlsym (handle, FLEXMALLOC_PLUGIN_SYMBOL);
+	if (plugin == nullptr)
+	{
+		VERBOSE_MSG(0, "Error! %s is not an allocator plugin, it does not define " FLEXMALLOC_PLUGIN_SYMBOL ".\n", path);
+		exit (1);
+	}
+	if (plugin->abi_version != FLEXMALLOC_PLUGIN_ABI_VERSION)
+	{
+		VERBOSE_MSG(0, "Error! Allocator plugin %s was built for ABI version %u but version %u is required.\n",
+		  path, plugin->abi_version, FLEXMALLOC_PLUGIN_ABI_VERSION);
+		exit (1);
+	}
+	if (plugin->allocator_size != sizeof(Allocator))
+	{
+		VERBOSE_MSG(0, "Error! Allocator plugin %s was built with an Allocator of %lu bytes but it takes %lu bytes in FlexMalloc.\n",
+		  path, plugin->allocator_size, sizeof(Allocator));
+		exit (1);
+	}
+
+	Allocator *a = plugin->create (_af, this);
+	if (a == nullptr)
+	{
+		VERBOSE_MSG(0, "Error! Could not create the allocator of plugin %s.\n", path);
+		exit (1);
+	}
+	if (get (a->name()) != nullptr)
+	{
+		VERBOSE_MSG(0, "Error! Allocator plugin %s provides allocator '%s', which already exists.\n", path, a->name());
+		exit (1);
+	}
+
+	add (a);
+	VERBOSE_MSG(1, "* %s (%s)\n", a->name(), a->description());
+}
+
 Allocator * Allocators::get (const char *name)
 {
 	unsigned u = 0;
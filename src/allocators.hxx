@@ -9,16 +9,15 @@
 #include "allocator-statistics.hxx"
 #include "allocator.hxx"
 
-#if defined(MEMKIND_SUPPORTED)
-# define NUM_ALLOCATORS 3
-#else
-# define NUM_ALLOCATORS 1
-#endif
-
 class Allocators
 {
 	private:
-	Allocator * allocators[NUM_ALLOCATORS+1]; // +1 for null-terminated
+	allocation_functions_t _af;
+	Allocator ** allocators;  // null-terminated
+	unsigned nallocators;
+
+	void add (Allocator *);
+	void load_plugin (const char *path);
 
 	public:
 	Allocators (allocation_functions_t &, const char * definitions);
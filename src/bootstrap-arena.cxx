@@ -0,0 +1,91 @@
+// License: To determine
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "common.hxx"
+#include "bootstrap-arena.hxx"
+
+char * volatile BootstrapArena::_region = nullptr;
+volatile size_t BootstrapArena::_top = 0;
+unsigned long long BootstrapArena::_nobjects = 0;
+unsigned long long BootstrapArena::_nreleased = 0;
+unsigned long long BootstrapArena::_ngrown = 0;
+
+// The region is reserved at the first allocation. Threads racing for it
+// keep the first mapping.
+bool BootstrapArena::map (void)
+{
+	char *p = (char*) mmap (nullptr, REGION_SZ, PROT_READ|PROT_WRITE,
+	  MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		return false;
+	if (!__sync_bool_compare_and_swap (&_region, nullptr, p))
+		munmap (p, REGION_SZ);
+	return true;
+}
+
+void * BootstrapArena::allocate (size_t size, size_t align)
+{
+	if (_region == nullptr && !map())
+		return nullptr;
+	if (size > REGION_SZ || align > REGION_SZ)
+		return nullptr;
+	align = MAX(align, ALIGNMENT);
+
+	size_t old, obj, top;
+	do
+	{
+		old = _top;
+		obj = (old + sizeof(record_t) + align - 1) & ~(align - 1);
+		top = (obj + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		if (top > REGION_SZ)
+			return nullptr;
+	} while (!__sync_bool_compare_and_swap (&_top, old, top));
+
+	void *res = _region + obj;
+	record(res)->size = size;
+	record(res)->begin = old;
+	__sync_fetch_and_add (&_nobjects, 1);
+	return res;
+}
+
+// Only the last object gives its memory back, the others are left behind
+void BootstrapArena::release (void *ptr)
+{
+	size_t begin = record(ptr)->begin, e = end (ptr);
+	if (_top != e)
+		return;
+
+	// Cleared before being given back, as another thread may take it as
+	// soon as the bump pointer moves
+	memset (_region + begin, 0, e - begin);
+	if (__sync_bool_compare_and_swap (&_top, e, begin))
+		__sync_fetch_and_add (&_nreleased, 1);
+}
+
+void * BootstrapArena::grow (void *ptr, size_t size)
+{
+	if (size <= record(ptr)->size)
+		return ptr;
+	if (size > REGION_SZ)
+		return nullptr;
+
+	size_t e = end (ptr);
+	size_t top = ((uintptr_t) ptr - (uintptr_t) _region + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	if (top > REGION_SZ || !__sync_bool_compare_and_swap (&_top, e, top))
+		return nullptr;
+
+	record(ptr)->size = size;
+	__sync_fetch_and_add (&_ngrown, 1);
+	return ptr;
+}
+
+void BootstrapArena::show_statistics (void)
+{
+	if (_nobjects == 0)
+		return;
+
+	VERBOSE_MSG(1, "Bootstrap arena: %llu objects (%llu freed and %llu grown in place), %lu KBytes in use of %lu MBytes.\n",
+	  _nobjects, _nreleased, _ngrown, _top >> 10, REGION_SZ >> 20);
+}
@@ -0,0 +1,55 @@
+// License: To determine
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Serves the allocations issued before FlexMalloc is initialized, including
+// those from the dynamic loader while the real allocation functions are
+// being resolved. Objects are bumped from a single mmap'ed region without
+// locks, each preceded by a small record with its size. The region above
+// the bump pointer is always zero, so freeing the last object gives its
+// memory back (clearing it) and the last object grows in place.
+//
+// Objects are told apart by their address, and remain valid once FlexMalloc
+// is initialized until they are freed. When the region is exhausted, the
+// callers resort to the real allocation functions.
+class BootstrapArena
+{
+	private:
+	static const size_t REGION_SZ = 64UL << 20;
+	static const size_t ALIGNMENT = 16;
+
+	typedef struct
+	{
+		uint64_t size;   // requested
+		uint64_t begin;  // offset of the bump pointer before the object
+	} record_t;
+
+	static char * volatile _region;
+	static volatile size_t _top;      // offset of the bump pointer
+	static unsigned long long _nobjects;
+	static unsigned long long _nreleased;
+	static unsigned long long _ngrown;
+
+	static bool map (void);
+	static record_t * record (void *ptr)
+	  { return (record_t*) ptr - 1; }
+	static size_t end (void *ptr)
+	  { return ((uintptr_t) ptr - (uintptr_t) _region + record(ptr)->size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+	public:
+	static bool contains (const void *ptr)
+	  { return _region != nullptr && (uintptr_t) ptr - (uintptr_t) _region < REGION_SZ; }
+
+	// Returns nullptr when the region is exhausted. Memory is always zeroed.
+	static void * allocate (size_t size, size_t align = ALIGNMENT);
+	static void release (void *ptr);
+	// Grows the object in place, if it is the last one, or returns nullptr
+	static void * grow (void *ptr, size_t size);
+	static size_t size (void *ptr)
+	  { return record(ptr)->size; }
+
+	static void show_statistics (void);
+};
@@ -70,6 +70,13 @@ void CacheCallstacks::add_match (unsigned nframes, void *frames[], Allocator *a,
 	}
 }
 
+// Forget all the cached callstacks (e.g. the code they point to got unloaded)
+void CacheCallstacks::clear (void)
+{
+	_num_entries = 0;
+	_first_entry = 0;
+}
+
 void CacheCallstacks::show_statistics (void) const
 {
 	VERBOSE_MSG(1, "- Cache size = %u with %u call-stack segments per entry\n", NUM_ENTRIES, CALLSTACKS_PER_ENTRY);
@@ -37,5 +37,6 @@ class CacheCallstacks
 
 	bool match (unsigned nframes, void *frames[], Allocator *&a, unsigned &id) const;
 	void add_match (unsigned nframes, void *frames[], Allocator *a, unsigned);
+	void clear (void);
 	void show_statistics (void) const;
 };
@@ -19,13 +19,11 @@
 #include <algorithm>
 
 #include "common.hxx"
-#include "utils.hxx"
 #include "code-locations.hxx"
 
-CodeLocations::CodeLocations (allocation_functions_t &af, Allocators *a)
-	: _fast_indexes_frames(nullptr), _af(af), _allocators(a), _locations(nullptr),
-	  _nlocations(0), _min_nframes(UINT_MAX), _max_nframes(0), _maps_info{0, 0, nullptr},
-	  _pending_modules(nullptr)
+CodeLocations::CodeLocations (allocation_functions_t &af, Allocators *a, ModuleRegistry *m)
+	: _fast_indexes_frames(nullptr), _af(af), _allocators(a), _modules(m), _locations(nullptr),
+	  _nlocations(0), _min_nframes(UINT_MAX), _max_nframes(0), _tracked_modules(nullptr)
 {
 }
 
@@ -55,11 +53,84 @@ char * CodeLocations::find_and_set_allocator (char *location_txt, location_t * l
 
 	// Identify allocator first
 	char allocator[PATH_MAX] = {0};
-	size_t allocator_len = std::min(strcspn(allocator_marker+2, "\n"), (size_t) PATH_MAX-1);
+	size_t allocator_len = std::min(strcspn(allocator_marker+2, " \n"), (size_t) PATH_MAX-1);
 	memcpy (allocator, allocator_marker+2, allocator_len);
 	// +2 because we skip @ && the following space
 	allocator[allocator_len] = '\0';
 
+	// The allocator may be followed by the chain of allocators to try when
+	// the objects do not fit (> allocator2 > allocator3), by a transparent
+	// huge pages policy (thp=huge|nohuge|none), by split, which places
+	// the objects that do not fit partly in the allocator and the rest in
+	// the fallback one, and by the size from which objects are pre-faulted
+	// (prefault=<bytes>)
+	location->ntiers = 0;
+	location->thp = THP_POLICY_UNSET;
+	location->split = false;
+	location->prefault = 0;
+	const char *TIER_MARKER = " > ";
+	const char *THP_MARKER = " thp=";
+	const char *SPLIT_MARKER = " split";
+	const char *PREFAULT_MARKER = " prefault=";
+	const char *attributes = allocator_marker+2+allocator_len;
+	while (*attributes == ' ')
+	{
+		if (strncmp (attributes, TIER_MARKER, strlen(TIER_MARKER)) == 0)
+		{
+			char tier[PATH_MAX] = {0};
+			attributes += strlen(TIER_MARKER);
+			size_t tier_len = std::min(strcspn(attributes, " \n"), (size_t) PATH_MAX-1);
+			memcpy (tier, attributes, tier_len);
+			attributes += tier_len;
+			if (location->ntiers == MAX_TIERS)
+			{
+				VERBOSE_MSG (0, "Error! Too many allocators in the chain, at most %u are supported.\n", MAX_TIERS);
+				return nullptr;
+			}
+			Allocator *a = _allocators->get (tier);
+			if (a == nullptr)
+			{
+				VERBOSE_MSG (0, "Error! Given allocator '%s' does not exist in given memory definitions file.\n", tier);
+				return nullptr;
+			}
+			location->tiers[location->ntiers++] = a;
+		}
+		else if (strncmp (attributes, THP_MARKER, strlen(THP_MARKER)) == 0)
+		{
+			char policy[16] = {0};
+			attributes += strlen(THP_MARKER);
+			size_t policy_len = std::min(strcspn(attributes, " \n"), sizeof(policy)-1);
+			memcpy (policy, attributes, policy_len);
+			if (!Options::parseThpPolicy (policy, location->thp))
+			{
+				VERBOSE_MSG (0, "Error! Invalid transparent huge pages policy '%s'. Available values are huge, nohuge and none.\n", policy);
+				return nullptr;
+			}
+			attributes += strcspn(attributes, " \n");
+		}
+		else if (strncmp (attributes, SPLIT_MARKER, strlen(SPLIT_MARKER)) == 0 &&
+		         strchr (" \n", attributes[strlen(SPLIT_MARKER)]) != nullptr)
+		{
+			location->split = true;
+			attributes += strlen(SPLIT_MARKER);
+		}
+		else if (strncmp (attributes, PREFAULT_MARKER, strlen(PREFAULT_MARKER)) == 0)
+		{
+			char *pEnd = nullptr;
+			attributes += strlen(PREFAULT_MARKER);
+			long long threshold = strtoll (attributes, &pEnd, 10);
+			if (pEnd == attributes || threshold <= 0 || strchr (" \n", *pEnd) == nullptr)
+			{
+				VERBOSE_MSG (0, "Error! Invalid pre-faulting threshold, a positive number of bytes is expected.\n");
+				return nullptr;
+			}
+			location->prefault = threshold;
+			attributes = pEnd;
+		}
+		else
+			break;
+	}
+
 	location->allocator = _allocators->get (allocator);
 	if (location->allocator == nullptr)
 	{
@@ -67,8 +138,20 @@ char * CodeLocations::find_and_set_allocator (char *location_txt, location_t * l
 		return nullptr;
 	}
 
-	// Mark the allocator as used
+	// Split objects are placed through the memory policy of the allocator,
+	// up to the capacity it reports as available
+	int mode;
+	unsigned long nodemask;
+	if (location->split && !location->allocator->mempolicy (mode, nodemask))
+	{
+		VERBOSE_MSG (0, "Error! Given allocator '%s' cannot split objects, as it does not place its memory through a memory policy.\n", allocator);
+		return nullptr;
+	}
+
+	// Mark the allocators as used
 	location->allocator->used (true);
+	for (unsigned t = 0; t < location->ntiers; ++t)
+		location->tiers[t]->used (true);
 
 	if (strcmp(allocator, fallback_allocator_name) == 0 && options.ignoreIfFallbackAllocator())
 	{
@@ -183,103 +266,6 @@ bool CodeLocations::process_source_location (char *location_txt, location_t * lo
 	return true;
 }
 
-bool CodeLocations::load_memory_mappings_info (memory_maps_t& maps)
-{
-	maps.num_entries = 0;
-
-	FILE * mapsfile = fopen ("/proc/self/maps", "r");
-
-	if (mapsfile == nullptr)
-	{
-		VERBOSE_MSG (1, "Warning! Could not open /proc/self/maps\n");
-		return 0;
-	}
-
-	DBG("Opened /proc/self/maps to learn about application symbols\n%s", "");
-
-	char line[LINE_SIZE+1];
-
-	while (!feof (mapsfile))
-		if (fgets (line, LINE_SIZE, mapsfile) != nullptr)
-		{
-			memory_maps_entry_t mme;
-			char permissions[5];
-
-			bool entry_parsed = parse_proc_self_maps_entry (line, &mme.start, &mme.end,
-			  sizeof(permissions), permissions, &mme.offset, LINE_SIZE, mme.module);
-
-			if (entry_parsed)
-			{
-				if (strlen(mme.module) > 0 && mme.module[0] != '[') // ignore [vdso], etc.
-				{
-					mme.perm_read = (permissions[0] == 'r');
-					mme.perm_write = (permissions[1] == 'w');
-					mme.perm_exec = (permissions[2] == 'x');
-
-					if (maps.capacity == maps.num_entries) {
-						maps.entries = (memory_maps_entry_t*) _af.realloc (maps.entries, (maps.capacity + 10) * sizeof(memory_maps_entry_t));
-						assert(maps.entries != nullptr);
-						maps.capacity += 10;
-					}
-
-					maps.entries[maps.num_entries] = mme;
-					maps.num_entries++;
-				}
-			}
-		}
-
-	fclose (mapsfile);
-	return true;
-}
-
-long CodeLocations::file_offset_to_address (const char *lib, unsigned long offset, bool& found)
-{
-	long baseAddress = 0;
-	unsigned long baseOffset = 0;
-	found = false;
-
-	for (unsigned i = 0; i < _maps_info.num_entries; i++)
-	{
-		const memory_maps_entry_t& mme = _maps_info.entries[i];
-
-		// Check for execution bits, ignore the rest
-		if (mme.perm_exec)
-		{
-			const char* module = mme.module;
-
-			char module_buf[PATH_MAX] = {0};
-			const char * p_module = module_buf;
-			if (realpath(module, module_buf) == nullptr)
-			{
-				VERBOSE_MSG (1, "Warning! Could not get realpath of %s (from /proc/self/maps)\n", module);
-				p_module = module;
-			}
-			char lib_buf[PATH_MAX] = {0};
-			const char * p_lib = lib_buf;
-			if (realpath(lib, lib_buf) == nullptr)
-			{
-				VERBOSE_MSG (1, "Warning! Could not get realpath of %s (from location)\n", lib);
-				p_lib = lib;
-			}
-
-			// Check if library matches
-			if (strcmp (p_module, p_lib) == 0)
-			{
-				if (mme.offset <= offset && offset < (mme.offset + (mme.end - mme.start)))
-				{
-					baseAddress = mme.start;
-					baseOffset = mme.offset;
-					found = true;
-					break; // Stop iterating
-				}
-			}
-		}
-	}
-
-	DBG("Base address for library (%s) -> %lx\n", lib, baseAddress);
-	return baseAddress + (offset - baseOffset);
-}
-
 bool CodeLocations::process_raw_location (char *location_txt, location_t * location, const char *fallback_allocator_name)
 {
 	/* Example of parsing line:
@@ -310,42 +296,56 @@ bool CodeLocations::process_raw_location (char *location_txt, location_t * locat
 		memcpy (module, prev_frame, module_len);
 		module[module_len] = '\0';
 
+		// The frame is either an offset within the module file or an
+		// offset relative to a symbol exported by the module
 		char *endptr;
-		long offset = strtoul (frame+1, &endptr, 16);
-		assert (endptr <= frame+1+16);
+		char *symbol = nullptr;
+		size_t token_len = strcspn (frame+1, " >@\n");
+		char *plus = (char*) memchr (frame+1, '+', token_len);
+		char *offset_txt = plus != nullptr ? plus+1 : frame+1;
+		long offset = strtoul (offset_txt, &endptr, 16);
+		if (endptr == offset_txt || endptr != frame+1+token_len || plus == frame+1)
+		{
+			VERBOSE_MSG(0, "Error! Invalid frame '%s!%.*s', a hexadecimal offset (optionally after a symbol and +) is expected.\n",
+			  module, (int) token_len, frame+1);
+			// Give back the frames already processed
+			for (size_t g = 0; g < f; ++g)
+			{
+				location->frames.raw[g].module->nframes--;
+				if (location->frames.raw[g].symbol != nullptr)
+					_af.free (location->frames.raw[g].symbol);
+			}
+			_af.free (location->frames.raw);
+			location->frames.raw = nullptr;
+			return false;
+		}
+		if (plus != nullptr)
+		{
+			size_t symbol_len = plus - (frame+1);
+			symbol = (char*) _af.malloc (symbol_len+1);
+			assert (symbol != nullptr);
+			memcpy (symbol, frame+1, symbol_len);
+			symbol[symbol_len] = '\0';
+		}
 
-		bool found = false;
-		long address = file_offset_to_address (module, offset, found);
+		tracked_module_t *tm = add_or_get_tracked_module (module);
+		tm->nframes++;
+		location->frames.raw[f].module = tm;
+		location->frames.raw[f].symbol = symbol;
+		location->frames.raw[f].offset = offset;
 
-		if (found)
+		uintptr_t address = 0;
+		if (resolve_frame (&location->frames.raw[f], address))
 		{
-			DBG("Offset %lx in file %s gets relocated to address %lx.\n",
-			  offset, module, address);
+			DBG("Frame %s!%s+%lx gets relocated to address %lx.\n",
+			  module, symbol != nullptr ? symbol : "", offset, address);
 			location->frames.raw[f].frame = address;
 		}
 		else
 		{
-			DBG("Could not translate frame: '%s'!%08lx\n", module, offset);
+			DBG("Could not translate frame: '%s'!%s+%08lx\n",
+			  module, symbol != nullptr ? symbol : "", offset);
 			location->frames.raw[f].frame = 0;
-
-			pending_module_t* mm = add_or_get_pending_module (module);
-			mm->nframes++;
-
-			pending_raw_frame_t* mf = (pending_raw_frame_t*) _af.malloc(sizeof(pending_raw_frame_t));
-			mf->index = f;
-			mf->module = mm;
-			mf->offset = offset;
-			mf->next = nullptr;
-
-			if (location->pending_frames == nullptr)
-				location->pending_frames = mf;
-			else
-			{
-				pending_raw_frame_t* last = location->pending_frames;
-				while (last->next != nullptr)
-					last = last->next;
-				last->next = mf;
-			}
 		}
 
 		prev_frame = strchr (endptr, '>') + 2;
@@ -355,22 +355,10 @@ bool CodeLocations::process_raw_location (char *location_txt, location_t * locat
 	return true;
 }
 
-CodeLocations::pending_module_t* CodeLocations::get_pending_module(const char* path)
+CodeLocations::tracked_module_t* CodeLocations::add_or_get_tracked_module(const char* path)
 {
-	pending_module_t* mm = _pending_modules;
-	while (mm != nullptr)
-	{
-		if (strcmp(path, mm->path) == 0)
-			return mm;
-		mm = mm->next;
-	}
-	return nullptr;
-}
-
-CodeLocations::pending_module_t* CodeLocations::add_or_get_pending_module(const char* path)
-{
-	pending_module_t* mm = _pending_modules;
-	pending_module_t* prev_mm = nullptr;
+	tracked_module_t* mm = _tracked_modules;
+	tracked_module_t* prev_mm = nullptr;
 	while (mm != nullptr)
 	{
 		if (strcmp(path, mm->path) == 0)
@@ -378,92 +366,154 @@ CodeLocations::pending_module_t* CodeLocations::add_or_get_pending_module(const
 		prev_mm = mm;
 		mm = mm->next;
 	}
-	pending_module_t* new_mm = (pending_module_t*) _af.malloc(sizeof(pending_module_t));
+	tracked_module_t* new_mm = (tracked_module_t*) _af.malloc(sizeof(tracked_module_t));
+	assert (new_mm != nullptr);
 	if (prev_mm != nullptr)
 		prev_mm->next = new_mm;
 	else
-		_pending_modules = new_mm;
+		_tracked_modules = new_mm;
 	assert(strlen(path) <= PATH_MAX);
 	strncpy(new_mm->path, path, PATH_MAX);
+	new_mm->path[PATH_MAX] = '\0';
+	new_mm->realpath[0] = '\0';
+	new_mm->build_id_len = 0;
+	// Modules can be referred by their build-id (hexadecimal string) or by path
+	if (strchr (path, '/') == nullptr &&
+	    ModuleRegistry::build_id_from_string (path, new_mm->build_id, new_mm->build_id_len))
+	{
+		new_mm->bound = _modules->find_by_build_id (new_mm->build_id, new_mm->build_id_len);
+	}
+	else
+	{
+		if (realpath (path, new_mm->realpath) == nullptr)
+		{
+			VERBOSE_MSG (1, "Warning! Could not get realpath of %s (from location)\n", path);
+			strncpy(new_mm->realpath, path, PATH_MAX);
+			new_mm->realpath[PATH_MAX] = '\0';
+		}
+		new_mm->bound = _modules->find_by_path (path);
+	}
 	new_mm->nframes = 0;
 	new_mm->next = nullptr;
 	return new_mm;
 }
 
-void CodeLocations::delete_unused_pending_modules(void)
+// Checks whether the registry module m is the module referred by the locations
+bool CodeLocations::is_tracked_module(const tracked_module_t* module, const ModuleRegistry::module_t *m)
 {
-	pending_module_t* mm = _pending_modules;
-	pending_module_t* prev_mm = nullptr;
-	while (mm != nullptr)
+	if (module->build_id_len > 0)
+		return m->build_id_len == module->build_id_len &&
+		  memcmp (m->build_id, module->build_id, module->build_id_len) == 0;
+	else
+		return _modules->is_module (m, module->realpath);
+}
+
+// Computes the relocated address of the frame, if its module is loaded.
+// Symbols are looked up in the dynamic symbol table of the module.
+bool CodeLocations::resolve_frame(const raw_frame_t* frame, uintptr_t &address) const
+{
+	const ModuleRegistry::module_t *m = frame->module->bound;
+	if (m == nullptr)
+		return false;
+
+	if (frame->symbol != nullptr)
 	{
-		if (mm->nframes == 0)
-		{
-			pending_module_t* next = mm->next;
-			if (prev_mm != nullptr)
-				prev_mm->next = next;
-			else
-				_pending_modules = next;
-			_af.free(mm);
-			mm = next;
-		}
-		else
+		uintptr_t symbol_address;
+		if (!ModuleRegistry::symbol_to_address (m, frame->symbol, symbol_address))
 		{
-			prev_mm = mm;
-			mm = mm->next;
+			VERBOSE_MSG(1, "Warning! Could not find symbol '%s' in the dynamic symbol table of %s\n",
+			  frame->symbol, m->name);
+			return false;
 		}
+		address = symbol_address + frame->offset;
+		return true;
 	}
+	else
+		return ModuleRegistry::file_offset_to_address (m, frame->offset, address);
 }
 
-void CodeLocations::translate_pending_frames(const char* module)
+// Relocates every frame that refers to the given module according to its
+// current binding. Frames of modules that are not loaded are set to 0 so
+// that they never match. Returns the number of frames left unresolved.
+unsigned CodeLocations::relocate_frames(const tracked_module_t* module)
 {
-	load_memory_mappings_info(_maps_info);
-
-	pending_module_t* mod = get_pending_module(module);
-	if (mod != nullptr)
+	unsigned unresolved = 0;
+	for (unsigned l = 0; l < _nlocations; l++)
 	{
-		VERBOSE_MSG(0, "Pending library '%s' is loading, translating frames.\n", module);
-		for (unsigned l = 0; l < _nlocations; l++)
+		location_t* loc = &_locations[l];
+		for (unsigned f = 0; f < loc->nframes; f++)
 		{
-			location_t* loc = &_locations[l];
+			raw_frame_t *rf = &loc->frames.raw[f];
+			if (rf->module != module)
+				continue;
 
-			pending_raw_frame_t* mf = loc->pending_frames;
-			pending_raw_frame_t* prev_mf = nullptr;
-			while (mf != nullptr)
+			uintptr_t address = 0;
+			if (resolve_frame (rf, address))
+				rf->frame = address;
+			else
 			{
-				// iterate over all pending frames because a library load will also load the shared libraries this depends on
-				bool found = false;
-				pending_raw_frame_t* mf_next = mf->next;
-				long address = file_offset_to_address (mf->module->path, mf->offset, found);
-				if (found)
-				{
-					loc->frames.raw[mf->index].frame = address;
-					mf->module->nframes--;
-
-					// delete pending_frame
-					if (prev_mf != nullptr)
-						prev_mf->next = mf_next;
-					else
-						loc->pending_frames = mf_next;
-					_af.free(mf);
-
-					// prepare next iter
-					mf = mf_next;
-				}
-				else
-				{
-					prev_mf = mf;
-					mf = mf_next;
-				}
+				rf->frame = 0;
+				unresolved++;
 			}
 		}
+	}
+	return unresolved;
+}
 
-		if (mod->nframes > 0)
-		{
-			VERBOSE_MSG(0, "Warning! There are %u frames still pending for library '%s'\n", mod->nframes, mod->path);
-		}
+// The module-change entry points below are called with the interposer lock
+// held, so the matching code never observes a partially relocated location.
+void CodeLocations::module_loaded (const ModuleRegistry::module_t *m)
+{
+	bool changed = false;
+	for (tracked_module_t* mm = _tracked_modules; mm != nullptr; mm = mm->next)
+	{
+		if (mm->bound != nullptr && mm->bound->loaded)
+			continue;
+		if (!is_tracked_module (mm, m))
+			continue;
 
-		delete_unused_pending_modules();
+		VERBOSE_MSG(0, "Library '%s' is loading, translating frames.\n", mm->path);
+		mm->bound = m;
+		unsigned unresolved = relocate_frames (mm);
+		if (unresolved > 0)
+			VERBOSE_MSG(0, "Warning! There are %u frames still pending for library '%s'\n",
+			  unresolved, mm->path);
+		changed = true;
+	}
+	if (changed)
 		show_frames ();
+}
+
+void CodeLocations::module_unloaded (const ModuleRegistry::module_t *m)
+{
+	for (tracked_module_t* mm = _tracked_modules; mm != nullptr; mm = mm->next)
+	{
+		if (mm->bound != m)
+			continue;
+
+		VERBOSE_MSG(0, "Library '%s' is unloading, its %u frames become pending.\n",
+		  mm->path, mm->nframes);
+		mm->bound = nullptr;
+		relocate_frames (mm);
+	}
+}
+
+// Re-binds all the tracked modules against the registry. Used when the
+// registry has been refreshed as a whole rather than through loader events.
+void CodeLocations::update_modules (void)
+{
+	for (tracked_module_t* mm = _tracked_modules; mm != nullptr; mm = mm->next)
+	{
+		if (mm->bound != nullptr && !mm->bound->loaded)
+			module_unloaded (mm->bound);
+		if (mm->bound == nullptr)
+		{
+			const ModuleRegistry::module_t *m = mm->build_id_len > 0 ?
+			  _modules->find_by_build_id (mm->build_id, mm->build_id_len) :
+			  _modules->find_by_path (mm->path);
+			if (m != nullptr)
+				module_loaded (m);
+		}
 	}
 }
 
@@ -556,11 +606,6 @@ bool CodeLocations::readfile (const char *f, const char *fallback_allocator_name
 		}
 	}
 
-	if (!options.sourceFrames())
-	{
-		load_memory_mappings_info(_maps_info);
-	}
-
 	_nlocations = 0;
 	for (char * p_current = p, *prevEOL = p; p_current != nullptr && p_current < &p[sb.st_size];
 			// prevEOL needs to be equal to p_current+1 except on the first iteration, as p_current points
@@ -589,7 +634,6 @@ bool CodeLocations::readfile (const char *f, const char *fallback_allocator_name
 		}
 
 		_locations = (location_t*) _af.realloc (_locations, sizeof(location_t)*(_nlocations+1));
-		_locations[_nlocations].pending_frames = nullptr;
 
 		// Process source location and see if it is correctly processed (and not ignored).
 		if (options.sourceFrames() &&
@@ -619,6 +663,11 @@ bool CodeLocations::readfile (const char *f, const char *fallback_allocator_name
 			VERBOSE_MSG(0, "The allocator \"%s\" is not available. Check if its parameters in the configuration file are correct.\n", _locations[_nlocations].allocator->name());
 			exit (-1);
 		}
+		for (unsigned t = 0; t < _locations[_nlocations].ntiers; ++t)
+			if (! _locations[_nlocations].tiers[t]->is_ready()) {
+				VERBOSE_MSG(0, "The allocator \"%s\" is not available. Check if its parameters in the configuration file are correct.\n", _locations[_nlocations].tiers[t]->name());
+				exit (-1);
+			}
 
 		_min_nframes = std::min(_min_nframes, _locations[_nlocations].nframes);
 		_max_nframes = std::max(_max_nframes, _locations[_nlocations].nframes);
@@ -786,6 +835,11 @@ void CodeLocations::show_stats (void)
 				VERBOSE_MSG(0, " - %u matches.\n", _locations[l].stats.n_allocations);
 			}
 		}
+		for (unsigned t = 0; t < _locations[l].ntiers; ++t)
+			VERBOSE_MSG(0, " - Then allocator '%s': %u fit and %u not fit.\n",
+			  _locations[l].tiers[t]->name(),
+			  _locations[l].stats.n_tier_hits[t],
+			  _locations[l].stats.n_tier_misses[t]);
 	}
 }
 
@@ -1100,6 +1154,19 @@ Allocator * CodeLocations::match (unsigned nframes, const translated_frame_t *tf
 	return nullptr;
 }
 
+// Locations are sorted by number of frames, so the index of a location does
+// not correspond to its ID (its position in the locations file)
+bool CodeLocations::location_index (unsigned id, unsigned &cl) const
+{
+	for (unsigned l = 0; l < _nlocations; ++l)
+		if (_locations[l].id == id)
+		{
+			cl = l;
+			return true;
+		}
+	return false;
+}
+
 void CodeLocations::record_location (unsigned lid, bool fits, bool in_cache)
 {
 	assert (lid < _nlocations);
@@ -1124,43 +1191,69 @@ void CodeLocations::record_location (unsigned lid, bool fits)
 		_locations[lid].stats.n_allocations_not_fit++;
 }
 
-void CodeLocations::record_location_add_memory (unsigned lid, size_t size, bool fallback_allocator)
+// Returns the first allocator of the chain of the location in which an
+// object that does not fit in the allocator of the location fits, or
+// nullptr if there is none
+Allocator * CodeLocations::next_tier (unsigned lid, size_t size)
 {
 	assert (lid < _nlocations);
 
-	if (!fallback_allocator)
+	for (unsigned t = 0; t < _locations[lid].ntiers; ++t)
 	{
-		_locations[lid].stats.current_used_memory += size;
-		if (_locations[lid].stats.HWM < _locations[lid].stats.current_used_memory)
-			_locations[lid].stats.HWM = _locations[lid].stats.current_used_memory;
+		if (_locations[lid].tiers[t]->fits (size))
+		{
+			_locations[lid].stats.n_tier_hits[t]++;
+			return _locations[lid].tiers[t];
+		}
+		_locations[lid].stats.n_tier_misses[t]++;
 	}
+	return nullptr;
+}
+
+void CodeLocations::record_location_add_memory (unsigned lid, size_t size, bool fallback_allocator)
+{
+	if (!fallback_allocator)
+		record_location_add_split_memory (lid, size, 0);
 	else
-	{
-		_locations[lid].stats.current_used_memory_fb += size;
-		if (_locations[lid].stats.HWM_fb < _locations[lid].stats.current_used_memory_fb)
-			_locations[lid].stats.HWM_fb = _locations[lid].stats.current_used_memory_fb;
-	}
+		record_location_add_split_memory (lid, 0, size);
+}
+
+void CodeLocations::record_location_sub_memory (unsigned lid, size_t size, bool fallback_allocator)
+{
+	if (!fallback_allocator)
+		record_location_sub_split_memory (lid, size, 0);
+	else
+		record_location_sub_split_memory (lid, 0, size);
+}
+
+// Accounts an object with size bytes on the requested allocator and size_fb
+// bytes on the fallback one (either may be 0 unless the object was split)
+void CodeLocations::record_location_add_split_memory (unsigned lid, size_t size, size_t size_fb)
+{
+	assert (lid < _nlocations);
+
+	_locations[lid].stats.current_used_memory += size;
+	if (_locations[lid].stats.HWM < _locations[lid].stats.current_used_memory)
+		_locations[lid].stats.HWM = _locations[lid].stats.current_used_memory;
+	_locations[lid].stats.current_used_memory_fb += size_fb;
+	if (_locations[lid].stats.HWM_fb < _locations[lid].stats.current_used_memory_fb)
+		_locations[lid].stats.HWM_fb = _locations[lid].stats.current_used_memory_fb;
+
 	_locations[lid].stats.n_living_objects++;
 	if (_locations[lid].stats.n_max_living_objects < _locations[lid].stats.n_living_objects)
 	  _locations[lid].stats.n_max_living_objects = _locations[lid].stats.n_living_objects;
 }
 
-void CodeLocations::record_location_sub_memory (unsigned lid, size_t size, bool fallback_allocator)
+void CodeLocations::record_location_sub_split_memory (unsigned lid, size_t size, size_t size_fb)
 {
 	assert (lid < _nlocations);
 
-	if (!fallback_allocator)
-	{
-		assert (_locations[lid].stats.current_used_memory >= size);
-		if (_locations[lid].stats.current_used_memory >= size)
-			_locations[lid].stats.current_used_memory -= size;
-	}
-	else
-	{
-		assert (_locations[lid].stats.current_used_memory_fb >= size);
-		if (_locations[lid].stats.current_used_memory_fb >= size)
-			_locations[lid].stats.current_used_memory_fb -= size;
-	}
+	assert (_locations[lid].stats.current_used_memory >= size);
+	if (_locations[lid].stats.current_used_memory >= size)
+		_locations[lid].stats.current_used_memory -= size;
+	assert (_locations[lid].stats.current_used_memory_fb >= size_fb);
+	if (_locations[lid].stats.current_used_memory_fb >= size_fb)
+		_locations[lid].stats.current_used_memory_fb -= size_fb;
 
 	assert(_locations[lid].stats.n_living_objects > 0);
 	if (_locations[lid].stats.n_living_objects > 0)
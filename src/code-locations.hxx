@@ -5,6 +5,7 @@
 #pragma once
 
 #include "allocators.hxx"
+#include "module-registry.hxx"
 
 typedef struct {
 	bool translated;
@@ -23,11 +24,34 @@ class CodeLocations
 	    bool valid;
 	} source_frame_t;
 
+	// Module referenced by raw frames, either by path or by build-id. It is
+	// bound to the registry entry while the module is loaded, and its frames
+	// are relocated whenever the binding changes.
+	typedef struct st_tracked_module
+	{
+		char path[PATH_MAX+1];
+		char realpath[PATH_MAX+1];
+		uint8_t build_id[ModuleRegistry::MAX_BUILD_ID_SZ];
+		unsigned build_id_len; // 0 if the module is referenced by path
+		const ModuleRegistry::module_t *bound;
+		unsigned nframes;
+		struct st_tracked_module* next;
+	} tracked_module_t;
+
+	// Raw frames are given either as module!offset (offset within the file)
+	// or as module!symbol+offset (offset from an exported symbol)
 	typedef struct
 	{
 		long frame;
+		tracked_module_t *module;
+		char *symbol;
+		long offset;
 	} raw_frame_t;
 
+	// Allocators tried, in order, for the objects that do not fit in the
+	// allocator of a location before resorting to the fallback allocator
+	static const unsigned MAX_TIERS = 4;
+
 	typedef struct {
 		size_t   current_used_memory;
 		size_t   HWM;
@@ -39,23 +63,10 @@ class CodeLocations
 		unsigned n_allocations_not_in_cache;
 		unsigned n_allocations_not_fit;
 		unsigned n_allocations;
+		unsigned n_tier_hits[MAX_TIERS];
+		unsigned n_tier_misses[MAX_TIERS];
 	} location_stats_t;
 
-	typedef struct st_pending_module
-	{
-		char path[PATH_MAX+1];
-		unsigned nframes;
-		struct st_pending_module* next;
-	} pending_module_t;
-
-	typedef struct st_pending_raw_frame
-	{
-		pending_module_t* module;
-		long offset;
-		unsigned index;
-		struct st_pending_raw_frame* next;
-	} pending_raw_frame_t;
-
 	typedef struct
 	{
 		union
@@ -64,31 +75,16 @@ class CodeLocations
 			raw_frame_t    *raw;
 		} frames;
 		Allocator * allocator;
+		Allocator * tiers[MAX_TIERS];
+		unsigned ntiers;
+		thp_policy_t thp;
+		bool split;
+		size_t prefault; // size threshold, 0 if unset
 		location_stats_t stats;
 		unsigned nframes;
 		unsigned id;
-		pending_raw_frame_t* pending_frames;
 	} location_t;
 
-	#define LINE_SIZE 2048
-	typedef struct
-	{
-		unsigned long start;
-		unsigned long end;
-		unsigned long offset;
-		char module[LINE_SIZE+1];
-		bool perm_read;
-		bool perm_write;
-		bool perm_exec;
-	} memory_maps_entry_t;
-
-	typedef struct
-	{
-		unsigned num_entries;
-		unsigned capacity;
-		memory_maps_entry_t* entries;
-	} memory_maps_t;
-
 	static bool comparator_by_ID (const location_t &lhs, const location_t &rhs);
 	static bool comparator_by_NumberOfFrames (const location_t &lhs, const location_t &rhs);
 
@@ -97,14 +93,13 @@ class CodeLocations
 					// when locations are sorted by comparator_by_NumberOfFrames
 	const allocation_functions_t _af;
 	Allocators * const _allocators;
+	ModuleRegistry * const _modules;
 	location_t * _locations;
 	unsigned _nlocations;
 	unsigned _min_nframes;
 	unsigned _max_nframes;
 
-	memory_maps_t _maps_info;
-
-	pending_module_t* _pending_modules;
+	tracked_module_t* _tracked_modules;
 
 	unsigned get_min_index_for_number_of_frames (unsigned nframes) const;
 	unsigned get_max_index_for_number_of_frames (unsigned nframes) const;
@@ -115,15 +110,14 @@ class CodeLocations
 	bool process_raw_location (char *location_txt, location_t * location, const char * fallback_allocator_name);
 	void clean_source_location (location_t * location);
 	void show_frames (void);
-	long file_offset_to_address (const char *lib, unsigned long address, bool& found);
 	void create_fast_indexes_for_frames (void);
-	bool load_memory_mappings_info (memory_maps_t& maps);
-	pending_module_t* get_pending_module(const char* path);
-	pending_module_t* add_or_get_pending_module(const char* path);
-	void delete_unused_pending_modules(void);
+	tracked_module_t* add_or_get_tracked_module(const char* path);
+	bool is_tracked_module(const tracked_module_t* module, const ModuleRegistry::module_t *m);
+	bool resolve_frame(const raw_frame_t* frame, uintptr_t &address) const;
+	unsigned relocate_frames(const tracked_module_t* module);
 
 	public:
-	CodeLocations (allocation_functions_t &, Allocators *);
+	CodeLocations (allocation_functions_t &, Allocators *, ModuleRegistry *);
 	~CodeLocations();
 	bool readfile (const char *f, const char *fallback_allocator_name);
 	void show_stats (void);
@@ -133,15 +127,27 @@ class CodeLocations
 	Allocator * match (unsigned nframes, void **frames, unsigned & location_id);
 	Allocators * allocators () const
 	  { return _allocators; };
+	ModuleRegistry * modules () const
+	  { return _modules; };
 	void record_location (unsigned location_id, bool fits, bool in_cache);
 	void record_location (unsigned location_id, bool fits);
+	Allocator * next_tier (unsigned location_id, size_t sz);
 	void record_location_add_memory (unsigned location_id, size_t sz, bool fallback_allocator);
 	void record_location_sub_memory (unsigned location_id, size_t sz, bool fallback_allocator);
+	void record_location_add_split_memory (unsigned location_id, size_t sz, size_t sz_fallback);
+	void record_location_sub_split_memory (unsigned location_id, size_t sz, size_t sz_fallback);
 	unsigned num_locations (void) const { return _nlocations; };
 	unsigned min_nframes (void) const { return _min_nframes; };
 	unsigned max_nframes (void) const { return _max_nframes; };
 	unsigned has_locations (void) const { return _nlocations > 0; };
 	Allocator * allocator (unsigned cl) const { return cl <= _nlocations ? _locations[cl].allocator : nullptr; };
-	void translate_pending_frames(const char* module);
+	unsigned location_id (unsigned cl) const { return _locations[cl].id; };
+	thp_policy_t thp (unsigned cl) const { return _locations[cl].thp; };
+	bool split (unsigned cl) const { return _locations[cl].split; };
+	size_t prefault (unsigned cl) const { return _locations[cl].prefault; };
+	bool location_index (unsigned id, unsigned &cl) const;
+	void module_loaded (const ModuleRegistry::module_t *m);
+	void module_unloaded (const ModuleRegistry::module_t *m);
+	void update_modules (void);
 };
 
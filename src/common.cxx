@@ -30,6 +30,16 @@ Options options;
 #define MATCH_ONLY_ON_MAIN_BINARY_DEFAULT   false
 #define SOURCE_FRAMES_DEFAULT               true
 #define IGNORE_IF_FALLBACK_ALLOCATOR_DEFAULT true
+#define ASYNC_SYMBOLIZATION_DEFAULT         false
+#define THP_POLICY_DEFAULT                  THP_POLICY_NONE
+#define THP_THRESHOLD_DEFAULT               (4UL << 20)
+#define PREFAULT_DEFAULT                    PREFAULT_NONE
+#define PREFAULT_THRESHOLD_DEFAULT          (64UL << 20)
+#define PREFAULT_THREADS_DEFAULT            8
+#define MMAP_THRESHOLD_DEFAULT              (16UL << 20)
+#define SHRINK_THRESHOLD_DEFAULT            (1UL << 20)
+#define COPY_THREADS_DEFAULT                0
+#define COPY_THRESHOLD_DEFAULT              (64UL << 20)
 
 #define PROCESS_ENVVAR(envvar,var,defvalue) \
     { \
@@ -71,6 +81,7 @@ Options::Options ()
 	PROCESS_ENVVAR(TOOL_CALLSTACK_STOP_AT_MAIN, _stopAtMain, CALLSTACK_STOP_AT_MAIN_DEFAULT);
 	PROCESS_ENVVAR(TOOL_SHORTEN_FRAMES, _shorten_frames, CALLSTACK_SHORTEN_FRAMES_DEFAULT);
 	PROCESS_ENVVAR(TOOL_IGNORE_IF_FALLBACK_ALLOCATOR, _ignoreIfFallbackAllocator, IGNORE_IF_FALLBACK_ALLOCATOR_DEFAULT);
+	PROCESS_ENVVAR(TOOL_ASYNC_SYMBOLIZATION, _asyncSymbolization, ASYNC_SYMBOLIZATION_DEFAULT);
 	if (getenv (TOOL_SOURCE_FRAMES))
 	{
 		PROCESS_ENVVAR(TOOL_SOURCE_FRAMES, _sourceFrames, SOURCE_FRAMES_DEFAULT);
@@ -95,6 +106,112 @@ Options::Options ()
 	else
 		_minSize = msize;
 
+	_thpPolicy = THP_POLICY_DEFAULT;
+	char *thp_policy = getenv(TOOL_THP_POLICY);
+	if (thp_policy != nullptr && !parseThpPolicy (thp_policy, _thpPolicy))
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Available values are huge, nohuge and none.\n",
+		  TOOL_THP_POLICY);
+		_thpPolicy = THP_POLICY_DEFAULT;
+	}
+
+	long long tsize = THP_THRESHOLD_DEFAULT;
+	char *thp_threshold = getenv(TOOL_THP_THRESHOLD);
+	if (thp_threshold != nullptr)
+		tsize = atoll (thp_threshold);
+	if (tsize < 0)
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Setting it to %lu.\n",
+		  TOOL_THP_THRESHOLD, THP_THRESHOLD_DEFAULT);
+		tsize = THP_THRESHOLD_DEFAULT;
+	}
+	_thpThreshold = tsize;
+
+	_prefault = PREFAULT_DEFAULT;
+	char *prefault = getenv(TOOL_PREFAULT);
+	if (prefault != nullptr)
+	{
+		if (strcasecmp (prefault, "local") == 0)
+			_prefault = PREFAULT_LOCAL;
+		else if (strcasecmp (prefault, "spread") == 0)
+			_prefault = PREFAULT_SPREAD;
+		else if (strcasecmp (prefault, "none") != 0)
+			VERBOSE_MSG(0, "Wrong value for environment variable %s. Available values are local, spread and none.\n",
+			  TOOL_PREFAULT);
+	}
+
+	long long psize = PREFAULT_THRESHOLD_DEFAULT;
+	char *prefault_threshold = getenv(TOOL_PREFAULT_THRESHOLD);
+	if (prefault_threshold != nullptr)
+		psize = atoll (prefault_threshold);
+	if (psize < 0)
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Setting it to %lu.\n",
+		  TOOL_PREFAULT_THRESHOLD, PREFAULT_THRESHOLD_DEFAULT);
+		psize = PREFAULT_THRESHOLD_DEFAULT;
+	}
+	_prefaultThreshold = psize;
+
+	int pthreads = PREFAULT_THREADS_DEFAULT;
+	char *prefault_threads = getenv(TOOL_PREFAULT_THREADS);
+	if (prefault_threads != nullptr)
+		pthreads = atoi (prefault_threads);
+	if (pthreads <= 0)
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Setting it to %d.\n",
+		  TOOL_PREFAULT_THREADS, PREFAULT_THREADS_DEFAULT);
+		pthreads = PREFAULT_THREADS_DEFAULT;
+	}
+	_prefaultThreads = pthreads;
+
+	long long msize_mmap = MMAP_THRESHOLD_DEFAULT;
+	char *mmap_threshold = getenv(TOOL_MMAP_THRESHOLD);
+	if (mmap_threshold != nullptr)
+		msize_mmap = atoll (mmap_threshold);
+	if (msize_mmap < 0)
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Setting it to %lu.\n",
+		  TOOL_MMAP_THRESHOLD, MMAP_THRESHOLD_DEFAULT);
+		msize_mmap = MMAP_THRESHOLD_DEFAULT;
+	}
+	_mmapThreshold = msize_mmap;
+
+	long long ssize = SHRINK_THRESHOLD_DEFAULT;
+	char *shrink_threshold = getenv(TOOL_SHRINK_THRESHOLD);
+	if (shrink_threshold != nullptr)
+		ssize = atoll (shrink_threshold);
+	if (ssize < 0)
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Setting it to %lu.\n",
+		  TOOL_SHRINK_THRESHOLD, SHRINK_THRESHOLD_DEFAULT);
+		ssize = SHRINK_THRESHOLD_DEFAULT;
+	}
+	_shrinkThreshold = ssize;
+
+	int cthreads = COPY_THREADS_DEFAULT;
+	char *copy_threads = getenv(TOOL_COPY_THREADS);
+	if (copy_threads != nullptr)
+		cthreads = atoi (copy_threads);
+	if (cthreads < 0)
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Setting it to %d.\n",
+		  TOOL_COPY_THREADS, COPY_THREADS_DEFAULT);
+		cthreads = COPY_THREADS_DEFAULT;
+	}
+	_copyThreads = cthreads;
+
+	long long csize = COPY_THRESHOLD_DEFAULT;
+	char *copy_threshold = getenv(TOOL_COPY_THRESHOLD);
+	if (copy_threshold != nullptr)
+		csize = atoll (copy_threshold);
+	if (csize <= 0)
+	{
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Setting it to %lu.\n",
+		  TOOL_COPY_THRESHOLD, COPY_THRESHOLD_DEFAULT);
+		csize = COPY_THRESHOLD_DEFAULT;
+	}
+	_copyThreshold = csize;
+
 	struct timespec ts;
 	clock_gettime (CLOCK_MONOTONIC, &ts);
 	_initial_time = ((uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
@@ -104,6 +221,34 @@ Options::~Options ()
 {
 }
 
+bool Options::parseThpPolicy (const char *s, thp_policy_t &policy)
+{
+	if (strcasecmp (s, "huge") == 0)
+		policy = THP_POLICY_HUGE;
+	else if (strcasecmp (s, "nohuge") == 0)
+		policy = THP_POLICY_NOHUGE;
+	else if (strcasecmp (s, "none") == 0)
+		policy = THP_POLICY_NONE;
+	else
+		return false;
+	return true;
+}
+
+const char * Options::thpPolicyName (thp_policy_t policy)
+{
+	switch (policy)
+	{
+		case THP_POLICY_HUGE:
+			return "huge";
+		case THP_POLICY_NOHUGE:
+			return "nohuge";
+		case THP_POLICY_NONE:
+			return "none";
+		default:
+			return "unset";
+	}
+}
+
 uint64_t Options::getTime (void) const
 {
 	struct timespec ts;
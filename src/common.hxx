@@ -10,7 +10,19 @@
 #include <limits.h>
 #include <sys/param.h>
 
-#include "flexmalloc-config.h"
+// The configuration of the build is only seen by FlexMalloc itself, as this
+// header is also installed for the plugins
+#if defined(HAVE_CONFIG_H)
+# include "flexmalloc-config.h"
+#endif
+
+// Transparent huge pages policy for large allocations. UNSET is only used
+// by the locations, meaning that the global policy applies.
+typedef enum { THP_POLICY_UNSET = 0, THP_POLICY_NONE, THP_POLICY_HUGE, THP_POLICY_NOHUGE } thp_policy_t;
+
+#define THP_PAGE_SIZE (2UL << 20)
+
+typedef enum { PREFAULT_NONE = 0, PREFAULT_LOCAL, PREFAULT_SPREAD } prefault_mode_t;
 
 class Options
 {
@@ -28,6 +40,16 @@ class Options
 	bool _sourceFrames;
 	bool _sourceFramesSet;
 	bool _ignoreIfFallbackAllocator;
+	bool _asyncSymbolization;
+	thp_policy_t _thpPolicy;
+	size_t _thpThreshold;
+	prefault_mode_t _prefault;
+	size_t _prefaultThreshold;
+	unsigned _prefaultThreads;
+	size_t _mmapThreshold;
+	size_t _shrinkThreshold;
+	unsigned _copyThreads;
+	size_t _copyThreshold;
 	
 	public:
 	Options ();
@@ -67,6 +89,28 @@ class Options
 	  { return _sourceFramesSet; };
 	bool ignoreIfFallbackAllocator (void) const
 	  { return _ignoreIfFallbackAllocator; };
+	bool asyncSymbolization (void) const
+	  { return _asyncSymbolization; };
+	thp_policy_t thpPolicy (void) const
+	  { return _thpPolicy; };
+	size_t thpThreshold (void) const
+	  { return _thpThreshold; };
+	static bool parseThpPolicy (const char *s, thp_policy_t &policy);
+	static const char * thpPolicyName (thp_policy_t policy);
+	prefault_mode_t prefault (void) const
+	  { return _prefault; };
+	size_t prefaultThreshold (void) const
+	  { return _prefaultThreshold; };
+	unsigned prefaultThreads (void) const
+	  { return _prefaultThreads; };
+	size_t mmapThreshold (void) const
+	  { return _mmapThreshold; };
+	size_t shrinkThreshold (void) const
+	  { return _shrinkThreshold; };
+	unsigned copyThreads (void) const
+	  { return _copyThreads; };
+	size_t copyThreshold (void) const
+	  { return _copyThreshold; };
 };
 
 typedef struct allocation_functions_st
@@ -97,6 +141,18 @@ extern Options options;
 #define TOOL_MATCH_ONLY_ON_MAIN_BINARY    TOOL_NAME"_MATCH_ONLY_ON_MAIN_BINARY"
 #define TOOL_SOURCE_FRAMES                TOOL_NAME"_SOURCE_FRAMES"
 #define TOOL_IGNORE_IF_FALLBACK_ALLOCATOR TOOL_NAME"_IGNORE_LOCATIONS_ON_FALLBACK_ALLOCATOR"
+#define TOOL_ASYNC_SYMBOLIZATION          TOOL_NAME"_ASYNC_SYMBOLIZATION"
+#define TOOL_DECISIONS_FILE               TOOL_NAME"_DECISIONS_FILE"
+#define TOOL_THP_POLICY                   TOOL_NAME"_THP_POLICY"
+#define TOOL_THP_THRESHOLD                TOOL_NAME"_THP_THRESHOLD"
+#define TOOL_METADATA                     TOOL_NAME"_METADATA"
+#define TOOL_PREFAULT                     TOOL_NAME"_PREFAULT"
+#define TOOL_PREFAULT_THRESHOLD           TOOL_NAME"_PREFAULT_THRESHOLD"
+#define TOOL_PREFAULT_THREADS             TOOL_NAME"_PREFAULT_THREADS"
+#define TOOL_MMAP_THRESHOLD               TOOL_NAME"_MMAP_THRESHOLD"
+#define TOOL_SHRINK_THRESHOLD             TOOL_NAME"_SHRINK_THRESHOLD"
+#define TOOL_COPY_THREADS                 TOOL_NAME"_COPY_THREADS"
+#define TOOL_COPY_THRESHOLD               TOOL_NAME"_COPY_THRESHOLD"
 
 #define VERBOSE_MSG(level,...) \
 	{ if (options.verboseLvl() >= level || options.debug()) { fprintf (options.messages_on_stderr() ? stderr : stdout, TOOL_NAME"|" __VA_ARGS__); } }
@@ -0,0 +1,215 @@
+// License: To determine
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "copy-engine.hxx"
+
+CopyEngine * CopyEngine::_instance = nullptr;
+
+CopyEngine::CopyEngine (unsigned max_threads, size_t threshold)
+  : _max_threads (MIN(max_threads, MAX_THREADS)), _threshold (threshold),
+    _nthreads (0), _generation (0), _nbusy (0), _dest (nullptr), _src (nullptr), _length (0),
+    _to (nullptr), _stream (false), _next_chunk (0), _npairs (0)
+{
+	pthread_mutex_init (&_mtx, nullptr);
+	pthread_cond_init (&_work, nullptr);
+	pthread_cond_init (&_done, nullptr);
+}
+
+CopyEngine::~CopyEngine ()
+{
+}
+
+// The calling thread takes chunks too, so one CPU is left for it
+void CopyEngine::start (void)
+{
+	long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+	unsigned nthreads = _max_threads;
+	if (ncpus > 0)
+		nthreads = MIN(nthreads, (unsigned) ncpus - 1);
+
+	for (unsigned u = 0; u < nthreads; ++u)
+		if (pthread_create (&_threads[_nthreads], nullptr, worker, this) == 0)
+			_nthreads++;
+	if (_nthreads < nthreads)
+		VERBOSE_MSG(0, "Warning! Could only create %u of %u copy threads.\n", _nthreads, nthreads);
+
+	if (_nthreads == 0)
+		return;
+
+	_instance = this;
+	pthread_atfork (atfork_prepare, atfork_parent, atfork_child);
+	VERBOSE_MSG(1, "Large cross-tier copies will be done by %u threads.\n", _nthreads + 1);
+}
+
+// A fork waits for the workers to finish the current copy, if any, and
+// holds the pool until the child is created
+void CopyEngine::atfork_prepare (void)
+{
+	pthread_mutex_lock (&_instance->_mtx);
+	while (_instance->_nbusy > 0)
+		pthread_cond_wait (&_instance->_done, &_instance->_mtx);
+}
+
+void CopyEngine::atfork_parent (void)
+{
+	pthread_mutex_unlock (&_instance->_mtx);
+}
+
+// Only the forking thread exists in the child
+void CopyEngine::atfork_child (void)
+{
+	pthread_mutex_init (&_instance->_mtx, nullptr);
+	pthread_cond_init (&_instance->_work, nullptr);
+	pthread_cond_init (&_instance->_done, nullptr);
+	_instance->_nthreads = 0;
+	_instance->_nbusy = 0;
+}
+
+// Copies with SSE2 streaming stores, which bypass the cache, from the first
+// 16-byte boundary of the destination. The stores are fenced before
+// returning, so that they are visible once the copy is reported as done.
+void CopyEngine::stream (char *dest, const char *src, size_t n)
+{
+#if defined(__SSE2__)
+	size_t head = MIN((size_t) (-(uintptr_t) dest & 15), n);
+	::memcpy (dest, src, head);
+	dest += head; src += head; n -= head;
+
+	for (; n >= 64; n -= 64, dest += 64, src += 64)
+	{
+		__m128i a = _mm_loadu_si128 ((const __m128i*) src);
+		__m128i b = _mm_loadu_si128 ((const __m128i*) (src + 16));
+		__m128i c = _mm_loadu_si128 ((const __m128i*) (src + 32));
+		__m128i d = _mm_loadu_si128 ((const __m128i*) (src + 48));
+		_mm_stream_si128 ((__m128i*) dest, a);
+		_mm_stream_si128 ((__m128i*) (dest + 16), b);
+		_mm_stream_si128 ((__m128i*) (dest + 32), c);
+		_mm_stream_si128 ((__m128i*) (dest + 48), d);
+	}
+	_mm_sfence ();
+#endif
+	::memcpy (dest, src, n);
+}
+
+void CopyEngine::copy_chunk (char *dest, const char *src, size_t n) const
+{
+	if (_stream)
+		stream (dest, src, n);
+	else
+		_to->memcpy (dest, src, n);
+}
+
+void CopyEngine::copy_chunks (void)
+{
+	size_t nchunks = (_length + CHUNK_SZ - 1) / CHUNK_SZ;
+	size_t c;
+	while ((c = __sync_fetch_and_add (&_next_chunk, 1)) < nchunks)
+	{
+		size_t offset = c * CHUNK_SZ;
+		copy_chunk (_dest + offset, _src + offset, MIN(CHUNK_SZ, _length - offset));
+	}
+}
+
+void * CopyEngine::worker (void *p)
+{
+	((CopyEngine*) p)->worker_loop();
+	return nullptr;
+}
+
+void CopyEngine::worker_loop (void)
+{
+	unsigned generation = 0;
+	while (true)
+	{
+		pthread_mutex_lock (&_mtx);
+		while (_generation == generation)
+			pthread_cond_wait (&_work, &_mtx);
+		generation = _generation;
+		pthread_mutex_unlock (&_mtx);
+
+		copy_chunks ();
+
+		pthread_mutex_lock (&_mtx);
+		// Both the copying thread and a fork may be waiting
+		if (--_nbusy == 0)
+			pthread_cond_broadcast (&_done);
+		pthread_mutex_unlock (&_mtx);
+	}
+}
+
+CopyEngine::pair_t * CopyEngine::pair (const Allocator *from, const Allocator *to)
+{
+	for (unsigned u = 0; u < _npairs; ++u)
+		if (_pairs[u].from == from && _pairs[u].to == to)
+			return &_pairs[u];
+
+	if (_npairs == MAX_PAIRS)
+		return nullptr;
+	pair_t *p = &_pairs[_npairs++];
+	p->from = from;
+	p->to = to;
+	p->ncopies = p->nstreamed = p->bytes = 0;
+	p->time = 0;
+	return p;
+}
+
+void CopyEngine::copy (Allocator *to, const Allocator *from, void *dest, const void *src, size_t n, bool stream)
+{
+	if (n == 0)
+		return;
+
+	uint64_t t = options.getTime();
+
+	_dest = (char*) dest;
+	_src = (const char*) src;
+	_length = n;
+	_to = to;
+	_stream = stream;
+	_next_chunk = 0;
+
+	if (n >= _threshold && _nthreads > 0)
+	{
+		pthread_mutex_lock (&_mtx);
+		_nbusy = _nthreads;
+		_generation++;
+		pthread_cond_broadcast (&_work);
+		pthread_mutex_unlock (&_mtx);
+
+		copy_chunks ();
+
+		pthread_mutex_lock (&_mtx);
+		while (_nbusy > 0)
+			pthread_cond_wait (&_done, &_mtx);
+		pthread_mutex_unlock (&_mtx);
+	}
+	else
+		copy_chunk (_dest, _src, n);
+
+	pair_t *p = pair (from, to);
+	if (p != nullptr)
+	{
+		p->ncopies++;
+		if (stream)
+			p->nstreamed++;
+		p->bytes += n;
+		p->time += options.getTime() - t;
+	}
+}
+
+void CopyEngine::show_statistics (void) const
+{
+	for (unsigned u = 0; u < _npairs; ++u)
+	{
+		const pair_t *p = &_pairs[u];
+		double seconds = (double) p->time / 1000000000.0;
+		VERBOSE_MSG(1, "Copies from %s to %s: %llu objects (%llu streamed), %llu MBytes in %.3f seconds (%.2f GBytes/s).\n",
+		  p->from != nullptr ? p->from->name() : "none", p->to->name(), p->ncopies, p->nstreamed,
+		  p->bytes >> 20, seconds, seconds > 0 ? (double) p->bytes / seconds / 1e9 : 0.0);
+	}
+}
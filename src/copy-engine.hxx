@@ -0,0 +1,83 @@
+// License: To determine
+
+#pragma once
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "common.hxx"
+#include "allocator.hxx"
+
+// Copies the objects that a realloc moves across tiers. Copies of the
+// threshold size or more are split in chunks taken by a small pool of
+// worker threads together with the calling one, so that they approach the
+// bandwidth of the nodes rather than the one of a single core. Objects that
+// leave their requested tier are written with non-temporal stores, as they
+// are not expected to be used soon and would otherwise evict the cache;
+// the others go through the memcpy of their allocator, which already
+// streams into the persistent tiers. The threads are created when FlexMalloc
+// starts; without them, as in the child of a fork, the calling thread copies
+// the whole object.
+class CopyEngine
+{
+	private:
+	static const unsigned MAX_THREADS = 64;
+	static const unsigned MAX_PAIRS = 64;
+	static const size_t CHUNK_SZ = 4UL << 20; // unit of work
+
+	typedef struct
+	{
+		const Allocator *from;
+		const Allocator *to;
+		unsigned long long ncopies;
+		unsigned long long nstreamed;
+		unsigned long long bytes;
+		uint64_t time; // ns
+	} pair_t;
+
+	const unsigned _max_threads;
+	const size_t _threshold;
+
+	pthread_t _threads[MAX_THREADS];
+	unsigned _nthreads;
+
+	// Current copy, published to the workers under _mtx
+	pthread_mutex_t _mtx;
+	pthread_cond_t _work;
+	pthread_cond_t _done;
+	unsigned _generation;
+	unsigned _nbusy;
+	char *_dest;
+	const char *_src;
+	size_t _length;
+	Allocator *_to;
+	bool _stream;
+	volatile size_t _next_chunk;
+
+	pair_t _pairs[MAX_PAIRS];  // tier pairs seen, in order of appearance
+	unsigned _npairs;
+
+	static CopyEngine *_instance; // the one whose threads are running
+
+	void copy_chunks (void);
+	void copy_chunk (char *, const char *, size_t) const;
+	static void stream (char *, const char *, size_t);
+	static void * worker (void *);
+	void worker_loop (void);
+	static void atfork_prepare (void);
+	static void atfork_parent (void);
+	static void atfork_child (void);
+	pair_t * pair (const Allocator *from, const Allocator *to);
+
+	public:
+	CopyEngine (unsigned max_threads, size_t threshold);
+	~CopyEngine ();
+
+	void start (void);
+	// Copies n bytes from src, allocated by from (or nullptr if by none),
+	// to dest, allocated by to, with non-temporal stores if stream is given.
+	// Copies are expected one at a time, as the FlexMalloc calls are
+	// serialized.
+	void copy (Allocator *to, const Allocator *from, void *dest, const void *src, size_t n, bool stream);
+	void show_statistics (void) const;
+};
@@ -0,0 +1,405 @@
+// License: To determine
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "decision-cache.hxx"
+
+#define LINE_SIZE 16384
+
+DecisionCache::DecisionCache (allocation_functions_t &af, ModuleRegistry *r, const CodeLocations *cl)
+	: _af(af), _registry(r), _cl(cl), _dmodules(nullptr), _ndmodules(0),
+	  _entries(nullptr), _nentries(0), _npreloaded(0), _nhits(0)
+{
+	memset (_buckets, 0, sizeof(_buckets));
+}
+
+DecisionCache::~DecisionCache ()
+{
+}
+
+unsigned DecisionCache::hash (unsigned nframes, void * const *frames)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (unsigned f = 0; f < nframes; ++f)
+	{
+		h ^= (uint64_t) frames[f];
+		h *= 1099511628211ULL;
+	}
+	return (unsigned) (h ^ (h >> 32)) & (NUM_BUCKETS-1);
+}
+
+bool DecisionCache::file_signature (const char *path, unsigned long long &size, long long &mtime)
+{
+	struct stat sb;
+	if (path == nullptr || stat (path, &sb) != 0)
+		return false;
+	size = sb.st_size;
+	mtime = sb.st_mtime;
+	return true;
+}
+
+unsigned DecisionCache::add_dmodule (const char *path, const uint8_t *build_id, unsigned build_id_len,
+	unsigned long long size, long long mtime)
+{
+	for (unsigned u = 0; u < _ndmodules; ++u)
+		if (strcmp (_dmodules[u].path, path) == 0 &&
+		    _dmodules[u].build_id_len == build_id_len &&
+		    memcmp (_dmodules[u].build_id, build_id, build_id_len) == 0 &&
+		    (build_id_len > 0 || (_dmodules[u].size == size && _dmodules[u].mtime == mtime)))
+			return u;
+
+	_dmodules = (dmodule_t*) _af.realloc (_dmodules, (_ndmodules+1)*sizeof(dmodule_t));
+	assert (_dmodules != nullptr);
+
+	dmodule_t *dm = &_dmodules[_ndmodules];
+	size_t len = strlen (path);
+	dm->path = (char*) _af.malloc (len+1);
+	assert (dm->path != nullptr);
+	memcpy (dm->path, path, len+1);
+	memcpy (dm->build_id, build_id, build_id_len);
+	dm->build_id_len = build_id_len;
+	dm->size = size;
+	dm->mtime = mtime;
+	dm->bound = nullptr;
+	return _ndmodules++;
+}
+
+// Looks for the loaded module corresponding to dm. If both have a build-id,
+// they must match, so decisions are not applied to a rebuilt binary. Modules
+// recorded without build-id must keep the size and modification time of
+// their file instead.
+bool DecisionCache::bind_dmodule (dmodule_t *dm)
+{
+	if (dm->bound != nullptr && !dm->bound->loaded)
+		dm->bound = nullptr;
+	if (dm->bound == nullptr)
+	{
+		const ModuleRegistry::module_t *m = _registry->find_by_path (dm->path);
+		bool changed = false;
+		if (m != nullptr && m->build_id_len > 0 && dm->build_id_len > 0)
+			changed = m->build_id_len != dm->build_id_len ||
+			  memcmp (m->build_id, dm->build_id, dm->build_id_len) != 0;
+		else if (m != nullptr)
+		{
+			unsigned long long size;
+			long long mtime;
+			changed = !file_signature (m->name, size, mtime) ||
+			  size != dm->size || mtime != dm->mtime;
+		}
+		if (changed)
+		{
+			VERBOSE_MSG(1, "Warning! Module %s has changed. Ignoring its decisions.\n", dm->path);
+			m = nullptr;
+		}
+		dm->bound = m;
+	}
+	return dm->bound != nullptr;
+}
+
+DecisionCache::entry_t * DecisionCache::find (unsigned nframes, void * const *frames) const
+{
+	for (entry_t *e = _buckets[hash (nframes, frames)]; e != nullptr; e = e->next)
+		if (e->nframes == nframes &&
+		    memcmp (e->frames, frames, nframes*sizeof(void*)) == 0)
+			return e;
+	return nullptr;
+}
+
+DecisionCache::entry_t * DecisionCache::new_entry (unsigned nframes)
+{
+	entry_t *e = (entry_t*) _af.malloc (sizeof(entry_t));
+	assert (e != nullptr);
+	e->nframes = nframes;
+	e->rel = (rel_frame_t*) _af.malloc (nframes*sizeof(rel_frame_t));
+	assert (e->rel != nullptr);
+	e->frames = (void**) _af.malloc (nframes*sizeof(void*));
+	assert (e->frames != nullptr);
+	e->active = false;
+	e->next = nullptr;
+
+	_entries = (entry_t**) _af.realloc (_entries, (_nentries+1)*sizeof(entry_t*));
+	assert (_entries != nullptr);
+	_entries[_nentries++] = e;
+	return e;
+}
+
+void DecisionCache::insert (entry_t *e)
+{
+	unsigned b = hash (e->nframes, e->frames);
+	e->next = _buckets[b];
+	_buckets[b] = e;
+}
+
+bool DecisionCache::lookup (unsigned nframes, void **frames, Allocator *&a, uint32_t &CL) const
+{
+	const entry_t *e = find (nframes, frames);
+	if (e == nullptr)
+		return false;
+
+	_nhits++;
+	if (e->has_location)
+	{
+		a = _cl->allocator (e->location);
+		CL = e->location;
+	}
+	else
+		a = nullptr;
+	return true;
+}
+
+// Records the decision taken for a callstack. Callstacks with frames outside
+// the known modules (e.g. generated code) cannot be made module-relative and
+// are not recorded.
+void DecisionCache::record (unsigned nframes, void **frames, Allocator *a, uint32_t CL)
+{
+	if (nframes == 0 || find (nframes, frames) != nullptr)
+		return;
+
+	const ModuleRegistry::module_t *modules[nframes];
+	for (unsigned f = 0; f < nframes; ++f)
+	{
+		modules[f] = _registry->find_by_address ((uintptr_t) frames[f]);
+		if (modules[f] == nullptr)
+			return;
+	}
+
+	entry_t *e = new_entry (nframes);
+	for (unsigned f = 0; f < nframes; ++f)
+	{
+		unsigned long long size = 0;
+		long long mtime = 0;
+		if (modules[f]->build_id_len == 0)
+			file_signature (modules[f]->name, size, mtime);
+		e->rel[f].module = add_dmodule (modules[f]->name, modules[f]->build_id, modules[f]->build_id_len,
+		  size, mtime);
+		_dmodules[e->rel[f].module].bound = modules[f];
+		e->rel[f].offset = (uintptr_t) frames[f] - modules[f]->base;
+		e->frames[f] = frames[f];
+	}
+	e->location = CL;
+	e->has_location = a != nullptr;
+	e->active = true;
+	insert (e);
+}
+
+// Recomputes the relocated frames after the loaded modules have changed.
+// Decisions involving modules not loaded are kept, but not matched.
+void DecisionCache::relocate (void)
+{
+	for (unsigned u = 0; u < _ndmodules; ++u)
+		bind_dmodule (&_dmodules[u]);
+
+	memset (_buckets, 0, sizeof(_buckets));
+	for (unsigned u = 0; u < _nentries; ++u)
+	{
+		entry_t *e = _entries[u];
+		e->active = true;
+		for (unsigned f = 0; f < e->nframes && e->active; ++f)
+		{
+			const dmodule_t *dm = &_dmodules[e->rel[f].module];
+			if (dm->bound != nullptr)
+				e->frames[f] = (void*) (dm->bound->base + e->rel[f].offset);
+			else
+				e->active = false;
+		}
+		if (e->active)
+			insert (e);
+	}
+}
+
+// The decisions are only valid for the locations file they were taken with
+bool DecisionCache::locations_signature (unsigned long long &size, long long &mtime) const
+{
+	return file_signature (getenv (TOOL_LOCATIONS_FILE), size, mtime);
+}
+
+// File format (text):
+//   locations <size> <mtime>
+//   module <index> <build-id or -> <size> <mtime> <path>
+//     (size and mtime of the file are 0 for modules with build-id)
+//   decision <location id or 0> <nframes> <module>!<offset> ...
+bool DecisionCache::load (const char *file)
+{
+	FILE *fd = fopen (file, "r");
+	if (fd == nullptr)
+	{
+		VERBOSE_MSG(0, "Decisions file %s does not exist yet. It will be created at exit.\n", file);
+		return false;
+	}
+
+	unsigned long long size, fsize;
+	long long mtime, fmtime;
+	if (!locations_signature (size, mtime))
+	{
+		fclose (fd);
+		return false;
+	}
+
+	char line[LINE_SIZE];
+	bool valid = false;
+	unsigned nignored = 0;
+	unsigned *index = nullptr; // module indexes in the file -> _dmodules
+	unsigned nindex = 0;
+	unsigned nmodules = 0;     // module lines read
+	while (fgets (line, sizeof(line), fd) != nullptr)
+	{
+		if (line[0] == '#')
+			continue;
+
+		if (strncmp (line, "locations ", 10) == 0)
+		{
+			valid = sscanf (line+10, "%llu %lld", &fsize, &fmtime) == 2 &&
+			  fsize == size && fmtime == mtime;
+			if (!valid)
+			{
+				VERBOSE_MSG(0, "Warning! Decisions file %s was generated for another locations file. Ignoring it.\n", file);
+				break;
+			}
+		}
+		else if (valid && strncmp (line, "module ", 7) == 0)
+		{
+			unsigned idx;
+			char build_id_str[2*ModuleRegistry::MAX_BUILD_ID_SZ+1];
+			unsigned long long msize;
+			long long mmtime;
+			int pos = 0;
+			if (sscanf (line+7, "%u %128s %llu %lld %n", &idx, build_id_str, &msize, &mmtime, &pos) < 4 || pos == 0)
+				continue;
+			// Modules are saved with consecutive indexes, so larger ones
+			// come from a damaged file
+			if (idx > nmodules++)
+			{
+				VERBOSE_MSG(0, "Warning! Invalid module index %u in decisions file %s. Ignoring it.\n", idx, file);
+				continue;
+			}
+			char *path = line+7+pos;
+			path[strcspn (path, "\n")] = '\0';
+
+			uint8_t build_id[ModuleRegistry::MAX_BUILD_ID_SZ];
+			unsigned build_id_len = 0;
+			if (strcmp (build_id_str, "-") != 0 &&
+			    !ModuleRegistry::build_id_from_string (build_id_str, build_id, build_id_len))
+				continue;
+
+			if (idx >= nindex)
+			{
+				unsigned *grown = (unsigned*) _af.realloc (index, (idx+1)*sizeof(unsigned));
+				if (grown == nullptr)
+				{
+					VERBOSE_MSG(0, "Warning! Not enough memory to load decisions file %s.\n", file);
+					break;
+				}
+				index = grown;
+				for (unsigned u = nindex; u <= idx; ++u)
+					index[u] = UINT_MAX;
+				nindex = idx+1;
+			}
+			index[idx] = add_dmodule (path, build_id, build_id_len, msize, mmtime);
+		}
+		else if (valid && strncmp (line, "decision ", 9) == 0)
+		{
+			unsigned id, nframes;
+			int pos = 0;
+			if (sscanf (line+9, "%u %u %n", &id, &nframes, &pos) < 2 || pos == 0 || nframes == 0)
+				continue;
+
+			// Callstacks are never unwound deeper than the longest location,
+			// so deeper ones cannot come from a run with these locations
+			if (nframes > _cl->max_nframes())
+			{
+				nignored++;
+				continue;
+			}
+
+			uint32_t CL = 0;
+			if (id > 0 && !_cl->location_index (id, CL))
+			{
+				nignored++;
+				continue;
+			}
+
+			rel_frame_t rel[nframes];
+			char *p = line+9+pos;
+			bool ok = true;
+			for (unsigned f = 0; f < nframes && ok; ++f)
+			{
+				char *endptr;
+				unsigned idx = strtoul (p, &endptr, 10);
+				ok = *endptr == '!' && idx < nindex && index[idx] != UINT_MAX;
+				if (ok)
+				{
+					rel[f].module = index[idx];
+					rel[f].offset = strtoul (endptr+1, &p, 16);
+				}
+			}
+			if (!ok)
+			{
+				nignored++;
+				continue;
+			}
+
+			entry_t *e = new_entry (nframes);
+			memcpy (e->rel, rel, nframes*sizeof(rel_frame_t));
+			e->location = CL;
+			e->has_location = id > 0;
+			_npreloaded++;
+		}
+	}
+	fclose (fd);
+	if (index != nullptr)
+		_af.free (index);
+
+	// Bind the preloaded decisions to the modules loaded
+	relocate ();
+
+	VERBOSE_MSG(0, "Preloaded %u decisions from %s (%u ignored).\n", _npreloaded, file, nignored);
+	return valid;
+}
+
+bool DecisionCache::save (const char *file) const
+{
+	unsigned long long size;
+	long long mtime;
+	if (!locations_signature (size, mtime))
+		return false;
+
+	FILE *fd = fopen (file, "w");
+	if (fd == nullptr)
+	{
+		VERBOSE_MSG(0, "Warning! Could not write decisions file %s\n", file);
+		return false;
+	}
+
+	fprintf (fd, "# FlexMalloc decisions for locations file %s\n", getenv (TOOL_LOCATIONS_FILE));
+	fprintf (fd, "locations %llu %lld\n", size, mtime);
+	for (unsigned u = 0; u < _ndmodules; ++u)
+	{
+		char build_id[2*ModuleRegistry::MAX_BUILD_ID_SZ+1] = "-";
+		for (unsigned b = 0; b < _dmodules[u].build_id_len; ++b)
+			snprintf (&build_id[2*b], 3, "%02x", _dmodules[u].build_id[b]);
+		fprintf (fd, "module %u %s %llu %lld %s\n", u, build_id, _dmodules[u].size,
+		  _dmodules[u].mtime, _dmodules[u].path);
+	}
+	for (unsigned u = 0; u < _nentries; ++u)
+	{
+		const entry_t *e = _entries[u];
+		fprintf (fd, "decision %u %u", e->has_location ? _cl->location_id (e->location) : 0, e->nframes);
+		for (unsigned f = 0; f < e->nframes; ++f)
+			fprintf (fd, " %u!%lx", e->rel[f].module, e->rel[f].offset);
+		fprintf (fd, "\n");
+	}
+	fclose (fd);
+
+	VERBOSE_MSG(0, "Saved %u decisions into %s.\n", _nentries, file);
+	return true;
+}
+
+void DecisionCache::show_statistics (void) const
+{
+	VERBOSE_MSG(1, "Decisions: %u known (%u preloaded), %llu hits.\n",
+	  _nentries, _npreloaded, _nhits);
+}
@@ -0,0 +1,82 @@
+// License: To determine
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "common.hxx"
+#include "allocator.hxx"
+#include "code-locations.hxx"
+#include "module-registry.hxx"
+
+// Decisions taken for (source-mode) callstacks, i.e. the location each raw
+// callstack resolved to (or none). The callstacks are kept as module-relative
+// frames so that the decisions can be written at exit and preloaded on the
+// next run of the same binaries with the same locations file.
+class DecisionCache
+{
+	private:
+	static const unsigned NUM_BUCKETS = 4096; // needs to be power of 2
+
+	typedef struct dmodule_st
+	{
+		char *path;
+		uint8_t build_id[ModuleRegistry::MAX_BUILD_ID_SZ];
+		unsigned build_id_len;
+		unsigned long long size; // of the file, for modules without build-id
+		long long mtime;
+		const ModuleRegistry::module_t *bound;
+	} dmodule_t;
+
+	typedef struct rel_frame_st
+	{
+		unsigned module;   // index in _dmodules
+		uintptr_t offset;  // offset from the load base of the module
+	} rel_frame_t;
+
+	typedef struct entry_st
+	{
+		unsigned nframes;
+		rel_frame_t *rel;
+		void **frames;     // relocated frames, valid if active
+		uint32_t location; // index within the code locations
+		bool has_location;
+		bool active;
+		struct entry_st *next; // next in bucket
+	} entry_t;
+
+	const allocation_functions_t _af;
+	ModuleRegistry * const _registry;
+	const CodeLocations * const _cl;
+
+	dmodule_t *_dmodules;
+	unsigned _ndmodules;
+	entry_t **_entries;
+	unsigned _nentries;
+	entry_t *_buckets[NUM_BUCKETS];
+
+	unsigned _npreloaded;
+	mutable unsigned long long _nhits;
+
+	static unsigned hash (unsigned nframes, void * const *frames);
+	static bool file_signature (const char *path, unsigned long long &size, long long &mtime);
+	unsigned add_dmodule (const char *path, const uint8_t *build_id, unsigned build_id_len,
+	  unsigned long long size, long long mtime);
+	bool bind_dmodule (dmodule_t *dm);
+	entry_t * find (unsigned nframes, void * const *frames) const;
+	entry_t * new_entry (unsigned nframes);
+	void insert (entry_t *e);
+	bool locations_signature (unsigned long long &size, long long &mtime) const;
+
+	public:
+	DecisionCache (allocation_functions_t &, ModuleRegistry *, const CodeLocations *);
+	~DecisionCache ();
+
+	bool lookup (unsigned nframes, void **frames, Allocator *&a, uint32_t &CL) const;
+	void record (unsigned nframes, void **frames, Allocator *a, uint32_t CL);
+	void relocate (void);
+	bool load (const char *file);
+	bool save (const char *file) const;
+	void show_statistics (void) const;
+};
@@ -0,0 +1,76 @@
+// License: To determine
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <elf.h>
+
+#include "elf-symbols.hxx"
+
+uintptr_t elf_lookup_dynamic_symbol (const ElfW(Dyn) *dynamic, uintptr_t base,
+	const char *name)
+{
+	const ElfW(Sym) *symtab = nullptr;
+	const char *strtab = nullptr;
+	const uint32_t *gnu_hash = nullptr;
+	const ElfW(Word) *hash = nullptr;
+
+	if (dynamic == nullptr || name == nullptr)
+		return 0;
+
+	// The dynamic loader usually relocates these entries in place, but not
+	// on every architecture
+	#define DYN_PTR(d) ((d)->d_un.d_ptr < base ? base + (d)->d_un.d_ptr : (d)->d_un.d_ptr)
+	for (const ElfW(Dyn) *d = dynamic; d->d_tag != DT_NULL; ++d)
+	{
+		if (d->d_tag == DT_SYMTAB)
+			symtab = (const ElfW(Sym)*) DYN_PTR(d);
+		else if (d->d_tag == DT_STRTAB)
+			strtab = (const char*) DYN_PTR(d);
+		else if (d->d_tag == DT_GNU_HASH)
+			gnu_hash = (const uint32_t*) DYN_PTR(d);
+		else if (d->d_tag == DT_HASH)
+			hash = (const ElfW(Word)*) DYN_PTR(d);
+	}
+	#undef DYN_PTR
+
+	if (symtab == nullptr || strtab == nullptr)
+		return 0;
+
+	if (gnu_hash != nullptr)
+	{
+		uint32_t h = 5381;
+		for (const unsigned char *c = (const unsigned char*) name; *c != '\0'; ++c)
+			h = h * 33 + *c;
+
+		const uint32_t nbuckets = gnu_hash[0];
+		const uint32_t symoffset = gnu_hash[1];
+		const uint32_t bloom_size = gnu_hash[2];
+		const uint32_t *buckets = &gnu_hash[4 + bloom_size * (sizeof(ElfW(Addr)) / 4)];
+		const uint32_t *chain = &buckets[nbuckets];
+
+		if (nbuckets == 0)
+			return 0;
+
+		for (uint32_t i = buckets[h % nbuckets]; i >= symoffset && i != 0; ++i)
+		{
+			const uint32_t ch = chain[i - symoffset];
+			if ((ch | 1) == (h | 1) && symtab[i].st_shndx != SHN_UNDEF &&
+			    strcmp (name, strtab + symtab[i].st_name) == 0)
+				return base + symtab[i].st_value;
+			if (ch & 1)
+				break;
+		}
+	}
+	else if (hash != nullptr)
+	{
+		const ElfW(Word) nchain = hash[1];
+		for (ElfW(Word) i = 0; i < nchain; ++i)
+			if (symtab[i].st_shndx != SHN_UNDEF &&
+			    strcmp (name, strtab + symtab[i].st_name) == 0)
+				return base + symtab[i].st_value;
+	}
+	return 0;
+}
@@ -0,0 +1,14 @@
+// License: To determine
+
+#pragma once
+
+#include <stdint.h>
+#include <link.h>
+
+// Looks up a defined symbol in the dynamic symbol table of a loaded module,
+// given its dynamic section and its load bias. Returns the relocated address
+// of the symbol, or 0 if the symbol is not exported by the module.
+// This is a self-contained lookup (neither dlsym() nor malloc() are used), so
+// it can be called from the rtld-audit library and from within the allocator.
+uintptr_t elf_lookup_dynamic_symbol (const ElfW(Dyn) *dynamic, uintptr_t base,
+	const char *name);
@@ -10,22 +10,67 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <new>
 
 #include "common.hxx"
-#include "utils.hxx"
 #include "flex-malloc.hxx"
 #include "allocator.hxx"
+#include "metadata-table.hxx"
+#include "bootstrap-arena.hxx"
 
 static AllocatorStatistics _uninitialized_stats;
 
+// Real allocation functions for the objects allocated before FlexMalloc is
+// initialized that do not fit in the bootstrap arena, resolved once. The
+// allocations of dlsym itself are served by the bootstrap arena.
+static allocation_functions_t _uninitialized_af;
+static volatile bool _uninitialized_resolving = false;
+
+static bool uninitialized_resolve (void)
+{
+	if (_uninitialized_af.free != nullptr)
+		return true;
+	if (_uninitialized_resolving)
+		return false;
+
+	_uninitialized_resolving = true;
+	_uninitialized_af.malloc = (void* (*)(size_t)) dlsym (RTLD_NEXT, "malloc");
+	_uninitialized_af.calloc = (void* (*)(size_t,size_t)) dlsym (RTLD_NEXT, "calloc");
+	_uninitialized_af.realloc = (void* (*)(void*,size_t)) dlsym (RTLD_NEXT, "realloc");
+	if (_uninitialized_af.malloc != nullptr && _uninitialized_af.calloc != nullptr &&
+	    _uninitialized_af.realloc != nullptr)
+		_uninitialized_af.free = (void (*)(void*)) dlsym (RTLD_NEXT, "free");
+	_uninitialized_resolving = false;
+
+	return _uninitialized_af.free != nullptr;
+}
+
+// Set on the symbolizer thread, whose own allocations are never queued
+static __thread bool in_symbolizer_thread = false;
+
+FlexMalloc * FlexMalloc::_sym_instance = nullptr;
+
 FlexMalloc::FlexMalloc (allocation_functions_t &af, Allocator * f, CodeLocations *cl)
-  : _af(af), _fallback(f), _allocators (cl->allocators()), _modules(nullptr),
-    _nmodules(0), _cl(cl)
+  : _af(af), _fallback(f), _allocators (cl->allocators()), _prefaulter(nullptr), _decisions(nullptr),
+    _decisions_file(nullptr), _modules(nullptr),
+    _nmodules(0), _nregistry_seen(0), _cl(cl), _registry(cl->modules()),
+    _interposer_mtx(nullptr), _sym_active(false), _sym_ndone(0), _sym_generation(0),
+    _sym_modules_dirty(false), _sym_nprovisional(0), _sym_nqueued(0),
+    _sym_nresolved(0), _sym_ndiscarded(0), _thp_naligned(0), _thp_nadvised(0)
 {
 	assert (_fallback != nullptr);
 
+	_split = (AllocatorSplit*) _af.malloc (sizeof(AllocatorSplit));
+	assert (_split != nullptr);
+	new (_split) AllocatorSplit (af, _fallback);
+
+	_copier = (CopyEngine*) _af.malloc (sizeof(CopyEngine));
+	assert (_copier != nullptr);
+	new (_copier) CopyEngine (options.copyThreads(), options.copyThreshold());
+
 	if (options.sourceFrames())
-		parse_map_files();
+		load_modules();
 }
 
 FlexMalloc::~FlexMalloc ()
@@ -34,17 +79,22 @@ FlexMalloc::~FlexMalloc ()
 
 // FlexMalloc::uninitialized_malloc
 //   performs a malloc when the FlexMalloc library has not been fully initialized or
-//   when specifically requesting memory from regular posix calls. This routine adds
+//   when specifically requesting memory from regular posix calls. Objects are taken
+//   from the bootstrap arena or, if exhausted, from the real malloc. This routine adds
 //   the necessary information to the created buffer (i.e. header)
 void * FlexMalloc::uninitialized_malloc (size_t size)
 {
-	void *res = nullptr;
-	void* (*tmp_malloc)(size_t) = (void* (*)(size_t)) dlsym (RTLD_NEXT, "malloc");
-	if (tmp_malloc == nullptr)
+	void *res = BootstrapArena::allocate (size);
+	if (res != nullptr)
+	{
+		_uninitialized_stats.record_malloc (size);
+		return res;
+	}
+	if (!uninitialized_resolve())
 		return nullptr;
 
 	DBG("(size = %lu)\n", size);
-	void * baseptr = tmp_malloc (Allocator::getTotalSize (size));
+	void * baseptr = _uninitialized_af.malloc (Allocator::getTotalSize (size));
 	if (baseptr != nullptr)
 	{
 		res = Allocator::generateAllocatorHeader (baseptr, nullptr, size);
@@ -55,26 +105,47 @@ void * FlexMalloc::uninitialized_malloc (size_t size)
 	return res;
 }
 
+// FlexMalloc::uninitialized_calloc
+//   as uninitialized_malloc, for zeroed memory
+void * FlexMalloc::uninitialized_calloc (size_t nmemb, size_t size)
+{
+	void *res = BootstrapArena::allocate (nmemb * size);
+	if (res != nullptr)
+	{
+		_uninitialized_stats.record_calloc (nmemb * size);
+		return res;
+	}
+	if (!uninitialized_resolve())
+		return nullptr;
+
+	DBG("(nmemb = %lu, size = %lu)\n", nmemb, size);
+	void * baseptr = _uninitialized_af.calloc (1, Allocator::getTotalSize (nmemb * size));
+	if (baseptr != nullptr)
+	{
+		res = Allocator::generateAllocatorHeader (baseptr, nullptr, nmemb * size);
+		DBG("returning %p\n", res);
+		if (res != nullptr)
+			_uninitialized_stats.record_calloc (nmemb * size);
+	}
+	return res;
+}
+
 // FlexMalloc::uninitialized_posix_memalign
 //   performs a posix_memalign when the FlexMalloc library has not been fully initialized
 //   or when specifically requesting memory from regular posix calls. This routine adds
 //   the necessary information to the created buffer (i.e. header)
-//    - invokes uninitialized_malloc
 int FlexMalloc::uninitialized_posix_memalign (void **ptr, size_t align, size_t size)
 {
-	void *res = nullptr;
-	void* (*tmp_malloc)(size_t) = (void* (*)(size_t)) dlsym (RTLD_NEXT, "malloc");
-	if (tmp_malloc == nullptr)
-		return ENOMEM;
-
-	DBG("(ptr = %p, align = %lu, size = %lu)\n", ptr, align, size);
-	void * baseptr = tmp_malloc (Allocator::getTotalSize(size + align));
-	if (baseptr != nullptr)
+	void *res = BootstrapArena::allocate (size, align);
+	if (res == nullptr && uninitialized_resolve())
 	{
-		res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, nullptr, size);
+		DBG("(ptr = %p, align = %lu, size = %lu)\n", ptr, align, size);
+		void * baseptr = _uninitialized_af.malloc (Allocator::getTotalSize(size + align));
+		if (baseptr != nullptr)
+			res = Allocator::generateAllocatorHeaderOnAligned (baseptr, align, nullptr, size);
 	}
 	DBG("returning ptr %p\n", res);
-	if (ptr != nullptr)
+	if (ptr != nullptr && res != nullptr)
 	{
 		*ptr = res;
 		_uninitialized_stats.record_aligned_malloc (size);
@@ -92,17 +163,32 @@ void * FlexMalloc::uninitialized_realloc (void *ptr, size_t size)
 {
 	void *res = nullptr;
 
+	// Objects of the bootstrap arena grow in place if they are the last one,
+	// otherwise they are moved
+	if (BootstrapArena::contains (ptr))
+	{
+		size_t prev_size = BootstrapArena::size (ptr);
+		res = BootstrapArena::grow (ptr, size);
+		if (res == nullptr && (res = uninitialized_malloc (size)) != nullptr)
+		{
+			memcpy (res, ptr, MIN(prev_size, size));
+			uninitialized_free (ptr);
+		}
+		else if (res != nullptr)
+			_uninitialized_stats.record_realloc (prev_size, size);
+		DBG("returning ptr %p\n", res);
+	}
 	// If given an allocated pointer, then we handle it normally as a realloc
-	if (ptr)
+	else if (ptr)
 	{
 		void *new_baseptr = nullptr;
 
 		// Given this pointer - we check whether the pointer was allocated by any allocator from
 		//   flexmalloc or by "default" calls (in _af structure).
 		Allocator::Header_t *prev_hdr = Allocator::getAllocatorHeader (ptr);
-		Allocator *prev_allocator = prev_hdr->allocator;
-		size_t prev_size  = prev_hdr->size;
-		void * prev_base  = prev_hdr->base_ptr;
+		Allocator *prev_allocator = prev_hdr->allocator();
+		size_t prev_size  = prev_hdr->size();
+		void * prev_base  = prev_hdr->base_ptr();
 		uintptr_t extra_size = Allocator::getExtraSize (prev_hdr);
 
 		DBG("with prev_allocator = %p and prev_size = %lu\n", prev_allocator, prev_size);
@@ -113,13 +199,16 @@ void * FlexMalloc::uninitialized_realloc (void *ptr, size_t size)
 			// Unhandled allocator
 			if (prev_allocator == nullptr)
 			{
-				void* (*tmp_realloc)(void*, size_t) = (void* (*)(void*,size_t)) dlsym (RTLD_NEXT, "realloc");
-				if (tmp_realloc == nullptr)
+				if (!uninitialized_resolve())
 					return nullptr;
 
-				new_baseptr = tmp_realloc (prev_base, Allocator::getTotalSize (size + extra_size));
+				new_baseptr = _uninitialized_af.realloc (prev_base, Allocator::getTotalSize (size + extra_size));
+				if (new_baseptr == nullptr)
+					return nullptr;
 
 				res = Allocator::generateAllocatorHeader (new_baseptr, extra_size, nullptr, size);
+				if (res != ptr)
+					Allocator::releaseAllocatorHeader (ptr);
 
 				DBG("Reallocated (%ld->%ld [extra bytes = %lu]) from %p (base at %p, header at %p) into %p (base at %p, header at %p)\n", prev_size, size, extra_size, ptr, prev_base, prev_hdr, res, new_baseptr, Allocator::getAllocatorHeader (res));
 
@@ -149,19 +238,29 @@ void * FlexMalloc::uninitialized_realloc (void *ptr, size_t size)
 
 void FlexMalloc::uninitialized_free (void *ptr)
 {
-	void (*tmp_free)(void*) = (void (*)(void*)) dlsym (RTLD_NEXT, "free");
-	if (tmp_free == nullptr)
+	if (BootstrapArena::contains (ptr))
+	{
+		_uninitialized_stats.record_free (BootstrapArena::size (ptr));
+		BootstrapArena::release (ptr);
+		return;
+	}
+	if (!uninitialized_resolve())
 		return;
 
 	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
-	_uninitialized_stats.record_free (hdr->size);
-	tmp_free (hdr->base_ptr);
+	_uninitialized_stats.record_free (hdr->size());
+	void *base = hdr->base_ptr();
+	Allocator::releaseAllocatorHeader (ptr);
+	_uninitialized_af.free (base);
 }
 
 size_t FlexMalloc::uninitialized_malloc_usable_size (void *ptr)
 {
+	if (BootstrapArena::contains (ptr))
+		return BootstrapArena::size (ptr);
+
 	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
-	return hdr->size;
+	return hdr->size();
 }
 
 static const char * __flexmalloc_excluded_libraries [] = {
@@ -195,85 +294,328 @@ bool FlexMalloc::excluded_library (const char *library)
 }
 
 
-void FlexMalloc::parse_map_files (void)
+// FlexMalloc::load_modules
+//   loads the symbols of the modules that have been registered in the module
+//   registry since the last invocation (all of them in the first call). Only
+//   modules with executable segments and not excluded are considered.
+void FlexMalloc::load_modules (void)
 {
-	FILE * mapsfile = fopen ("/proc/self/maps", "r");
+	unsigned prev_nmodules = _nmodules;
 
-	if (mapsfile == nullptr)
+	for (; _nregistry_seen < _registry->count(); _nregistry_seen++)
 	{
-		VERBOSE_MSG (1, "Warning! Could not open /proc/self/maps\n");
-		return;
+		const ModuleRegistry::module_t *m = _registry->get (_nregistry_seen);
+
+		bool has_exec = false;
+		for (unsigned s = 0; s < m->nsegments && !has_exec; ++s)
+			has_exec = m->segments[s].exec;
+		if (!has_exec)
+			continue;
+
+		if (excluded_library (m->name))
+		{
+			VERBOSE_MSG(2, "Excluding the analysis of %s\n", m->name);
+			continue;
+		}
+
+		DBG("Processing module %s (base 0x%08lx) and tentatively inserting into index %u\n",
+		  m->name, m->base, _nmodules);
+
+		_modules = (module_t*) _af.realloc (_modules, (_nmodules+1)*sizeof(module_t));
+		assert (_modules != nullptr);
+
+		_modules[_nmodules].module = m;
+		_modules[_nmodules].bfd = new BFDManager;
+		_modules[_nmodules].symbolsLoaded =
+		  _modules[_nmodules].bfd->load_binary (m->name);
+
+		// If BFD failed to load the binary/symbols then ignore this
+		// recently created entry
+		if (_modules[_nmodules].symbolsLoaded)
+		{
+			VERBOSE_MSG(1, "Successfully loaded symbols from %s into index %u\n",
+			  m->name, _nmodules);
+			_nmodules++;
+		}
+		else
+		{
+			VERBOSE_MSG(2, "Could not load symbols from %s\n", m->name);
+		}
 	}
 
-	VERBOSE_MSG(1, "Opened /proc/self/maps to learn about application symbols\n");
+	VERBOSE_MSG(1, "Loaded symbols from %u libraries\n", _nmodules - prev_nmodules);
+}
+
+// FlexMalloc::update_modules
+//   reacts to changes in the module registry. Modules that have been unloaded
+//   stop being used for translation, and their callstacks are dropped from the
+//   cache as their addresses may be reused by other modules. Then, symbols
+//   of the newly registered modules are loaded.
+void FlexMalloc::update_modules (void)
+{
+	if (_decisions != nullptr)
+		_decisions->relocate();
+
+	if (_sym_active)
+	{
+		// BFD and the modules belong to the symbolizer thread. Let it update
+		// them and discard the decisions it is taking with the old modules.
+		_c_cache.clear();
+		__sync_fetch_and_add (&_sym_generation, 1);
+		_sym_modules_dirty = true;
+		return;
+	}
 
-	#define LINE_SIZE 2048
-	char line[LINE_SIZE+1];
-	unsigned line_no = 0;
+	retire_modules();
+	load_modules();
+}
 
-	while (!feof (mapsfile))
-		if (fgets (line, LINE_SIZE, mapsfile) != nullptr)
+// FlexMalloc::retire_modules
+//   stops using the modules that have been unloaded for translation, and drops
+//   the cached callstacks as their addresses may be reused by other modules.
+void FlexMalloc::retire_modules (void)
+{
+	bool retired = false;
+	for (unsigned m = 0; m < _nmodules; ++m)
+		if (_modules[m].symbolsLoaded && !_modules[m].module->loaded)
 		{
-			unsigned long start, end, offset;
-			char module[LINE_SIZE+1];
-			char permissions[5];
+			VERBOSE_MSG(1, "Module %s has been unloaded\n", _modules[m].module->name);
+			_modules[m].symbolsLoaded = false;
+			retired = true;
+		}
+	if (retired)
+		_c_cache.clear();
+}
 
-			line_no++;
+// FlexMalloc::load_decisions
+//   preloads the decisions taken in previous runs (if any) from the given
+//   file, where they will be saved at exit.
+void FlexMalloc::load_decisions (const char *file)
+{
+	if (!options.sourceFrames())
+	{
+		VERBOSE_MSG(0, "Decisions file is only used with source-code locations. Ignoring it.\n");
+		return;
+	}
 
-			memset (module, 0, (LINE_SIZE+1)*sizeof(char));
-			bool entry_parsed = parse_proc_self_maps_entry (line, &start, &end,
-			  sizeof(permissions), permissions, &offset, LINE_SIZE, module);
+	_decisions = (DecisionCache*) _af.malloc (sizeof(DecisionCache));
+	assert (_decisions != nullptr);
+	new (_decisions) DecisionCache (const_cast<allocation_functions_t&>(_af), _registry, _cl);
+	_decisions_file = file;
+	_decisions->load (file);
+}
 
-			if (entry_parsed)
-			{
-				// Check for execution bits, ignore the rest
-				if (permissions[2] == 'x')
-				{
-					if (!excluded_library (module))
-					{
-						// avoid [vdso], [syscall] and others
-						if (module[0] != '[')
-						{
-							DBG("Processing line %u, %s [0x%08lx-0x%08lx] and tentatively inserting into index %u\n",
-							  line_no, module, start, end, _nmodules);
-
-							_modules = (module_t*) _af.realloc (_modules, (_nmodules+1)*sizeof(module_t));
-							assert (_modules != nullptr);
-
-							_modules[_nmodules].name = strdup (module);
-							assert (_modules[_nmodules].name != nullptr);
-							_modules[_nmodules].startAddress = start;
-							_modules[_nmodules].endAddress = end;
-							_modules[_nmodules].bfd = new BFDManager;
-							_modules[_nmodules].symbolsLoaded =
-							  _modules[_nmodules].bfd->load_binary (_modules[_nmodules].name);
-
-							// If BFD failed to load the binary/symbols then ignore this
-							// recently created entry
-							if (_modules[_nmodules].symbolsLoaded)
-							{
-								VERBOSE_MSG(1, "Successfully loaded symbols from %s into index %u\n",
-								  _modules[_nmodules].name, _nmodules);
-								_nmodules++;
-							}
-							else
-							{
-								VERBOSE_MSG(2, "Could not load symbols from %s\n",
-								  _modules[_nmodules].name);
-							}
-						}
-					}
-					else
-					{
-						VERBOSE_MSG(2, "Excluding the analysis of %s\n", module);
-					}
-				}
-			}
+void FlexMalloc::save_decisions (void)
+{
+	if (_decisions != nullptr)
+		_decisions->save (_decisions_file);
+}
+
+// FlexMalloc::start_symbolizer
+//   enables the asynchronous symbolization. The interposer lock is needed by
+//   the symbolizer thread to access the module registry.
+void FlexMalloc::start_symbolizer (pthread_mutex_t *interposer_mtx)
+{
+	if (!options.sourceFrames())
+		return;
+
+	_interposer_mtx = interposer_mtx;
+	for (unsigned u = 0; u < SYMBOLIZER_SLOTS; ++u)
+		_sym_slots[u].state = SLOT_FREE;
+	pthread_mutex_init (&_sym_mtx, nullptr);
+	pthread_cond_init (&_sym_cond, nullptr);
+	pthread_cond_init (&_sym_idle, nullptr);
+
+	if (pthread_create (&_sym_thread, nullptr, symbolizer_thread, this) != 0)
+	{
+		VERBOSE_MSG(0, "Warning! Could not create the symbolizer thread. Symbolizing synchronously.\n");
+		return;
+	}
+	_sym_active = true;
+	_sym_instance = this;
+	pthread_atfork (symbolizer_atfork_prepare, symbolizer_atfork_parent,
+	  symbolizer_atfork_child);
+	VERBOSE_MSG(0, "Callstacks will be symbolized asynchronously.\n");
+}
+
+// A fork waits for the symbolizer to finish the callstack it is translating,
+// if any, as it may hold the interposer lock meanwhile, and holds the slots
+// until the child is created
+void FlexMalloc::symbolizer_atfork_prepare (void)
+{
+	FlexMalloc *fm = _sym_instance;
+	pthread_mutex_lock (&fm->_sym_mtx);
+	for (unsigned u = 0; u < SYMBOLIZER_SLOTS; ++u)
+		while (fm->_sym_slots[u].state == SLOT_RUNNING)
+			pthread_cond_wait (&fm->_sym_idle, &fm->_sym_mtx);
+}
+
+void FlexMalloc::symbolizer_atfork_parent (void)
+{
+	pthread_mutex_unlock (&_sym_instance->_sym_mtx);
+}
+
+// The child has no symbolizer thread, so it symbolizes its callstacks by
+// itself. The queued and resolved callstacks are dropped; they are queued
+// again on their next allocation.
+void FlexMalloc::symbolizer_atfork_child (void)
+{
+	FlexMalloc *fm = _sym_instance;
+	pthread_mutex_init (&fm->_sym_mtx, nullptr);
+	pthread_cond_init (&fm->_sym_cond, nullptr);
+	pthread_cond_init (&fm->_sym_idle, nullptr);
+	for (unsigned u = 0; u < SYMBOLIZER_SLOTS; ++u)
+		fm->_sym_slots[u].state = SLOT_FREE;
+	fm->_sym_ndone = 0;
+	fm->_sym_active = false;
+}
+
+// FlexMalloc::start_prefaulter
+//   creates the threads that pre-fault the large objects
+void FlexMalloc::start_prefaulter (void)
+{
+	Prefaulter *p = (Prefaulter*) _af.malloc (sizeof(Prefaulter));
+	assert (p != nullptr);
+	new (p) Prefaulter (options.prefault());
+	if (p->start (options.prefaultThreads()))
+		_prefaulter = p;
+	else
+	{
+		p->~Prefaulter();
+		_af.free (p);
+	}
+}
+
+// FlexMalloc::start_copier
+//   creates the threads that copy the large objects moved across tiers, at
+//   start-up rather than within a realloc that holds the interposer lock
+void FlexMalloc::start_copier (void)
+{
+	_copier->start();
+}
+
+void * FlexMalloc::symbolizer_thread (void *p)
+{
+	in_symbolizer_thread = true;
+	((FlexMalloc*) p)->symbolizer_loop();
+	return nullptr;
+}
+
+void FlexMalloc::symbolizer_loop (void)
+{
+	while (true)
+	{
+		// Wait for a queued callstack
+		symbolizer_slot_t *slot = nullptr;
+		pthread_mutex_lock (&_sym_mtx);
+		while (slot == nullptr)
+		{
+			for (unsigned u = 0; u < SYMBOLIZER_SLOTS && slot == nullptr; ++u)
+				if (_sym_slots[u].state == SLOT_QUEUED)
+					slot = &_sym_slots[u];
+			if (slot == nullptr)
+				pthread_cond_wait (&_sym_cond, &_sym_mtx);
 		}
+		slot->state = SLOT_RUNNING;
+		pthread_mutex_unlock (&_sym_mtx);
 
-	VERBOSE_MSG(1, "Loaded symbols from %u libraries\n", _nmodules);
+		// Modules are only changed by this thread, under the interposer lock
+		// as the registry is updated by the allocating threads
+		unsigned generation = _sym_generation;
+		if (_sym_modules_dirty)
+		{
+			pthread_mutex_lock (_interposer_mtx);
+			_sym_modules_dirty = false;
+			generation = _sym_generation;
+			retire_modules();
+			load_modules();
+			pthread_mutex_unlock (_interposer_mtx);
+		}
 
-	fclose (mapsfile);
+		bool translated;
+		uint32_t CL = 0;
+		Allocator *a = translate_callstack (slot->nframes, slot->frames, CL, translated);
+
+		pthread_mutex_lock (&_sym_mtx);
+		slot->allocator = a;
+		slot->CL = CL;
+		slot->translated = translated;
+		slot->generation = generation;
+		slot->state = SLOT_DONE;
+		_sym_ndone++;
+		pthread_cond_broadcast (&_sym_idle);
+		pthread_mutex_unlock (&_sym_mtx);
+	}
+}
+
+// FlexMalloc::symbolizer_enqueue
+//   queues the callstack to the symbolizer thread, unless it is already
+//   queued or it cannot be cached. Returns whether it has been queued.
+bool FlexMalloc::symbolizer_enqueue (unsigned nptrs, void **callstack)
+{
+	if (in_symbolizer_thread || nptrs > CALLSTACKS_PER_ENTRY)
+		return false;
+
+	bool queued = false;
+	pthread_mutex_lock (&_sym_mtx);
+	symbolizer_slot_t *free_slot = nullptr;
+	for (unsigned u = 0; u < SYMBOLIZER_SLOTS; ++u)
+	{
+		symbolizer_slot_t *slot = &_sym_slots[u];
+		if (slot->state == SLOT_FREE)
+		{
+			if (free_slot == nullptr)
+				free_slot = slot;
+		}
+		else if (slot->nframes == nptrs &&
+		  memcmp (slot->frames, callstack, nptrs*sizeof(void*)) == 0)
+		{
+			// Already being resolved
+			pthread_mutex_unlock (&_sym_mtx);
+			return false;
+		}
+	}
+	if (free_slot != nullptr)
+	{
+		memcpy (free_slot->frames, callstack, nptrs*sizeof(void*));
+		free_slot->nframes = nptrs;
+		free_slot->state = SLOT_QUEUED;
+		_sym_nqueued++;
+		queued = true;
+		pthread_cond_signal (&_sym_cond);
+	}
+	pthread_mutex_unlock (&_sym_mtx);
+	return queued;
+}
+
+// FlexMalloc::symbolizer_publish
+//   moves the decisions taken by the symbolizer into the callstacks cache.
+//   Decisions taken with modules that have changed since are discarded (the
+//   callstack will be queued again on its next allocation).
+void FlexMalloc::symbolizer_publish (void)
+{
+	pthread_mutex_lock (&_sym_mtx);
+	for (unsigned u = 0; u < SYMBOLIZER_SLOTS; ++u)
+	{
+		symbolizer_slot_t *slot = &_sym_slots[u];
+		if (slot->state != SLOT_DONE)
+			continue;
+		if (slot->generation == _sym_generation)
+		{
+			DBG("Symbolizer resolved callstack into a = %p CL = %u\n", slot->allocator, slot->CL);
+			_c_cache.add_match (slot->nframes, slot->frames, slot->allocator, slot->CL);
+			// Untranslated callstacks may resolve once their modules are
+			// known, so they are not kept for the next runs
+			if (_decisions != nullptr && slot->translated)
+				_decisions->record (slot->nframes, slot->frames, slot->allocator, slot->CL);
+			_sym_nresolved++;
+		}
+		else
+			_sym_ndiscarded++;
+		slot->state = SLOT_FREE;
+	}
+	_sym_ndone = 0;
+	pthread_mutex_unlock (&_sym_mtx);
 }
 
 inline Allocator * FlexMalloc::allocatorForCallstack (unsigned nptrs, void **callstack, size_t size, bool& fits, uint32_t& CL)
@@ -284,107 +626,156 @@ inline Allocator * FlexMalloc::allocatorForCallstack (unsigned nptrs, void **cal
 		return allocatorForCallstack_raw (nptrs, callstack, size, fits, CL);
 }
 
-Allocator * FlexMalloc::allocatorForCallstack_source (unsigned nptrs, void **callstack, size_t size, bool& fits, uint32_t& CL)
+// FlexMalloc::translate_callstack
+//   translates the frames of the callstack into source code references using
+//   BFD and looks for a location matching them. translated tells whether any
+//   frame could be translated.
+Allocator * FlexMalloc::translate_callstack (unsigned nptrs, void **callstack, uint32_t& CL, bool &translated)
 {
 	Allocator *a = nullptr;
-	bool _c_hit = _c_cache.match (nptrs, callstack, a, CL);
-	if (! _c_hit )
-	{
-		// Process each callstack frame. Check on which module it resides, compute effective address
-		// and then translate it using BFD (if possible)
 
-		translated_frame_t tf[nptrs];
-		unsigned n_translated_frames = 0;
-		unsigned highest_translated_frame = 0;
-		bool any_translated = false;
+	// Process each callstack frame. Check on which module it resides, compute effective address
+	// and then translate it using BFD (if possible)
 
-		// Initialize data structure
-		memset (tf, 0, sizeof(translated_frame_t)*nptrs);
+	translated_frame_t tf[nptrs];
+	unsigned n_translated_frames = 0;
+	unsigned highest_translated_frame = 0;
+	bool any_translated = false;
 
-		for (unsigned frame = 0; frame < nptrs; frame++)
-		{
-			DBG("Frame %u (out of %u) points to %p\n", frame, nptrs, callstack[frame]);
+	// Initialize data structure
+	memset (tf, 0, sizeof(translated_frame_t)*nptrs);
 
-			const char *fname = nullptr;
-			char *file = nullptr;
-			long lptr = (long) callstack[frame];
-			void *effective_address = nullptr;
+	for (unsigned frame = 0; frame < nptrs; frame++)
+	{
+		DBG("Frame %u (out of %u) points to %p\n", frame, nptrs, callstack[frame]);
 
-			tf[frame].translated = false;
-			for (unsigned m = 0; m < _nmodules; ++m)
-				if (_modules[m].startAddress <= lptr && lptr <= _modules[m].endAddress && _modules[m].symbolsLoaded)
-				{
-					if (m != 0) // If we're looking into a module, substract its base address
-						effective_address = (void*) ((long) callstack[frame] - _modules[m].startAddress);
-					else
-						effective_address = callstack[frame];
+		const char *fname = nullptr;
+		char *file = nullptr;
+		uintptr_t lptr = (uintptr_t) callstack[frame];
+		void *effective_address = nullptr;
 
-					DBG("Frame %d hit module #%d (%s) and effective address is %p\n", frame, m+1, _modules[m].name, effective_address);
+		tf[frame].translated = false;
+		for (unsigned m = 0; m < _nmodules; ++m)
+			if (_modules[m].symbolsLoaded && ModuleRegistry::contains (_modules[m].module, lptr))
+			{
+				// BFD works with the addresses as seen in the file, so remove the load bias
+				effective_address = (void*) (lptr - _modules[m].module->base);
 
-					tf[frame].translated =
-					  _modules[m].bfd->translate_address (effective_address, &fname, &file, &tf[frame].line);
-					break;
-				}
+				DBG("Frame %d hit module #%d (%s) and effective address is %p\n", frame, m+1, _modules[m].module->name, effective_address);
 
-			if (tf[frame].translated && file != nullptr && fname != nullptr)
-			{
-				any_translated = true;
-				highest_translated_frame = frame;
+				tf[frame].translated =
+				  _modules[m].bfd->translate_address (effective_address, &fname, &file, &tf[frame].line);
+				break;
+			}
+
+		if (tf[frame].translated && file != nullptr && fname != nullptr)
+		{
+			any_translated = true;
+			highest_translated_frame = frame;
 
 #warning Do we need strdup() here?
-				if (options.compareWholePath())
-					tf[frame].file = file;
-				else
-					tf[frame].file = basename(file);
-	
-				DBG("Frame %d (%p) translated into: %s [%s:%d].\n",
-				  frame, effective_address, fname, tf[frame].file, tf[frame].line);
-
-				if (options.stopAtMain())
-					/* Stop parsing backtrace at main -- avoid start symbol, for instance */
-					if (strncmp (fname, "main", 4) == 0 || strncmp (fname, "MAIN__", 6) == 0)
-						break;
-			}
+			if (options.compareWholePath())
+				tf[frame].file = file;
 			else
-			{
-				tf[frame].file = nullptr;
-				tf[frame].line = 0;
-				DBG("Frame %d (%p) was not translated.\n", frame, effective_address);
-			}
+				tf[frame].file = basename(file);
 
-			// Stop translating once we have translated more frames than the max of frames
-			// seen in the code-locations.
-			if (any_translated)
-			{
-				n_translated_frames++;
-				if (n_translated_frames >= _cl->max_nframes())
-				{
-					DBG("Breaking call-stack translation because translated max frames (%u) in code locations.\n",
-					  _cl->max_nframes());
+			DBG("Frame %d (%p) translated into: %s [%s:%d].\n",
+			  frame, effective_address, fname, tf[frame].file, tf[frame].line);
+
+			if (options.stopAtMain())
+				/* Stop parsing backtrace at main -- avoid start symbol, for instance */
+				if (strncmp (fname, "main", 4) == 0 || strncmp (fname, "MAIN__", 6) == 0)
 					break;
-				}
-			}
+		}
+		else
+		{
+			tf[frame].file = nullptr;
+			tf[frame].line = 0;
+			DBG("Frame %d (%p) was not translated.\n", frame, effective_address);
 		}
 
-		// Make sure that we have translated a portion of the call-stack
+		// Stop translating once we have translated more frames than the max of frames
+		// seen in the code-locations.
 		if (any_translated)
 		{
-			// Ignore the initial frame (the malloc routine call itself) and the prefix of the
-			// the callstack that has not been translated
-			unsigned initial_frame = 0;
-			while (initial_frame < nptrs)
+			n_translated_frames++;
+			if (n_translated_frames >= _cl->max_nframes())
 			{
-				if (tf[initial_frame].translated)
-					break;
-				initial_frame++;
+				DBG("Breaking call-stack translation because translated max frames (%u) in code locations.\n",
+				  _cl->max_nframes());
+				break;
 			}
+		}
+	}
+
+	// Make sure that we have translated a portion of the call-stack
+	translated = any_translated;
+	if (any_translated)
+	{
+		// Ignore the initial frame (the malloc routine call itself) and the prefix of the
+		// the callstack that has not been translated
+		unsigned initial_frame = 0;
+		while (initial_frame < nptrs)
+		{
+			if (tf[initial_frame].translated)
+				break;
+			initial_frame++;
+		}
+
+		unsigned nframes = highest_translated_frame - initial_frame + 1;
+		DBG("Number of used frames: %u = %u - %u + 1 \n", nframes, highest_translated_frame, initial_frame);
+		if (nframes > 0)
+			a = _cl->match (nframes, &tf[initial_frame], CL);
+		DBG("Translated callstack matches a = %p CL = %u\n", a, CL);
+	}
+
+	return a;
+}
+
+Allocator * FlexMalloc::allocatorForCallstack_source (unsigned nptrs, void **callstack, size_t size, bool& fits, uint32_t& CL)
+{
+	Allocator *a = nullptr;
+
+	// Bring the decisions taken by the symbolizer thread into the cache
+	if (_sym_active && _sym_ndone > 0)
+		symbolizer_publish ();
+
+	bool _c_hit = _c_cache.match (nptrs, callstack, a, CL);
+	if (! _c_hit && _decisions != nullptr && _decisions->lookup (nptrs, callstack, a, CL))
+	{
+		// Decision already known (possibly from a previous run)
+		_c_cache.add_match (nptrs, callstack, a, CL);
+		_c_hit = true;
+	}
+	if (! _c_hit )
+	{
+		if (_sym_active)
+		{
+			// Provisionally place the allocation on the fallback allocator
+			// while the symbolizer thread resolves the location (BFD is only
+			// used from that thread in this mode)
+			symbolizer_enqueue (nptrs, callstack);
+			_sym_nprovisional++;
+			fits = true;
+			return nullptr;
+		}
 
-			unsigned nframes = highest_translated_frame - initial_frame + 1;
-			DBG("Number of used frames: %u = %u - %u + 1 \n", nframes, highest_translated_frame, initial_frame);
-			if (nframes > 0)
-				a = _cl->match (nframes, &tf[initial_frame], CL);
-			DBG("Cache - adding match - a = %p CL = %u\n", a, CL);
+		// Modules changed while the symbolizer thread owned them (i.e.
+		// before a fork) are updated here
+		if (_sym_modules_dirty)
+		{
+			_sym_modules_dirty = false;
+			retire_modules();
+			load_modules();
+		}
+
+		bool translated = false;
+		a = translate_callstack (nptrs, callstack, CL, translated);
+		if (translated)
+		{
 			_c_cache.add_match (nptrs, callstack, a, CL); // Record the original call-stack
+			if (_decisions != nullptr)
+				_decisions->record (nptrs, callstack, a, CL);
 		}
 	}
 
@@ -422,6 +813,98 @@ Allocator * FlexMalloc::allocatorForCallstack_raw (unsigned nptrs, void **callst
 	return a;
 }
 
+// FlexMalloc::thp_policy
+//   returns the transparent huge pages policy for an object of the given size,
+//   which is given by its location (if it has one) or by the global policy.
+thp_policy_t FlexMalloc::thp_policy (bool has_location, uint32_t CL, size_t size) const
+{
+	if (size < options.thpThreshold())
+		return THP_POLICY_NONE;
+	if (has_location && _cl->thp (CL) != THP_POLICY_UNSET)
+		return _cl->thp (CL);
+	return options.thpPolicy();
+}
+
+// FlexMalloc::apply_thp
+//   advises the kernel on the pages fully covered by the object. Failures are
+//   ignored, as some tiers (e.g. file-backed) do not support it.
+void FlexMalloc::apply_thp (void *ptr, size_t size, thp_policy_t policy)
+{
+	if (ptr == nullptr || (policy != THP_POLICY_HUGE && policy != THP_POLICY_NOHUGE))
+		return;
+
+	size_t page = policy == THP_POLICY_HUGE ? THP_PAGE_SIZE : sysconf (_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t) ptr + page - 1) & ~(page - 1);
+	uintptr_t end = ((uintptr_t) ptr + size) & ~(page - 1);
+	if (start < end)
+	{
+		madvise ((void*) start, end - start,
+		  policy == THP_POLICY_HUGE ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+		_thp_nadvised++;
+	}
+}
+
+// FlexMalloc::prefaults
+//   tells whether an object of the given size is to be pre-faulted, from the
+//   threshold of its location (if it has one) or the global one.
+bool FlexMalloc::prefaults (bool has_location, uint32_t CL, size_t size) const
+{
+	if (_prefaulter == nullptr)
+		return false;
+	if (has_location && _cl->prefault (CL) > 0)
+		return size >= _cl->prefault (CL);
+	return size >= options.prefaultThreshold();
+}
+
+// FlexMalloc::fallback_allocator
+//   returns the allocator for an object that does not fit in the allocator of
+//   its location, which is the first allocator of the location chain in which
+//   it fits, or the fallback allocator if there is none.
+Allocator * FlexMalloc::fallback_allocator (uint32_t CL, size_t size)
+{
+	Allocator *a = _cl->next_tier (CL, size);
+	if (a != nullptr)
+	{
+		DBG("Allocator '%s' in the chain of location %u fits %lu bytes\n", a->name(), CL, size);
+		return a;
+	}
+	return _fallback;
+}
+
+// FlexMalloc::record_location_add
+//   accounts the memory of an object on its location. Split objects are
+//   divided between the requested allocator and the fallback one, and the
+//   objects migrated to a single tier are accounted as any other object.
+void FlexMalloc::record_location_add (uint32_t CL, void *ptr, size_t size, bool fits)
+{
+	if (ptr != nullptr && Allocator::getAllocatorHeader (ptr)->allocator() == _split &&
+	    _split->owner (ptr) == _split)
+	{
+		size_t lead = _split->lead_size (ptr);
+		_cl->record_location_add_split_memory (CL, lead, size - lead);
+	}
+	else
+		_cl->record_location_add_memory (CL, size, !fits);
+}
+
+// FlexMalloc::record_location_sub
+//   removes the memory of an object owned by a from its location. Lead
+//   refers to the bytes on the requested allocator of the split objects,
+//   which needs to be taken before they are freed, as their owner.
+void FlexMalloc::record_location_sub (uint32_t CL, Allocator *a, size_t size, size_t lead)
+{
+	if (a == _split)
+		_cl->record_location_sub_split_memory (CL, lead, size - lead);
+	else
+	{
+		// Identify whether the previous allocation did fit to substract
+		// the amount of memory used. For this, we check if requested
+		// allocator matches the used allocator.
+		bool prev_fit = _cl->allocator (CL) == a;
+		_cl->record_location_sub_memory (CL, size, !prev_fit);
+	}
+}
+
 void * FlexMalloc::malloc (unsigned nptrs, void **callstack, size_t size)
 {
 	DBG("(nptrs = %u callstack = %p size = %lu)\n", nptrs, callstack, size);
@@ -430,12 +913,13 @@ void * FlexMalloc::malloc (unsigned nptrs, void **callstack, size_t size)
 	bool save_CL = false;
 	uint32_t CL;
 	Allocator *a = allocatorForCallstack (nptrs, callstack, size, fits, CL);
+	Allocator *requested = a;
 	if (!fits)
 	{
 		DBG("Willing to allocate %lu bytes using allocator '%s' but it does not fit. Using fallback allocator.\n",
 		    size, a->name());
 		a->record_unfitted_malloc (size);
-		a = _fallback;
+		a = fallback_allocator (CL, size);
 	}
 	if (nullptr == a)
 		a = _fallback;
@@ -443,14 +927,33 @@ void * FlexMalloc::malloc (unsigned nptrs, void **callstack, size_t size)
 		save_CL = true;
 
 	DBG("Allocating %lu bytes using allocator '%s'\n", size, a->name());
-	void * res = a->malloc(size);
+	void * res = nullptr;
+	thp_policy_t thp = thp_policy (save_CL, CL, size);
+	if (!fits && a == _fallback && _cl->split (CL))
+		res = _split->allocate (requested, _fallback, size, thp == THP_POLICY_HUGE ? THP_PAGE_SIZE : 0);
+	if (res != nullptr)
+	{
+		DBG("Split %lu bytes between allocators '%s' and '%s'\n", size, requested->name(), a->name());
+	}
+	else if (thp == THP_POLICY_HUGE)
+	{
+		// Start the object on a huge page boundary
+		if (a->posix_memalign (&res, THP_PAGE_SIZE, size) != 0)
+			res = nullptr;
+		_thp_naligned++;
+	}
+	else
+		res = a->malloc(size);
+	apply_thp (res, size, thp);
+	if (res != nullptr && prefaults (save_CL, CL, size))
+		_prefaulter->fill (res, size, false);
 	DBG("Data allocated in %p\n", res);
 
 	// Save code location to quantify HWM per location
 	if (save_CL)
 	{
 		Allocator::codeLocation (res, CL);
-		_cl->record_location_add_memory (CL, size, !fits);
+		record_location_add (CL, res, size, fits);
 	}
 
 	return res;
@@ -464,12 +967,13 @@ void * FlexMalloc::calloc (unsigned nptrs, void **callstack, size_t nmemb, size_
 	bool save_CL = false;
 	uint32_t CL;
 	Allocator *a = allocatorForCallstack (nptrs, callstack, size, fits, CL);
+	Allocator *requested = a;
 	if (!fits)
 	{
 		DBG("Willing to allocate %lu bytes using allocator '%s' but it does not fit. Using fallback allocator.\n",
 		    size, a->name());
 		a->record_unfitted_calloc (size);
-		a = _fallback;
+		a = fallback_allocator (CL, nmemb * size);
 	}
 	if (nullptr == a)
 		a = _fallback;
@@ -477,14 +981,50 @@ void * FlexMalloc::calloc (unsigned nptrs, void **callstack, size_t nmemb, size_
 		save_CL = true;
 
 	DBG("Allocating %lu bytes using allocator '%s'\n", size, a->name());
-	void * res = a->calloc(nmemb, size);
+	void * res = nullptr;
+	thp_policy_t thp = thp_policy (save_CL, CL, nmemb * size);
+	bool prefault = prefaults (save_CL, CL, nmemb * size);
+	// Split objects are freshly mapped, and thus already zeroed
+	if (!fits && a == _fallback && _cl->split (CL))
+		res = _split->allocate (requested, _fallback, nmemb * size, thp == THP_POLICY_HUGE ? THP_PAGE_SIZE : 0);
+	if (res != nullptr)
+	{
+		DBG("Split %lu bytes between allocators '%s' and '%s'\n", nmemb * size, requested->name(), a->name());
+		apply_thp (res, nmemb * size, thp);
+	}
+	else if (thp == THP_POLICY_HUGE)
+	{
+		if (a->posix_memalign (&res, THP_PAGE_SIZE, nmemb * size) != 0)
+			res = nullptr;
+		else
+		{
+			// Aligned objects are not known to be zero, the pre-faulting
+			// threads clear them if enabled
+			apply_thp (res, nmemb * size, thp);
+			if (prefault)
+				_prefaulter->fill (res, nmemb * size, true);
+			else
+				memset (res, 0, nmemb * size);
+			prefault = false;
+		}
+		_thp_naligned++;
+	}
+	else
+	{
+		res = a->calloc(nmemb, size);
+		apply_thp (res, nmemb * size, thp);
+	}
+	// The allocators only clear the memory not known to be zero, so the
+	// remaining pages are still to be faulted
+	if (res != nullptr && prefault)
+		_prefaulter->fill (res, nmemb * size, false);
 	DBG("Data allocated in %p\n", res);
 
 	// Save code location to quantify HWM per location
 	if (save_CL)
 	{
 		Allocator::codeLocation (res, CL);
-		_cl->record_location_add_memory (CL, nmemb * size, !fits);
+		record_location_add (CL, res, nmemb * size, fits);
 	}
 
 	return res;
@@ -501,20 +1041,42 @@ int FlexMalloc::posix_memalign (unsigned nptrs, void **callstack, void ** memptr
 	bool save_CL = false;
 	uint32_t CL;
 	Allocator *a = allocatorForCallstack (nptrs, callstack, size, fits, CL);
+	Allocator *requested = a;
 	if (!fits)
 	{
 		DBG("Willing to allocate %lu bytes using allocator '%s' but it does not fit. Using fallback allocator.\n",
 		    size, a->name());
 		a->record_unfitted_aligned_malloc (size);
-		a = _fallback;
+		a = fallback_allocator (CL, size);
 	}
 	if (nullptr == a)
 		a = _fallback;
 	else
 		save_CL = true;
 
+	thp_policy_t thp = thp_policy (save_CL, CL, size);
+	if (thp == THP_POLICY_HUGE && alignment < THP_PAGE_SIZE)
+	{
+		alignment = THP_PAGE_SIZE;
+		_thp_naligned++;
+	}
+
 	DBG("Allocating %lu bytes using allocator '%s'\n", size, a->name());
-	int res = a->posix_memalign (&ptr, alignment, size);
+	int res;
+	if (!fits && a == _fallback && _cl->split (CL) &&
+	    (ptr = _split->allocate (requested, _fallback, size, alignment)) != nullptr)
+	{
+		DBG("Split %lu bytes between allocators '%s' and '%s'\n", size, requested->name(), a->name());
+		res = 0;
+	}
+	else
+		res = a->posix_memalign (&ptr, alignment, size);
+	if (res == 0)
+	{
+		apply_thp (ptr, size, thp);
+		if (prefaults (save_CL, CL, size))
+			_prefaulter->fill (ptr, size, false);
+	}
 	DBG("Result %d - data allocated in %p\n", res, *memptr);
 
 	if (memptr != nullptr)
@@ -524,7 +1086,7 @@ int FlexMalloc::posix_memalign (unsigned nptrs, void **callstack, void ** memptr
 	if (save_CL)
 	{
 		Allocator::codeLocation (ptr, CL);
-		_cl->record_location_add_memory (CL, size, !fits);
+		record_location_add (CL, ptr, size, fits);
 	}
 
 	return res;
@@ -542,7 +1104,7 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 		DBG("Willing to allocate %lu bytes using allocator '%s' but it does not fit. Using fallback allocator.\n",
 		    new_size, new_allocator->name());
 		new_allocator->record_unfitted_realloc (new_size);
-		new_allocator = _fallback;
+		new_allocator = fallback_allocator (CL, new_size);
 	}
 	if (nullptr == new_allocator)
 		new_allocator = _fallback;
@@ -554,9 +1116,12 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 		// Given this pointer - we check whether the pointer was allocated by any allocator from
 		//   flexmalloc or by "default" calls (in _af structure).
 		Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
-		Allocator *prev_allocator = hdr->allocator;
-		size_t prev_size  = hdr->size;
-		void * prev_base  = hdr->base_ptr;
+		Allocator *prev_allocator = hdr->allocator();
+		size_t prev_size  = hdr->size();
+		void * prev_base  = hdr->base_ptr();
+		size_t prev_lead  = prev_allocator == _split ? _split->lead_size (ptr) : 0;
+		// Objects migrated to a single tier are handled as objects of the tier
+		Allocator *prev_owner = prev_allocator == _split ? _split->owner (ptr) : prev_allocator;
 		// Extract the previous code-location ID and if it is valid
 		bool valid_prev_CL;
 		uint32_t prev_CL  = Allocator::codeLocation (ptr, valid_prev_CL);
@@ -566,9 +1131,9 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 			// Case in which buffer was allocated by "_af"/backend allocators and no new allocator
 			// assigned to this call-site
 			DBG("realloc from null-allocator to null-allocator%s\n", "");
-			FlexMalloc::uninitialized_realloc (ptr, new_size);
+			res = FlexMalloc::uninitialized_realloc (ptr, new_size);
 		}
-		else if (prev_allocator != new_allocator)
+		else if (prev_owner != new_allocator)
 		{
 			// Case in which buffer was initially allocated by one allocator but realloc callstack
 			// now states to be allocated by a new allocator.
@@ -585,8 +1150,17 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 				  prev_allocator, new_allocator);
 			}
 
+			// Objects between allocators that place their memory through a
+			// memory policy, in pages that the previous one owns alone, have
+			// their pages migrated rather than copied
+			bool migrated = false;
+			if (prev_allocator != nullptr && new_allocator != nullptr &&
+			    (res = _split->migrate (prev_allocator, new_allocator, ptr, prev_size, new_size, migrated)) != nullptr)
+			{
+				DBG("realloc moved %p to %p (pages migrated: %d)\n", ptr, res, migrated);
+			}
 			// Allocate space in allocator
-			if (new_allocator == nullptr)
+			else if (new_allocator == nullptr)
 			{
 				res = _af.malloc (new_size);
 				if (res == nullptr)
@@ -605,16 +1179,24 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 				}
 			}
 
-			// Copy from one memory region to the other using the specific
-			// memcpy from the new allocator
-			if (new_allocator == nullptr)
-				memcpy (res, ptr, MIN(prev_size, new_size));
-			else
-				new_allocator->memcpy (res, ptr, MIN(prev_size, new_size));
+			// Copy from one memory region to the other through the copy
+			// engine, which uses the specific memcpy from the new allocator
+			// unless the object does not go to the tier requested by its
+			// location, in which case it is streamed
+			if (!migrated)
+			{
+				if (new_allocator == nullptr)
+					memcpy (res, ptr, MIN(prev_size, new_size));
+				else
+					_copier->copy (new_allocator, prev_allocator, res, ptr, MIN(prev_size, new_size), !fits || !save_CL);
+			}
 
 			// Free old pointer
 			if (prev_allocator == nullptr)
+			{
+				Allocator::releaseAllocatorHeader (ptr);
 				_af.free (prev_base);
+			}
 			else
 				prev_allocator->free (ptr);
 
@@ -632,14 +1214,14 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 			else
 				new_allocator->record_target_realloc (MIN(prev_size, new_size));
 		}
-		else if (prev_allocator == new_allocator) // && prev_a != nullptr && new_a != nullptr
+		else if (prev_owner == new_allocator) // && prev_a != nullptr && new_a != nullptr
 		{
 			// Case in which the allocator used in previous allocation and allocator
 			// used in current allocation match
 			DBG("pre/post allocator in realloc are the same allocator %p (%s)\n",
 			  prev_allocator, prev_allocator->name());
 
-			res = new_allocator->realloc (ptr, new_size);
+			res = prev_allocator->realloc (ptr, new_size);
 
 			// Need to annotate statistics. Note that the bytes copied are the
 			// minimum between new and prev sizes. Also, allocators ignore realloc
@@ -647,46 +1229,39 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 			// capture metrics when new size is larger -> bytes copies are the
 			// prev_size then
 			if (new_size > prev_size)
-				new_allocator->record_self_realloc (prev_size);
+				prev_allocator->record_self_realloc (prev_size);
 		}
 
-		if (prev_allocator != new_allocator)
+		// Objects are not moved to honor the alignment on realloc
+		apply_thp (res, new_size, thp_policy (save_CL, CL, new_size));
+
+		if (prev_owner != new_allocator)
 		{
-			// Identify whether the previous allocation did fit to substract
-			// the amount of memory used. For this, we check if requested
-			// allocator matches the used allocator.
 			if (valid_prev_CL)
-			{
-				bool prev_fit = _cl->allocator (prev_CL) == prev_allocator;
-				_cl->record_location_sub_memory (prev_CL, prev_size, !prev_fit);
-			}
+				record_location_sub (prev_CL, prev_owner, prev_size, prev_lead);
 			// Save code location to quantify HWM per location
 			if (save_CL)
 			{
 				Allocator::codeLocation (res, CL);
-				_cl->record_location_add_memory (CL, new_size, !fits);
+				record_location_add (CL, res, new_size, fits);
 			}
 		}
 		else
 		{
 			// Only update statistics if new buffer is actually bigger than
-			// old buffer
-			
-			// Identify whether the previous allocation did fit to substract
-			// the amount of memory used. For this, we check if requested
-			// allocator matches the used allocator.
-			if (new_size > prev_size)
+			// old buffer, or if it was shrunk (allocators ignore the small
+			// reductions, leaving the previous size in the header)
+			bool shrunk = res != nullptr && new_size < prev_size &&
+			  Allocator::getAllocatorHeader (res)->size() == new_size;
+			if (new_size > prev_size || shrunk)
 			{
 				if (valid_prev_CL)
-				{
-					bool prev_fit = _cl->allocator (prev_CL) == prev_allocator;
-					_cl->record_location_sub_memory (prev_CL, prev_size, !prev_fit);
-				}
+					record_location_sub (prev_CL, prev_owner, prev_size, prev_lead);
 				// Save code location to quantify HWM per location
 				if (save_CL)
 				{
 					Allocator::codeLocation (res, CL);
-					_cl->record_location_add_memory (CL, new_size, !fits);
+					record_location_add (CL, res, new_size, fits);
 				}
 			}
 		}
@@ -706,26 +1281,27 @@ void * FlexMalloc::realloc (unsigned nptrs, void **callstack, void *ptr, size_t
 void FlexMalloc::free (void *ptr)
 {
 	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
-	Allocator *a = hdr->allocator;
-	size_t size  = hdr->size;
+	Allocator *a = hdr->allocator();
+	size_t size  = hdr->size();
 
 	// Extract the previous code-location ID and if it is valid
 	bool valid_prev_CL;
 	uint32_t prev_CL  = Allocator::codeLocation (ptr, valid_prev_CL);
 
-	// Identify whether the previous allocation did fit to substract
-	// the amount of memory used. For this, we check if requested
-	// allocator matches the used allocator.
 	if (valid_prev_CL)
 	{
-		bool prev_fit = _cl->allocator (prev_CL) == a;
-		_cl->record_location_sub_memory (prev_CL, size, !prev_fit);
+		if (a == _split)
+			record_location_sub (prev_CL, _split->owner (ptr), size, _split->lead_size (ptr));
+		else
+			record_location_sub (prev_CL, a, size, 0);
 	}
 
 	// Delegate to the allocator to do the actual free
 	if (a == nullptr)
 	{
-		_af.free (hdr->base_ptr);
+		void *base = hdr->base_ptr();
+		Allocator::releaseAllocatorHeader (ptr);
+		_af.free (base);
 		_uninitialized_stats.record_free (size);
 	}
 	else if (a != nullptr)
@@ -739,7 +1315,7 @@ size_t FlexMalloc::malloc_usable_size (void *ptr) const
 	// Given this pointer - we check whether the pointer was allocated by any allocator from
 	//   flexmalloc or by "default" calls (in _af structure).
 	Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
-	return hdr->size;
+	return hdr->size();
 }
 
 void FlexMalloc::show_statistics (void) const
@@ -748,21 +1324,36 @@ void FlexMalloc::show_statistics (void) const
 	{
 		VERBOSE_MSG(1, "Callstacks cache summary:\n");
 		_c_cache.show_statistics();
+		if (_decisions != nullptr)
+			_decisions->show_statistics();
+		if (_sym_active)
+			VERBOSE_MSG(1, "Symbolizer: %llu provisional placements, %llu queued, %llu resolved, %llu discarded.\n",
+			  _sym_nprovisional, _sym_nqueued, _sym_nresolved, _sym_ndiscarded);
 		VERBOSE_MSG(1, "End of callstacks cache summary.\n");
 	}
+	if (_thp_naligned > 0 || _thp_nadvised > 0)
+		VERBOSE_MSG(1, "Transparent huge pages: %llu allocations aligned, %llu allocations advised.\n",
+		  _thp_naligned, _thp_nadvised);
+	if (_prefaulter != nullptr)
+		_prefaulter->show_statistics();
+	_copier->show_statistics();
 	VERBOSE_MSG(1, "Allocator statistics:\n");
 	_allocators->show_statistics();
+	if (_split->used())
+		_split->show_statistics();
 	_uninitialized_stats.show_statistics ("out-of-flexmalloc", true);
+	BootstrapArena::show_statistics ();
+	MetadataTable::show_statistics ();
 	VERBOSE_MSG(1, "End of allocator statistics.\n");
 	if (options.sourceFrames())
 	{
 		for (unsigned u = 0; u < _nmodules; ++u)
 		{
-			struct stat s;
-			if (0 != stat (_modules[u].name, &s))
-				s.st_size = 0;
-			VERBOSE_MSG(1, "Module %u (%s) in range %08lx-%08lx w/ size %lu.\n", 
-			  u, _modules[u].name, _modules[u].startAddress, _modules[u].endAddress, s.st_size);
+			const ModuleRegistry::module_t *m = _modules[u].module;
+			char build_id[2*ModuleRegistry::MAX_BUILD_ID_SZ+1];
+			ModuleRegistry::build_id_to_string (m, build_id, sizeof(build_id));
+			VERBOSE_MSG(1, "Module %u (%s) loaded at %08lx w/ %u segments and build-id '%s'.\n",
+			  u, m->name, m->base, m->nsegments, build_id);
 		}
 	}
 }
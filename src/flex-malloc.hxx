@@ -1,11 +1,17 @@
 #pragma once
 
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "allocator.hxx"
 #include "code-locations.hxx"
+#include "module-registry.hxx"
 #include "bfd-manager.hxx"
 #include "cache-callstack.hxx"
+#include "decision-cache.hxx"
+#include "allocator-split.hxx"
+#include "prefault.hxx"
+#include "copy-engine.hxx"
 
 class FlexMalloc
 {
@@ -13,25 +19,82 @@ class FlexMalloc
 	const allocation_functions_t _af;
 	Allocator * _fallback;
 	const Allocators * _allocators; 
+	AllocatorSplit * _split;        // for the objects split across tiers
+	Prefaulter * _prefaulter;       // if large objects are pre-faulted
+	CopyEngine * _copier;           // for the objects moved across tiers
 
 	CacheCallstacks _c_cache;
+	DecisionCache *_decisions;
+	const char *_decisions_file;
 
 	typedef struct module_st
 	{
 		BFDManager *bfd;
-		char *name;
-		long startAddress;
-		long endAddress;
+		const ModuleRegistry::module_t *module;
 		bool symbolsLoaded;
-		bool do_not_backtrace;
 	} module_t;
 
 	module_t   *_modules;
 	unsigned   _nmodules;
-	void parse_map_files (void);
+	unsigned   _nregistry_seen; // Number of registry modules already examined
 	CodeLocations * const _cl;
+	ModuleRegistry * const _registry;
+
+	// Asynchronous symbolization. On a cache miss, the callstack is queued
+	// into a slot and the allocation is provisionally served by the fallback
+	// allocator. The symbolizer thread translates the callstack and leaves
+	// the decision in the slot, which is moved into the callstacks cache by
+	// the next allocation (so the cache is only touched by the allocating
+	// threads, under the interposer lock).
+	static const unsigned SYMBOLIZER_SLOTS = 64;
+	typedef enum { SLOT_FREE, SLOT_QUEUED, SLOT_RUNNING, SLOT_DONE } slot_state_t;
+	typedef struct symbolizer_slot_st
+	{
+		void *frames[CALLSTACKS_PER_ENTRY];
+		unsigned nframes;
+		slot_state_t state;
+		Allocator *allocator;
+		uint32_t CL;
+		bool translated;     // whether any frame could be translated
+		unsigned generation; // of the modules used to translate it
+	} symbolizer_slot_t;
+
+	symbolizer_slot_t _sym_slots[SYMBOLIZER_SLOTS];
+	pthread_mutex_t _sym_mtx;
+	pthread_cond_t _sym_cond;
+	pthread_cond_t _sym_idle;
+	pthread_t _sym_thread;
+	pthread_mutex_t *_interposer_mtx;
+	bool _sym_active;
+	volatile unsigned _sym_ndone;
+	volatile unsigned _sym_generation;
+	volatile bool _sym_modules_dirty;
+	unsigned long long _sym_nprovisional;
+	unsigned long long _sym_nqueued;
+	unsigned long long _sym_nresolved;
+	unsigned long long _sym_ndiscarded;
+
+	unsigned long long _thp_naligned;
+	unsigned long long _thp_nadvised;
+
+	static FlexMalloc *_sym_instance;
+	static void * symbolizer_thread (void *);
+	static void symbolizer_atfork_prepare (void);
+	static void symbolizer_atfork_parent (void);
+	static void symbolizer_atfork_child (void);
+	void symbolizer_loop (void);
+	bool symbolizer_enqueue (unsigned nptrs, void **callstack);
+	void symbolizer_publish (void);
+	void retire_modules (void);
 
 	bool excluded_library (const char *library);
+	thp_policy_t thp_policy (bool has_location, uint32_t codelocation, size_t sz) const;
+	void apply_thp (void *ptr, size_t sz, thp_policy_t policy);
+	bool prefaults (bool has_location, uint32_t codelocation, size_t sz) const;
+	Allocator * fallback_allocator (uint32_t codelocation, size_t sz);
+	void record_location_add (uint32_t codelocation, void *ptr, size_t sz, bool fits);
+	void record_location_sub (uint32_t codelocation, Allocator *a, size_t sz, size_t lead);
+	Allocator * translate_callstack (unsigned nptrs, void **callstack, uint32_t& codelocation, bool &translated);
 	Allocator * allocatorForCallstack_source (unsigned nptrs, void **callstack, size_t sz, bool &fits, uint32_t& codelocation);
 	Allocator * allocatorForCallstack_raw    (unsigned nptrs, void **callstack, size_t sz, bool &fits, uint32_t& codelocation);
 	Allocator * allocatorForCallstack (unsigned nptrs, void **callstack, size_t sz, bool &fits, uint32_t& codelocation);
@@ -48,10 +111,18 @@ class FlexMalloc
 	size_t malloc_usable_size (void *ptr) const;
 
 	void show_statistics (void) const;
+	void load_modules (void);
+	void update_modules (void);
+	void start_symbolizer (pthread_mutex_t *interposer_mtx);
+	void start_prefaulter (void);
+	void start_copier (void);
+	void load_decisions (const char *file);
+	void save_decisions (void);
 
 	////// Static methods - to be called before FlexMalloc has been fully initiliazed
 
 	static void * uninitialized_malloc (size_t s);
+	static void * uninitialized_calloc (size_t nmemb, size_t s);
 	static int    uninitialized_posix_memalign (void **ptr, size_t align, size_t s);
 	static void * uninitialized_realloc (void *ptr, size_t s);
 	static void   uninitialized_free (void *ptr);
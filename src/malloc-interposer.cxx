@@ -29,7 +29,10 @@
 #include "common.hxx"
 #include "code-locations.hxx"
 #include "allocators.hxx"
+#include "module-registry.hxx"
 #include "flex-malloc.hxx"
+#include "metadata-table.hxx"
+#include "bootstrap-arena.hxx"
 
 static allocation_functions_t real_allocation_functions;
 static Allocator * fallback = nullptr;
@@ -54,7 +57,14 @@ static bool malloc_interposer_started = false;
 static pthread_mutex_t mtx_malloc_interposer;
 static pthread_mutexattr_t mtx_attr_malloc_interposer;
 
+// Set when the dynamic loader reports (through the rtld-audit library) that
+// modules have been mapped or unmapped. Once the audit interface is seen to
+// be active, the dlopen/dlclose wrappers do not need to rescan the modules.
+static volatile unsigned modules_changed = 0;
+static bool rtld_audit_active = false;
+
 static Allocators *allocators = nullptr;
+static ModuleRegistry *modules = nullptr;
 static CodeLocations *codelocations = nullptr;
 static FlexMalloc *flexmalloc = nullptr;
 
@@ -215,18 +225,78 @@ int pthread_create (
 }
 #endif // HWC
 
+// Rescans the loaded modules and, if anything changed, relocates the raw
+// locations or loads the symbols of the new modules. Must be called with
+// the interposer lock held, so that the matching never observes the
+// locations while being updated.
+static void update_modules (void)
+{
+	if (modules->refresh() > 0)
+	{
+		if (options.sourceFrames())
+			flexmalloc->update_modules();
+		else
+			codelocations->update_modules();
+	}
+}
+
+// Module changes reported by the dynamic loader are applied right before the
+// next allocation that needs to match the locations.
+static inline void process_module_events (void)
+{
+	if (UNLIKELY(modules_changed) && __sync_bool_compare_and_swap (&modules_changed, 1, 0))
+		update_modules ();
+}
+
+// Entry points for the rtld-audit library (libflexmalloc_audit.so, given in
+// LD_AUDIT). These are invoked with the dynamic loader lock held, so they
+// only flag the event; they must neither take the interposer lock nor
+// allocate memory.
+extern "C" void flexmalloc_rtld_objopen (const char *, uintptr_t)
+{
+	rtld_audit_active = true;
+	__sync_lock_test_and_set (&modules_changed, 1);
+}
+
+extern "C" void flexmalloc_rtld_objclose (const char *, uintptr_t)
+{
+	rtld_audit_active = true;
+	__sync_lock_test_and_set (&modules_changed, 1);
+}
+
 void* dlopen(const char *file, int mode)
 {
 	static void* (*o_dlopen) ( const char *file, int mode )=0;
 	o_dlopen = (void*(*)(const char *file, int mode)) dlsym(RTLD_NEXT,"dlopen");
 	void* res = (*o_dlopen)( file, mode );
 
-	if (LIKELY(malloc_interposer_started) && !options.sourceFrames())
+	if (LIKELY(malloc_interposer_started) && res != nullptr && !rtld_audit_active)
 	{
-		if (file != NULL)
-		{
-			codelocations->translate_pending_frames(file);
-		}
+		// Learn about the newly loaded modules and make them available to the matching
+		pthread_mutex_lock (&mtx_malloc_interposer);
+		inside++;
+		update_modules ();
+		inside--;
+		pthread_mutex_unlock (&mtx_malloc_interposer);
+	}
+	return res;
+}
+
+int dlclose(void *handle)
+{
+	static int (*o_dlclose) ( void *handle )=0;
+	o_dlclose = (int(*)(void *handle)) dlsym(RTLD_NEXT,"dlclose");
+	int res = (*o_dlclose)( handle );
+
+	if (LIKELY(malloc_interposer_started) && res == 0 && !rtld_audit_active)
+	{
+		// Retire the modules that may have been unloaded, so that their
+		// addresses are not matched anymore
+		pthread_mutex_lock (&mtx_malloc_interposer);
+		inside++;
+		update_modules ();
+		inside--;
+		pthread_mutex_unlock (&mtx_malloc_interposer);
 	}
 	return res;
 }
@@ -246,6 +316,8 @@ void * malloc (size_t size)
 	{
 		if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 		{
+			process_module_events ();
+
 			_n_malloc++;
 
 			DBG("IN (size = %lu)\n", size);
@@ -283,46 +355,13 @@ void * malloc (size_t size)
 	return res;
 }
 
-
-#define _CALLOC_INIT_BUFFER     1024*1024
-static char     __calloc_buffer[_CALLOC_INIT_BUFFER] = { 0 };
-static unsigned __calloc_buffer_last_pos = 0;
-
 void * calloc (size_t nmemb, size_t size)
 {
-	static void* (*tmp_calloc)(size_t,size_t) = nullptr;
-	static void* (*tmp_malloc)(size_t) = nullptr;
-	static unsigned calloc_init_depth = 0;
 	void * res = nullptr;
  	if (UNLIKELY(!malloc_interposer_started))
 	{
-		if (tmp_calloc == nullptr && calloc_init_depth == 0)
-		{
-			calloc_init_depth++;
-			tmp_calloc = (void* (*)(size_t,size_t)) dlsym (RTLD_NEXT, "calloc");
-			tmp_malloc = (void* (*)(size_t)) dlsym (RTLD_NEXT, "malloc");
-			calloc_init_depth--;
-			DBG("PRE0 (size = %lu)\n", size);
-			void *res = tmp_calloc (nmemb, size);
-			DBG("returning %p\n", res);
-			return res;
-		}
-		else if (tmp_calloc == nullptr && calloc_init_depth > 0)
-		{
-			assert (nmemb * size + __calloc_buffer_last_pos < _CALLOC_INIT_BUFFER);
-			res = &__calloc_buffer[__calloc_buffer_last_pos];
-			__calloc_buffer_last_pos += nmemb * size;
-			DBG("PRE0b (size = %lu)\n", size);
-			DBG("returning %p\n", res);
-			return res;
-		}
-		else if (tmp_malloc != nullptr)
-		{
-			DBG("uninit size %lu * %lu\n", nmemb, size);
-			void * res = FlexMalloc::uninitialized_malloc (nmemb * size);
-			memset (res, 0, nmemb * size);
-			return res;
-		}
+		DBG("uninit size %lu * %lu\n", nmemb, size);
+		return FlexMalloc::uninitialized_calloc (nmemb, size);
 	}
 
 	pthread_mutex_lock (&mtx_malloc_interposer);
@@ -331,6 +370,8 @@ void * calloc (size_t nmemb, size_t size)
 	{
 		if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 		{
+			process_module_events ();
+
 			_n_calloc++;
 
 			DBG("IN (size = %lu)\n", size);
@@ -366,20 +407,11 @@ void * calloc (size_t nmemb, size_t size)
 	inside--;
 	pthread_mutex_unlock (&mtx_malloc_interposer);
 
-	// Set memory to 0s, as calloc semantics requires
-	memset (res, 0, nmemb * size);
-
 	return res;
 }
 
 void *realloc (void *ptr, size_t size)
 {
-	if (UNLIKELY((void*) &__calloc_buffer[0] <= ptr && ptr < (void*) &__calloc_buffer[_CALLOC_INIT_BUFFER]))
-	{
-		assert (false);
-		return nullptr;
-	}
-
 	if (UNLIKELY(!malloc_interposer_started))
 	{
 	// This branch occurs when running free before initializing library
@@ -387,6 +419,17 @@ void *realloc (void *ptr, size_t size)
 		return FlexMalloc::uninitialized_realloc (ptr, size);
 	}
 
+	// Objects from the bootstrap arena are moved to the allocator of the
+	// location when they grow, as if newly allocated
+	void *bootstrap_ptr = nullptr;
+	if (UNLIKELY(BootstrapArena::contains (ptr)))
+	{
+		if (size <= BootstrapArena::size (ptr))
+			return ptr;
+		bootstrap_ptr = ptr;
+		ptr = nullptr;
+	}
+
 	// We cannot discriminate according to the given size because we need to honor
 	// the allocator previously used.
 
@@ -395,6 +438,8 @@ void *realloc (void *ptr, size_t size)
 	void * res = nullptr;
 	if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 	{
+		process_module_events ();
+
 		_n_realloc++;
 
 		DBG("IN ptr = %p, size = %lu\n", ptr, size);
@@ -423,6 +468,12 @@ void *realloc (void *ptr, size_t size)
 	inside--;
 	pthread_mutex_unlock (&mtx_malloc_interposer);
 
+	if (bootstrap_ptr != nullptr && res != nullptr)
+	{
+		memcpy (res, bootstrap_ptr, BootstrapArena::size (bootstrap_ptr));
+		free (bootstrap_ptr);
+	}
+
 	return res;
 }
 
@@ -442,6 +493,8 @@ int posix_memalign (void **memptr, size_t alignment, size_t size)
 	{
 		if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 		{
+			process_module_events ();
+
 			_n_posix_memalign++;
 
 			DBG("IN (alignment = %lu, size = %lu)\n", alignment, size);
@@ -501,6 +554,8 @@ void * aligned_alloc (size_t alignment, size_t size)
 	{
 		if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 		{
+			process_module_events ();
+
 			DBG("IN (alignment = %lu, size = %lu)\n", alignment, size);
 			unsigned MF = codelocations->max_nframes();
 			void *callstack_ptrs[1+MF];
@@ -565,6 +620,8 @@ void * memalign (size_t alignment, size_t size)
 	{
 		if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 		{
+			process_module_events ();
+
 			DBG("IN (alignment = %lu, size = %lu)\n", alignment, size);
 			unsigned MF = codelocations->max_nframes();
 			void *callstack_ptrs[1+MF];
@@ -629,6 +686,8 @@ void * valloc (size_t size)
 	{
 		if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 		{
+			process_module_events ();
+
 			DBG("IN (size = %lu)\n", size);
 			unsigned MF = codelocations->max_nframes();
 			void *callstack_ptrs[1+MF];
@@ -694,6 +753,8 @@ void * pvalloc (size_t size)
 	{
 		if (LIKELY(inside == 1 && flexmalloc && codelocations->has_locations()))
 		{
+			process_module_events ();
+
 			DBG("IN (size = %lu, nsize = %lu)\n", size, nsize);
 			unsigned MF = codelocations->max_nframes();
 			void *callstack_ptrs[1+MF];
@@ -738,14 +799,19 @@ void free (void *ptr)
 	if (UNLIKELY(ptr == nullptr))
 		return;
 
-	if (UNLIKELY((void*) &__calloc_buffer[0] <= ptr && ptr < (void*) &__calloc_buffer[_CALLOC_INIT_BUFFER]))
-		return;
-
 	if (UNLIKELY(!malloc_interposer_started))
+	{
+		// Only the objects of the bootstrap arena are known to be ours
+		if (BootstrapArena::contains (ptr))
+			FlexMalloc::uninitialized_free (ptr);
 		return;
+	}
 
 	pthread_mutex_lock (&mtx_malloc_interposer);
-	flexmalloc->free (ptr);
+	if (UNLIKELY(BootstrapArena::contains (ptr)))
+		FlexMalloc::uninitialized_free (ptr);
+	else
+		flexmalloc->free (ptr);
 	_n_free++;
 	pthread_mutex_unlock (&mtx_malloc_interposer);
 }
@@ -755,15 +821,19 @@ void cfree (void *ptr)
 	if (UNLIKELY(ptr == nullptr))
 		return;
 
-	if (UNLIKELY((void*) &__calloc_buffer[0] <= ptr && ptr < (void*) &__calloc_buffer[_CALLOC_INIT_BUFFER]))
-		return;
-
 	if (UNLIKELY(!malloc_interposer_started))
+	{
+		if (BootstrapArena::contains (ptr))
+			FlexMalloc::uninitialized_free (ptr);
 		return;
+	}
 
 	// cfree (ptr) relies on top of free (ptr)
 	pthread_mutex_lock (&mtx_malloc_interposer);
-	flexmalloc->free (ptr);
+	if (UNLIKELY(BootstrapArena::contains (ptr)))
+		FlexMalloc::uninitialized_free (ptr);
+	else
+		flexmalloc->free (ptr);
 	_n_cfree++;
 	pthread_mutex_unlock (&mtx_malloc_interposer);
 }
@@ -775,7 +845,7 @@ size_t malloc_usable_size (void *ptr)
 
 	size_t res; 
 
-	if (UNLIKELY(!malloc_interposer_started))
+	if (UNLIKELY(!malloc_interposer_started || BootstrapArena::contains (ptr)))
 	// This branch occurs when running free before initializing library
 	{
 		return FlexMalloc::uninitialized_malloc_usable_size (ptr);
@@ -819,6 +889,13 @@ void malloc_interposer_start (void)
 		_exit (0);
 	}
 
+	if ((env = getenv (TOOL_METADATA)) != nullptr &&
+	    strcmp (env, "in-band") != 0 && strcmp (env, "out-of-band") != 0)
+		VERBOSE_MSG(0, "Wrong value for environment variable %s. Available values are in-band and out-of-band.\n",
+		  TOOL_METADATA);
+	if (MetadataTable::enabled())
+		VERBOSE_MSG(0, "Allocation metadata kept out of band\n");
+
 	// Get memory definitions from environment
 	if ((env = getenv (TOOL_DEFINITIONS_FILE)) != nullptr)
 	{
@@ -909,16 +986,25 @@ void malloc_interposer_start (void)
 		VERBOSE_MSG(0, "Allocator '%s' will handle allocations smaller or equal than %ld bytes\n",
 		  fallback_smallAllocation->name(), options.minSize());
 	}
+	else
+		// Zero-sized allocations still take the small allocations path
+		fallback_smallAllocation = fallback;
 
 	// Mark the fallback allocator as used by default
 	fallback->used(true);
 
+	// Learn about the modules loaded in the process
+	modules = (ModuleRegistry*) real_allocation_functions.malloc (sizeof(ModuleRegistry));
+	assert (modules != nullptr);
+	new (modules) ModuleRegistry (real_allocation_functions);
+	modules->refresh ();
+
 	// If the user has given a file pointing to callstacks, parse and enable runtime
 	if ((env = getenv (TOOL_LOCATIONS_FILE)) != nullptr)
 	{
 		codelocations = (CodeLocations*) real_allocation_functions.malloc (sizeof(CodeLocations));
 		assert (codelocations != nullptr);
-		new (codelocations) CodeLocations (real_allocation_functions, allocators);
+		new (codelocations) CodeLocations (real_allocation_functions, allocators, modules);
 		codelocations->readfile (env, fallback->name());
 	}
 	else
@@ -931,6 +1017,14 @@ void malloc_interposer_start (void)
 	flexmalloc = (FlexMalloc*) real_allocation_functions.malloc (sizeof(FlexMalloc));
 	assert (flexmalloc != nullptr);
 	new (flexmalloc) FlexMalloc (real_allocation_functions, fallback, codelocations);
+	if ((env = getenv (TOOL_DECISIONS_FILE)) != nullptr)
+		flexmalloc->load_decisions (env);
+	if (options.asyncSymbolization())
+		flexmalloc->start_symbolizer (&mtx_malloc_interposer);
+	if (options.prefault() != PREFAULT_NONE)
+		flexmalloc->start_prefaulter ();
+	if (options.copyThreads() > 0)
+		flexmalloc->start_copier ();
 
 #if defined(HWC)
 	// Initialize and start performance counters
@@ -1004,6 +1098,14 @@ void malloc_interposer_stop  (void)
 		  counters[7]/1000000, ((float) counters[7])/((float)counters[6]), ((float) counters[7])/((float)counters[0]));
 #endif
 
+	// Keep the decisions for the next run. Allocations performed meanwhile
+	// are served by the fallback allocator.
+	pthread_mutex_lock (&mtx_malloc_interposer);
+	inside++;
+	flexmalloc->save_decisions();
+	inside--;
+	pthread_mutex_unlock (&mtx_malloc_interposer);
+
 	// Dump internal statistics
 	flexmalloc->show_statistics();
 	codelocations->show_stats();
@@ -0,0 +1,198 @@
+// License: To determine
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "common.hxx"
+#include "metadata-table.hxx"
+
+int MetadataTable::_mode = -1;
+volatile char MetadataTable::_lock = 0;
+MetadataTable::record_t ** MetadataTable::_buckets = nullptr;
+unsigned MetadataTable::_nbuckets = 0;
+MetadataTable::record_t * MetadataTable::_free = nullptr;
+char * MetadataTable::_pool = nullptr;
+char * MetadataTable::_pool_end = nullptr;
+unsigned long long MetadataTable::_nrecords = 0;
+unsigned long long MetadataTable::_max_nrecords = 0;
+unsigned long long MetadataTable::_pool_bytes = 0;
+
+// May be called before the library is initialized, even before the options
+// are built, so the environment is read here
+bool MetadataTable::enabled (void)
+{
+	if (_mode < 0)
+	{
+		const char *env = getenv (TOOL_METADATA);
+		_mode = env != nullptr && strcmp (env, "out-of-band") == 0;
+	}
+	return _mode > 0;
+}
+
+// Doubles the buckets. Records with the same key keep their order, so the
+// newest header of an address is still found first.
+bool MetadataTable::grow (void)
+{
+	unsigned nbuckets = _nbuckets > 0 ? _nbuckets * 2 : INITIAL_BUCKETS;
+	record_t **buckets = (record_t**) mmap (nullptr, nbuckets * sizeof(record_t*),
+	  PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (buckets == MAP_FAILED)
+		return false;
+
+	for (unsigned b = 0; b < _nbuckets; ++b)
+	{
+		record_t *reversed = nullptr;
+		for (record_t *r = _buckets[b], *next; r != nullptr; r = next)
+		{
+			next = r->next;
+			r->next = reversed;
+			reversed = r;
+		}
+		for (record_t *r = reversed, *next; r != nullptr; r = next)
+		{
+			next = r->next;
+			unsigned nb = bucket (r->key, nbuckets);
+			r->next = buckets[nb];
+			buckets[nb] = r;
+		}
+	}
+
+	if (_buckets != nullptr)
+		munmap (_buckets, _nbuckets * sizeof(record_t*));
+	_buckets = buckets;
+	_nbuckets = nbuckets;
+	return true;
+}
+
+MetadataTable::record_t * MetadataTable::new_record (void)
+{
+	record_t *r = _free;
+	if (r != nullptr)
+	{
+		_free = r->next;
+		return r;
+	}
+
+	if (_pool + sizeof(record_t) > _pool_end)
+	{
+		char *p = (char*) mmap (nullptr, POOL_SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return nullptr;
+		_pool = p;
+		_pool_end = p + POOL_SZ;
+		_pool_bytes += POOL_SZ;
+	}
+	r = (record_t*) _pool;
+	_pool += sizeof(record_t);
+	return r;
+}
+
+Allocator::Header_t * MetadataTable::insert (void *ptr, Allocator *a)
+{
+	uintptr_t key = (uintptr_t) ptr;
+	Allocator::Header_t *res = nullptr;
+
+	lock ();
+	if (_nrecords >= _nbuckets && !grow() && _nbuckets == 0)
+	{
+		unlock ();
+		return nullptr;
+	}
+
+	unsigned b = bucket (key, _nbuckets);
+	record_t *r = _buckets[b];
+	while (r != nullptr && r->key != key)
+		r = r->next;
+
+	// Same allocator at the same address, as when reallocating in place
+	if (r != nullptr && r->hdr.allocator() == a)
+		res = &r->hdr;
+	else if ((r = new_record()) != nullptr)
+	{
+		r->key = key;
+		r->next = _buckets[b];
+		_buckets[b] = r;
+		res = &r->hdr;
+		if (++_nrecords > _max_nrecords)
+			_max_nrecords = _nrecords;
+	}
+	unlock ();
+
+	return res;
+}
+
+Allocator::Header_t * MetadataTable::lookup (void *ptr)
+{
+	Allocator::Header_t *res = find (ptr);
+
+	// Every object given to the application has a header, so ptr was never
+	// allocated or was already freed
+	if (res == nullptr)
+	{
+		VERBOSE_MSG(0, "Invalid pointer %p, not allocated or already freed. Aborting!\n", ptr);
+		abort ();
+	}
+	return res;
+}
+
+Allocator::Header_t * MetadataTable::find (void *ptr)
+{
+	uintptr_t key = (uintptr_t) ptr;
+	Allocator::Header_t *res = nullptr;
+
+	lock ();
+	if (_nbuckets > 0)
+	{
+		record_t *r = _buckets[bucket (key, _nbuckets)];
+		while (r != nullptr && r->key != key)
+			r = r->next;
+		if (r != nullptr)
+			res = &r->hdr;
+	}
+	unlock ();
+
+	return res;
+}
+
+bool MetadataTable::release (void *ptr)
+{
+	uintptr_t key = (uintptr_t) ptr;
+	bool found = false;
+
+	lock ();
+	if (_nbuckets > 0)
+	{
+		record_t **prev = &_buckets[bucket (key, _nbuckets)];
+		while (*prev != nullptr && (*prev)->key != key)
+			prev = &(*prev)->next;
+		if (*prev != nullptr)
+		{
+			record_t *r = *prev;
+			*prev = r->next;
+			r->next = _free;
+			_free = r;
+			_nrecords--;
+			found = true;
+		}
+	}
+	unlock ();
+
+	return found;
+}
+
+void * MetadataTable::object (const Allocator::Header_t *hdr)
+{
+	const record_t *r = (const record_t*) ((uintptr_t) hdr - offsetof(record_t, hdr));
+	return (void*) r->key;
+}
+
+void MetadataTable::show_statistics (void)
+{
+	if (_max_nrecords == 0)
+		return;
+
+	VERBOSE_MSG(1, "Out-of-band metadata: %llu headers (max %llu) in %u buckets and %llu MBytes of records.\n",
+	  _nrecords, _max_nrecords, _nbuckets, _pool_bytes >> 20);
+}
@@ -0,0 +1,74 @@
+// License: To determine
+
+#pragma once
+
+#include <stdint.h>
+#include "allocator.hxx"
+
+// Headers of the allocated objects when the allocation metadata is kept out
+// of band (FLEXMALLOC_METADATA=out-of-band), and of the objects from aligned
+// entry points otherwise. The headers are looked up from the address
+// returned to the application, so no byte in front of the objects belongs
+// to FlexMalloc.
+//
+// Objects are hashed by address into chains of records taken from mmap'ed
+// pools, which never go through malloc and never move, so a header can be
+// used while other objects are allocated. When an allocator builds objects
+// on top of another one (interleave, slab) both headers share the address.
+// The newest one is then found first, and the one below shows up again when
+// it is released.
+class MetadataTable
+{
+	private:
+	static const unsigned INITIAL_BUCKETS = 1 << 16; // needs to be power of 2
+	static const size_t POOL_SZ = 1UL << 20;
+
+	typedef struct record_st
+	{
+		struct record_st *next;  // next in bucket, or in the free list
+		uintptr_t key;           // address given to the application
+		Allocator::Header_t hdr;
+	} record_t;
+
+	static int _mode;            // -1 until the environment is read
+	static volatile char _lock;
+	static record_t **_buckets;
+	static unsigned _nbuckets;
+	static record_t *_free;
+	static char *_pool;          // records not handed out yet
+	static char *_pool_end;
+	static unsigned long long _nrecords;
+	static unsigned long long _max_nrecords;
+	static unsigned long long _pool_bytes;
+
+	static unsigned bucket (uintptr_t key, unsigned nbuckets)
+	  { return (unsigned) ((key >> 4) * 0x9E3779B97F4A7C15ULL >> 32) & (nbuckets - 1); }
+	static void lock (void)
+	  { while (__atomic_test_and_set (&_lock, __ATOMIC_ACQUIRE)) ; }
+	static void unlock (void)
+	  { __atomic_clear (&_lock, __ATOMIC_RELEASE); }
+	static bool grow (void);
+	static record_t * new_record (void);
+
+	public:
+	// Whether all headers are kept in this table, given by the environment
+	// on the first call and fixed for the rest of the execution
+	static bool enabled (void);
+
+	// Header for the object at ptr from allocator a, to be filled by the
+	// caller. The header of another allocator at the same address is kept
+	// below it.
+	static Allocator::Header_t * insert (void *ptr, Allocator *a);
+	// Header of the object at ptr, which aborts if it has none
+	static Allocator::Header_t * lookup (void *ptr);
+	// As lookup, for objects that may not be in the table
+	static Allocator::Header_t * find (void *ptr);
+	// Returns whether ptr had a header
+	static bool release (void *ptr);
+	static bool empty (void)
+	  { return _nrecords == 0; }
+	// Address of the object a header belongs to
+	static void * object (const Allocator::Header_t *hdr);
+
+	static void show_statistics (void);
+};
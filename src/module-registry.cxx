@@ -0,0 +1,309 @@
+// License: To determine
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <link.h>
+#include <elf.h>
+
+#include "common.hxx"
+#include "module-registry.hxx"
+#include "elf-symbols.hxx"
+
+// Notes are 4-byte aligned in ELF files (both for ELF32 and ELF64)
+#define NOTE_ALIGN(x) (((x) + 3) & ~((size_t) 3))
+
+ModuleRegistry::ModuleRegistry (allocation_functions_t &af)
+	: _af(af), _modules(nullptr), _nmodules(0), _capacity(0)
+{
+}
+
+ModuleRegistry::~ModuleRegistry ()
+{
+}
+
+ModuleRegistry::module_t * ModuleRegistry::find_by_base (const char *name, uintptr_t base) const
+{
+	for (unsigned u = 0; u < _nmodules; ++u)
+		if (_modules[u]->loaded && _modules[u]->base == base &&
+		    strcmp (_modules[u]->name, name) == 0)
+			return _modules[u];
+	return nullptr;
+}
+
+// Returns the module described by info, registering it if it was not known
+ModuleRegistry::module_t * ModuleRegistry::add (struct dl_phdr_info *info)
+{
+	char exe[PATH_MAX+1] = {0};
+	const char *name = info->dlpi_name;
+
+	// The dynamic loader gives an empty name to the main binary
+	if (name == nullptr || name[0] == '\0')
+	{
+		ssize_t len = readlink ("/proc/self/exe", exe, PATH_MAX);
+		if (len <= 0)
+			return nullptr;
+		exe[len] = '\0';
+		name = exe;
+	}
+
+	// Avoid linux-vdso.so.1 and other modules that are not backed by a file
+	if (strchr (name, '/') == nullptr)
+		return nullptr;
+
+	module_t *m = find_by_base (name, info->dlpi_addr);
+	if (m != nullptr)
+		return m;
+
+	m = (module_t*) _af.malloc (sizeof(module_t));
+	assert (m != nullptr);
+	memset (m, 0, sizeof(module_t));
+
+	size_t len = strlen (name);
+	m->name = (char*) _af.malloc (len+1);
+	assert (m->name != nullptr);
+	memcpy (m->name, name, len+1);
+	m->realname = nullptr;
+	m->base = info->dlpi_addr;
+	m->loaded = true;
+
+	for (unsigned p = 0; p < info->dlpi_phnum; ++p)
+	{
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[p];
+
+		if (phdr->p_type == PT_LOAD)
+		{
+			if (m->nsegments < MAX_SEGMENTS)
+			{
+				segment_t *s = &m->segments[m->nsegments++];
+				s->start = m->base + phdr->p_vaddr;
+				s->end = s->start + phdr->p_memsz;
+				s->offset = phdr->p_offset;
+				s->filesz = phdr->p_filesz;
+				s->exec = (phdr->p_flags & PF_X) != 0;
+			}
+			else
+			{
+				VERBOSE_MSG(1, "Warning! Module %s has more than %u loadable segments. Ignoring the rest.\n",
+				  m->name, MAX_SEGMENTS);
+			}
+		}
+		else if (phdr->p_type == PT_DYNAMIC)
+		{
+			m->dynamic = (const ElfW(Dyn)*) (m->base + phdr->p_vaddr);
+		}
+		else if (phdr->p_type == PT_NOTE && m->build_id_len == 0)
+		{
+			// Look for the GNU build-id note, which is mapped in memory as part of the module
+			const char *note = (const char*) (m->base + phdr->p_vaddr);
+			const char *note_end = note + phdr->p_memsz;
+			while (note + sizeof(ElfW(Nhdr)) <= note_end)
+			{
+				const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr)*) note;
+				const char *note_name = note + sizeof(ElfW(Nhdr));
+				const char *note_desc = note_name + NOTE_ALIGN(nhdr->n_namesz);
+
+				if (note_desc + nhdr->n_descsz > note_end)
+					break;
+
+				if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+				    memcmp (note_name, "GNU", 4) == 0 &&
+				    nhdr->n_descsz <= MAX_BUILD_ID_SZ)
+				{
+					memcpy (m->build_id, note_desc, nhdr->n_descsz);
+					m->build_id_len = nhdr->n_descsz;
+					break;
+				}
+
+				note = note_desc + NOTE_ALIGN(nhdr->n_descsz);
+			}
+		}
+	}
+
+	if (_nmodules == _capacity)
+	{
+		_modules = (module_t**) _af.realloc (_modules, (_capacity + 16) * sizeof(module_t*));
+		assert (_modules != nullptr);
+		_capacity += 16;
+	}
+	m->index = _nmodules;
+	_modules[_nmodules++] = m;
+
+	DBG("Registered module #%u %s (base %lx, %u segments, %u bytes of build-id)\n",
+	  m->index, m->name, m->base, m->nsegments, m->build_id_len);
+
+	return m;
+}
+
+int ModuleRegistry::dl_iterate_phdr_cb (struct dl_phdr_info *info, size_t, void *data)
+{
+	ModuleRegistry *r = (ModuleRegistry*) data;
+	ModuleRegistry::module_t *m = r->add (info);
+	if (m != nullptr)
+		m->seen = true;
+	return 0;
+}
+
+// Rescans the loaded modules. Registers new modules and retires those that
+// are no longer loaded. Returns the number of modules that changed.
+unsigned ModuleRegistry::refresh (void)
+{
+	unsigned prev_nmodules = _nmodules;
+	unsigned nretired = 0;
+
+	for (unsigned u = 0; u < _nmodules; ++u)
+		_modules[u]->seen = false;
+
+	dl_iterate_phdr (dl_iterate_phdr_cb, this);
+
+	for (unsigned u = 0; u < prev_nmodules; ++u)
+		if (_modules[u]->loaded && !_modules[u]->seen)
+		{
+			_modules[u]->loaded = false;
+			nretired++;
+			DBG("Retired module #%u %s (base %lx)\n", u, _modules[u]->name,
+			  _modules[u]->base);
+		}
+
+	VERBOSE_MSG(2, "Module registry knows about %u modules (%u new, %u retired).\n",
+	  _nmodules, _nmodules - prev_nmodules, nretired);
+
+	return (_nmodules - prev_nmodules) + nretired;
+}
+
+const char * ModuleRegistry::realname (module_t *m)
+{
+	if (m->realname == nullptr)
+	{
+		char buf[PATH_MAX] = {0};
+		const char *p = buf;
+		if (realpath (m->name, buf) == nullptr)
+		{
+			VERBOSE_MSG (1, "Warning! Could not get realpath of %s (from loaded modules)\n", m->name);
+			p = m->name;
+		}
+		size_t len = strlen (p);
+		m->realname = (char*) _af.malloc (len+1);
+		assert (m->realname != nullptr);
+		memcpy (m->realname, p, len+1);
+	}
+	return m->realname;
+}
+
+bool ModuleRegistry::contains (const module_t *m, uintptr_t address)
+{
+	for (unsigned s = 0; s < m->nsegments; ++s)
+		if (m->segments[s].start <= address && address < m->segments[s].end)
+			return true;
+	return false;
+}
+
+const ModuleRegistry::module_t * ModuleRegistry::find_by_address (uintptr_t address) const
+{
+	for (unsigned u = 0; u < _nmodules; ++u)
+		if (_modules[u]->loaded && contains (_modules[u], address))
+			return _modules[u];
+	return nullptr;
+}
+
+const ModuleRegistry::module_t * ModuleRegistry::find_by_path (const char *path)
+{
+	char buf[PATH_MAX] = {0};
+	const char *p = buf;
+	if (realpath (path, buf) == nullptr)
+	{
+		VERBOSE_MSG (1, "Warning! Could not get realpath of %s (from location)\n", path);
+		p = path;
+	}
+
+	for (unsigned u = 0; u < _nmodules; ++u)
+		if (_modules[u]->loaded && strcmp (realname (_modules[u]), p) == 0)
+			return _modules[u];
+	return nullptr;
+}
+
+// Checks whether module m corresponds to the given (already resolved) path
+bool ModuleRegistry::is_module (const module_t *m, const char *realpath)
+{
+	return strcmp (realname (const_cast<module_t*>(m)), realpath) == 0;
+}
+
+const ModuleRegistry::module_t * ModuleRegistry::find_by_build_id (const uint8_t *build_id, unsigned len) const
+{
+	for (unsigned u = 0; u < _nmodules; ++u)
+		if (_modules[u]->loaded && _modules[u]->build_id_len == len && memcmp (_modules[u]->build_id, build_id, len) == 0)
+			return _modules[u];
+	return nullptr;
+}
+
+// Translate an offset within the module file into a relocated address. Only
+// executable segments are considered, as these hold the callstack frames.
+bool ModuleRegistry::file_offset_to_address (const module_t *m, size_t offset, uintptr_t &address)
+{
+	for (unsigned s = 0; s < m->nsegments; ++s)
+	{
+		const segment_t *seg = &m->segments[s];
+		if (seg->exec && seg->offset <= offset && offset < seg->offset + seg->filesz)
+		{
+			address = seg->start + (offset - seg->offset);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ModuleRegistry::file_offset_to_address (const char *path, size_t offset, uintptr_t &address)
+{
+	const module_t *m = find_by_path (path);
+	if (m == nullptr)
+		return false;
+	return file_offset_to_address (m, offset, address);
+}
+
+// Translate a symbol exported by the module (i.e. in its dynamic symbol table)
+// into its relocated address.
+bool ModuleRegistry::symbol_to_address (const module_t *m, const char *symbol, uintptr_t &address)
+{
+	uintptr_t a = elf_lookup_dynamic_symbol (m->dynamic, m->base, symbol);
+	if (a == 0)
+		return false;
+	address = a;
+	return true;
+}
+
+// Parse a build-id given as an hexadecimal string. Returns false if the
+// string does not look like a build-id.
+bool ModuleRegistry::build_id_from_string (const char *str, uint8_t *build_id, unsigned &len)
+{
+	size_t slen = strlen (str);
+	if (slen == 0 || (slen % 2) != 0 || slen > 2*MAX_BUILD_ID_SZ)
+		return false;
+
+	for (size_t c = 0; c < slen; ++c)
+		if (!isxdigit (str[c]))
+			return false;
+
+	for (size_t b = 0; b < slen/2; ++b)
+	{
+		char hex[3] = { str[2*b], str[2*b+1], '\0' };
+		build_id[b] = (uint8_t) strtoul (hex, nullptr, 16);
+	}
+	len = slen/2;
+	return true;
+}
+
+void ModuleRegistry::build_id_to_string (const module_t *m, char *buf, size_t len)
+{
+	assert (len > 0);
+	buf[0] = '\0';
+	for (unsigned b = 0; b < m->build_id_len && 2*b+2 < len; ++b)
+		snprintf (&buf[2*b], 3, "%02x", m->build_id[b]);
+}
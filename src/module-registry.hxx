@@ -0,0 +1,82 @@
+// License: To determine
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <link.h>
+
+#include "common.hxx"
+
+// Registry of the modules (main binary and shared objects) loaded in the
+// process. It is fed from dl_iterate_phdr(), so it learns about the load base,
+// the PT_LOAD segments and the build-id of each module directly from the
+// dynamic loader instead of parsing /proc/self/maps. Calling refresh() again
+// only registers the modules that were not known yet and retires the ones
+// that are gone. Retired entries are kept (but never matched) so pointers
+// handed out by the registry remain valid.
+class ModuleRegistry
+{
+	public:
+	static const unsigned MAX_SEGMENTS = 8;
+	static const unsigned MAX_BUILD_ID_SZ = 64;
+
+	typedef struct segment_st
+	{
+		uintptr_t start;   // relocated address of the segment
+		uintptr_t end;     // relocated address of the end of the segment
+		size_t    offset;  // file offset of the segment
+		size_t    filesz;  // bytes of the segment backed by the file
+		bool      exec;
+	} segment_t;
+
+	typedef struct module_st
+	{
+		char      *name;     // path given by the dynamic loader
+		char      *realname; // realpath of name, computed on demand
+		uintptr_t base;      // load bias (dlpi_addr)
+		const ElfW(Dyn) *dynamic; // relocated PT_DYNAMIC, if any
+		segment_t segments[MAX_SEGMENTS];
+		unsigned  nsegments;
+		uint8_t   build_id[MAX_BUILD_ID_SZ];
+		unsigned  build_id_len;
+		unsigned  index;
+		bool      loaded;
+		bool      seen;      // used while refreshing
+	} module_t;
+
+	private:
+	const allocation_functions_t _af;
+	module_t **_modules;
+	unsigned   _nmodules;
+	unsigned   _capacity;
+
+	static int dl_iterate_phdr_cb (struct dl_phdr_info *info, size_t size, void *data);
+	module_t * find_by_base (const char *name, uintptr_t base) const;
+	module_t * add (struct dl_phdr_info *info);
+	const char * realname (module_t *m);
+
+	public:
+	ModuleRegistry (allocation_functions_t &);
+	~ModuleRegistry ();
+
+	unsigned refresh (void);
+
+	unsigned count (void) const
+	  { return _nmodules; };
+	const module_t * get (unsigned u) const
+	  { return u < _nmodules ? _modules[u] : nullptr; };
+
+	const module_t * find_by_address (uintptr_t address) const;
+	const module_t * find_by_path (const char *path);
+	bool is_module (const module_t *m, const char *realpath);
+	const module_t * find_by_build_id (const uint8_t *build_id, unsigned len) const;
+	static bool file_offset_to_address (const module_t *m, size_t offset, uintptr_t &address);
+	bool file_offset_to_address (const char *path, size_t offset, uintptr_t &address);
+
+	static bool symbol_to_address (const module_t *m, const char *symbol, uintptr_t &address);
+	static bool build_id_from_string (const char *str, uint8_t *build_id, unsigned &len);
+
+	static bool contains (const module_t *m, uintptr_t address);
+	static void build_id_to_string (const module_t *m, char *buf, size_t len);
+};
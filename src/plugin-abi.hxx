@@ -0,0 +1,14 @@
+// License: To determine
+
+#pragma once
+
+// Version of the interface between FlexMalloc and the allocator plugins,
+// installed with the headers needed to build them in place of the
+// configuration of the build.
+//
+// The ABI version is to be increased whenever the layout of Allocator,
+// AllocatorStatistics or Options, or the set or the contract of Allocator
+// virtual methods (e.g. calloc returning zeroed memory), changes.
+
+#define FLEXMALLOC_PLUGIN_ABI_VERSION 6
+#define FLEXMALLOC_PLUGIN_SYMBOL "flexmalloc_allocator_plugin"
@@ -0,0 +1,270 @@
+// License: To determine
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "prefault.hxx"
+
+Prefaulter * Prefaulter::_instance = nullptr;
+
+Prefaulter::Prefaulter (prefault_mode_t mode)
+  : _mode(mode), _page_size (sysconf (_SC_PAGESIZE)), _nruns(0), _ncpus(0),
+    _nthreads(0), _generation(0), _nbusy(0), _start(nullptr), _length(0),
+    _zero(false), _node(-1), _next_chunk(0), _nfills(0), _nzeroed(0), _bytes(0), _time(0)
+{
+	pthread_mutex_init (&_mtx, nullptr);
+	pthread_cond_init (&_work, nullptr);
+	pthread_cond_init (&_done, nullptr);
+	read_topology ();
+}
+
+Prefaulter::~Prefaulter ()
+{
+}
+
+// Learns the node of each CPU from sysfs and the sequence of nodes the
+// allowed CPUs belong to
+void Prefaulter::read_topology (void)
+{
+	for (unsigned c = 0; c < MAX_CPUS; ++c)
+		_cpu_node[c] = -1;
+
+	for (unsigned n = 0; n < MAX_NODES; ++n)
+	{
+		char path[128];
+		snprintf (path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", n);
+		FILE *f = fopen (path, "r");
+		if (f == nullptr)
+			continue;
+		char list[4096];
+		if (fgets (list, sizeof(list), f) != nullptr)
+		{
+			// Ranges of CPUs, e.g. 0-3,8-11
+			char *p = list;
+			while (*p >= '0' && *p <= '9')
+			{
+				unsigned long first = strtoul (p, &p, 10), last = first;
+				if (*p == '-')
+					last = strtoul (p+1, &p, 10);
+				for (unsigned long c = first; c <= last && c < MAX_CPUS; ++c)
+					_cpu_node[c] = n;
+				if (*p == ',')
+					p++;
+			}
+		}
+		fclose (f);
+	}
+
+	cpu_set_t allowed;
+	if (sched_getaffinity (0, sizeof(allowed), &allowed) != 0)
+		return;
+	for (unsigned c = 0; c < MAX_CPUS && c < CPU_SETSIZE; ++c)
+		if (CPU_ISSET(c, &allowed))
+		{
+			if (_nruns > 0 && _runs[_nruns-1].node == _cpu_node[c])
+				_runs[_nruns-1].ncpus++;
+			else
+			{
+				_runs[_nruns].node = _cpu_node[c];
+				_runs[_nruns].ncpus = 1;
+				_nruns++;
+			}
+			_ncpus++;
+		}
+}
+
+bool Prefaulter::start (unsigned nthreads)
+{
+	nthreads = MIN(nthreads, MAX_THREADS);
+	if (_ncpus > 0)
+		nthreads = MIN(nthreads, _ncpus);
+
+	for (unsigned u = 0; u < nthreads; ++u)
+		if (pthread_create (&_threads[_nthreads], nullptr, worker, this) == 0)
+			_nthreads++;
+	if (_nthreads == 0)
+	{
+		VERBOSE_MSG(0, "Warning! Could not create the pre-faulting threads. Objects will not be pre-faulted.\n");
+		return false;
+	}
+
+	_instance = this;
+	pthread_atfork (atfork_prepare, atfork_parent, atfork_child);
+
+	VERBOSE_MSG(0, "Objects will be pre-faulted by %u threads with %s first touch.\n",
+	  _nthreads, _mode == PREFAULT_SPREAD ? "spread" : "local");
+	return true;
+}
+
+// A fork waits for the workers to finish the current fill, if any, and
+// holds the pool until the child is created
+void Prefaulter::atfork_prepare (void)
+{
+	pthread_mutex_lock (&_instance->_mtx);
+	while (_instance->_nbusy > 0)
+		pthread_cond_wait (&_instance->_done, &_instance->_mtx);
+}
+
+void Prefaulter::atfork_parent (void)
+{
+	pthread_mutex_unlock (&_instance->_mtx);
+}
+
+// Only the forking thread exists in the child
+void Prefaulter::atfork_child (void)
+{
+	pthread_mutex_init (&_instance->_mtx, nullptr);
+	pthread_cond_init (&_instance->_work, nullptr);
+	pthread_cond_init (&_instance->_done, nullptr);
+	_instance->_nthreads = 0;
+	_instance->_nbusy = 0;
+}
+
+// Node whose pages hold offset within the current fill (or -1 if unknown)
+// and the offset where the next node starts
+int Prefaulter::node_at (size_t offset, size_t &end) const
+{
+	end = _length;
+	if (_mode != PREFAULT_SPREAD || _nruns == 0)
+		return _node;
+
+	// Runs of CPUs take parts of the object proportional to their number
+	// of CPUs, at page boundaries
+	unsigned cpus = 0;
+	for (unsigned r = 0; r < _nruns; ++r)
+	{
+		cpus += _runs[r].ncpus;
+		size_t run_end = (_length / _ncpus * cpus + _length % _ncpus * cpus / _ncpus) & ~(_page_size - 1);
+		if (r == _nruns - 1 || offset < run_end)
+		{
+			if (r < _nruns - 1)
+				end = run_end;
+			return _runs[r].node;
+		}
+	}
+	return -1;
+}
+
+// Fills the chunk at offset. Unless policy_node is null, the calling thread
+// first touches each part with a preferred policy on its node, and
+// policy_node tracks the node its policy currently prefers.
+void Prefaulter::fill_chunk (size_t offset, int *policy_node)
+{
+	size_t end = MIN(offset + CHUNK_SZ, _length);
+	while (offset < end)
+	{
+		size_t node_end;
+		int node = node_at (offset, node_end);
+		node_end = MIN(node_end, end);
+
+		if (policy_node != nullptr && node != *policy_node)
+		{
+			unsigned long mask = node >= 0 ? 1UL << node : 0;
+			// The kernel expects the number of bits in the mask plus one
+			if (node >= 0)
+				syscall (SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask)*8 + 1);
+			else
+				syscall (SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+			*policy_node = node;
+		}
+
+		char *s = _start + offset, *e = _start + node_end;
+		if (_zero)
+			::memset (s, 0, e - s);
+		else
+			// Contents are either zero or undefined, so writing a zero in
+			// every page keeps them
+			for (char *p = s; p < e; p = (char*) (((uintptr_t) p + _page_size) & ~(_page_size - 1)))
+				*(volatile char*) p = 0;
+		offset = node_end;
+	}
+}
+
+void * Prefaulter::worker (void *p)
+{
+	((Prefaulter*) p)->worker_loop();
+	return nullptr;
+}
+
+void Prefaulter::worker_loop (void)
+{
+	unsigned generation = 0;
+	int policy_node = -1;
+	while (true)
+	{
+		pthread_mutex_lock (&_mtx);
+		while (_generation == generation)
+			pthread_cond_wait (&_work, &_mtx);
+		generation = _generation;
+		pthread_mutex_unlock (&_mtx);
+
+		size_t nchunks = (_length + CHUNK_SZ - 1) / CHUNK_SZ;
+		size_t c;
+		while ((c = __sync_fetch_and_add (&_next_chunk, 1)) < nchunks)
+			fill_chunk (c * CHUNK_SZ, &policy_node);
+
+		pthread_mutex_lock (&_mtx);
+		// Both the filling thread and a fork may be waiting
+		if (--_nbusy == 0)
+			pthread_cond_broadcast (&_done);
+		pthread_mutex_unlock (&_mtx);
+	}
+}
+
+void Prefaulter::fill (void *p, size_t size, bool zero)
+{
+	if (p == nullptr || size == 0)
+		return;
+
+	uint64_t t = options.getTime();
+
+	pthread_mutex_lock (&_mtx);
+	_start = (char*) p;
+	_length = size;
+	_zero = zero;
+	_node = -1;
+	if (_mode == PREFAULT_LOCAL)
+	{
+		int cpu = sched_getcpu();
+		if (cpu >= 0 && cpu < (int) MAX_CPUS)
+			_node = _cpu_node[cpu];
+	}
+	_next_chunk = 0;
+	if (_nthreads > 0)
+	{
+		_nbusy = _nthreads;
+		_generation++;
+		pthread_cond_broadcast (&_work);
+		while (_nbusy > 0)
+			pthread_cond_wait (&_done, &_mtx);
+	}
+	else
+		// The memory policy of the calling thread belongs to the application
+		for (size_t offset = 0; offset < size; offset += CHUNK_SZ)
+			fill_chunk (offset, nullptr);
+	pthread_mutex_unlock (&_mtx);
+
+	_nfills++;
+	if (zero)
+		_nzeroed++;
+	_bytes += size;
+	_time += options.getTime() - t;
+}
+
+void Prefaulter::show_statistics (void) const
+{
+	if (_nfills == 0)
+		return;
+
+	double seconds = (double) _time / 1000000000.0;
+	VERBOSE_MSG(1, "Pre-faulting: %llu objects (%llu zeroed), %llu MBytes in %.3f seconds (%.2f GBytes/s) on %u threads.\n",
+	  _nfills, _nzeroed, _bytes >> 20, seconds, seconds > 0 ? (double) _bytes / seconds / 1e9 : 0.0, _nthreads);
+}
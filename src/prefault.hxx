@@ -0,0 +1,82 @@
+// License: To determine
+
+#pragma once
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "common.hxx"
+
+// Pool of worker threads that pre-fault (or zero) large objects as soon as
+// they are allocated, so that the page faults are taken in parallel rather
+// than by the first thread touching them. The pages are first touched with
+// a preferred memory policy on the node of the allocating thread (local) or
+// on the nodes of the CPUs the process runs on (spread), where consecutive
+// parts of the object go to consecutive CPUs as with an OpenMP static
+// schedule. Memory placed by an allocator through a memory policy of its
+// own keeps that policy, as it takes precedence over the one of the thread.
+class Prefaulter
+{
+	private:
+	static const unsigned MAX_THREADS = 64;
+	static const unsigned MAX_NODES = 64;
+	static const unsigned MAX_CPUS = 1024;
+	static const size_t CHUNK_SZ = 8UL << 20; // unit of work, multiple of THP_PAGE_SIZE
+
+	typedef struct
+	{
+		int node;
+		unsigned ncpus;
+	} run_t;
+
+	const prefault_mode_t _mode;
+	const size_t _page_size;
+	short _cpu_node[MAX_CPUS];  // node of each CPU, or -1
+	run_t _runs[MAX_CPUS];      // nodes of the allowed CPUs, in CPU order
+	unsigned _nruns;
+	unsigned _ncpus;            // allowed CPUs
+
+	pthread_t _threads[MAX_THREADS];
+	unsigned _nthreads;
+
+	// Current fill, published to the workers under _mtx
+	pthread_mutex_t _mtx;
+	pthread_cond_t _work;
+	pthread_cond_t _done;
+	unsigned _generation;
+	unsigned _nbusy;
+	char *_start;
+	size_t _length;
+	bool _zero;
+	int _node;
+	volatile size_t _next_chunk;
+
+	unsigned long long _nfills;
+	unsigned long long _nzeroed;
+	unsigned long long _bytes;
+	uint64_t _time; // ns
+
+	static Prefaulter *_instance; // the one whose threads are running
+
+	void read_topology (void);
+	int node_at (size_t offset, size_t &end) const;
+	void fill_chunk (size_t offset, int *policy_node);
+	static void * worker (void *);
+	void worker_loop (void);
+	static void atfork_prepare (void);
+	static void atfork_parent (void);
+	static void atfork_child (void);
+
+	public:
+	Prefaulter (prefault_mode_t mode);
+	~Prefaulter ();
+
+	// Creates the threads. A child of a fork has none of them, so it fills
+	// the objects itself.
+	bool start (unsigned nthreads);
+	// Touches every page of [p, p+size), or clears it if zero is given, and
+	// returns once done. Fills are expected one at a time, as the FlexMalloc
+	// calls are serialized.
+	void fill (void *p, size_t size, bool zero);
+	void show_statistics (void) const;
+};
@@ -0,0 +1,85 @@
+// vim: set nowrap
+// vim: set tabstop=4
+
+// License: To determine
+
+// rtld-audit library (to be given in LD_AUDIT next to LD_PRELOAD). The
+// dynamic loader notifies this library whenever a module is mapped or about
+// to be unmapped (including the dependencies of dlopen'ed libraries, and the
+// effective unload of dlclose'd ones), and the events are forwarded to
+// libflexmalloc so that it refreshes its module registry and relocates the
+// code locations. This library runs in its own link-map namespace, so it
+// must not rely on libflexmalloc or on the application allocator.
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <stdint.h>
+#include <link.h>
+
+#include "elf-symbols.hxx"
+
+typedef void (*rtld_event_t)(const char *, uintptr_t);
+
+static struct link_map *flexmalloc_map = nullptr;
+static rtld_event_t flexmalloc_objopen = nullptr;
+static rtld_event_t flexmalloc_objclose = nullptr;
+
+// The interface this library is built against is used, as long as the
+// loader supports it; otherwise the library is not loaded
+extern "C" unsigned la_version (unsigned version)
+{
+	return version >= LAV_CURRENT ? LAV_CURRENT : 0;
+}
+
+extern "C" unsigned la_objopen (struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
+{
+	*cookie = (uintptr_t) map;
+
+	// Only the modules from the application namespace are interesting
+	if (lmid != LM_ID_BASE)
+		return 0;
+
+	if (flexmalloc_map == nullptr && map->l_name != nullptr &&
+	    strstr (map->l_name, "/libflexmalloc") != nullptr)
+		flexmalloc_map = map;
+	else if (flexmalloc_objopen != nullptr)
+		flexmalloc_objopen (map->l_name, map->l_addr);
+
+	// No symbol binding needs to be audited
+	return 0;
+}
+
+// Called once all the modules needed at startup have been loaded and
+// relocated. Before this point libflexmalloc cannot be called, and it learns
+// about these modules by itself.
+extern "C" void la_preinit (uintptr_t *)
+{
+	if (flexmalloc_map != nullptr)
+	{
+		// dlsym() is not reliable when invoked from the audit namespace on a
+		// module of the application namespace, so look the symbols up directly
+		flexmalloc_objopen = (rtld_event_t) elf_lookup_dynamic_symbol (
+		  flexmalloc_map->l_ld, flexmalloc_map->l_addr, "flexmalloc_rtld_objopen");
+		flexmalloc_objclose = (rtld_event_t) elf_lookup_dynamic_symbol (
+		  flexmalloc_map->l_ld, flexmalloc_map->l_addr, "flexmalloc_rtld_objclose");
+	}
+}
+
+extern "C" unsigned la_objclose (uintptr_t *cookie)
+{
+	struct link_map *map = (struct link_map*) *cookie;
+
+	// Stop forwarding events if libflexmalloc itself goes away
+	if (map == flexmalloc_map)
+	{
+		flexmalloc_objopen = nullptr;
+		flexmalloc_objclose = nullptr;
+	}
+	else if (flexmalloc_objclose != nullptr)
+		flexmalloc_objclose (map->l_name, map->l_addr);
+
+	return 0;
+}
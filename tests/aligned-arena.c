@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Allocates and frees aligned objects of many sizes and alignments, along
+// with zero-sized ones, in a loop whose live objects never exceed a small
+// part of the tier. Any capacity not given back on free accumulates and
+// eventually exhausts it.
+
+#define LIVE 64
+
+int main (int argc, char *argv[])
+{
+	void *live[LIVE] = { NULL };
+	int rounds = argc > 1 ? atoi (argv[1]) : 20000;
+	int i;
+
+	for (i = 0; i < rounds; ++i)
+	{
+		int slot = i % LIVE;
+		size_t align = (size_t) 16 << (i % 13);  // 16 bytes to 64 KBytes
+		size_t size = (i * 7919) % 20000;
+
+		free (live[slot]);
+		if (i % 5 == 0)
+			live[slot] = malloc (0);
+		else if (posix_memalign (&live[slot], align, size) != 0)
+		{
+			fprintf (stderr, "posix_memalign (%zu, %zu) failed\n", align, size);
+			return 1;
+		}
+		else if ((size_t) live[slot] % align != 0)
+		{
+			fprintf (stderr, "%p is not aligned to %zu\n", live[slot], align);
+			return 1;
+		}
+		else
+			memset (live[slot], i, size);
+	}
+	for (i = 0; i < LIVE; ++i)
+		free (live[i]);
+
+	fprintf (stderr, "aligned-arena: done\n");
+	return 0;
+}
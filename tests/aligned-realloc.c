@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Allocates aligned objects from every alignment up to 1 MByte, grows and
+// shrinks them through realloc checking that their contents are kept, and
+// frees them. With "invalid", it then frees an address within an object,
+// which was never returned by the allocator and must abort the program.
+
+#define NALIGNS 17
+
+static int check (const char *p, size_t size, int c)
+{
+	size_t i;
+	for (i = 0; i < size; ++i)
+		if (p[i] != (char) c)
+			return 1;
+	return 0;
+}
+
+int main (int argc, char *argv[])
+{
+	void *objs[NALIGNS];
+	int i;
+
+	for (i = 0; i < NALIGNS; ++i)
+	{
+		size_t align = (size_t) 16 << i;  // 16 bytes to 1 MByte
+		size_t size = 1000 + i * 4096;
+		char *p;
+
+		if (posix_memalign (&objs[i], align, size) != 0 || (size_t) objs[i] % align != 0)
+		{
+			fprintf (stderr, "posix_memalign (%zu, %zu) failed\n", align, size);
+			return 1;
+		}
+		memset (objs[i], i, size);
+
+		if ((p = realloc (objs[i], 4 * size)) == NULL || check (p, size, i) != 0)
+		{
+			fprintf (stderr, "growing the object aligned to %zu failed\n", align);
+			return 1;
+		}
+		memset (p, i, 4 * size);
+		if ((p = realloc (p, size / 2)) == NULL || check (p, size / 2, i) != 0)
+		{
+			fprintf (stderr, "shrinking the object aligned to %zu failed\n", align);
+			return 1;
+		}
+		objs[i] = p;
+	}
+	for (i = 0; i < NALIGNS; ++i)
+		free (objs[i]);
+
+	fprintf (stderr, "aligned-realloc: done\n");
+
+	if (argc > 1 && strcmp (argv[1], "invalid") == 0)
+	{
+		char *p = malloc (64);
+		free ((void*) ((uintptr_t) p + 16));
+	}
+	return 0;
+}
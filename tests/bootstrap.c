@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+// Reallocates and frees, once FlexMalloc is initialized, the objects that
+// the constructor of its dependency allocated before (see early.c).
+
+#define MB (1 << 20)
+
+extern char *early_small, *early_large, *early_grown;
+
+static int check (const char *p, size_t size, char c)
+{
+	size_t i;
+	for (i = 0; i < size; i++)
+		if (p[i] != c)
+			return 1;
+	return 0;
+}
+
+int main (void)
+{
+	if (early_small == NULL || early_large == NULL || early_grown == NULL)
+	{
+		fprintf (stderr, "early allocation failed\n");
+		return 1;
+	}
+	if (check (early_small, 100, 's') != 0 || check (early_large, MB, 'l') != 0 ||
+	    check (early_grown, 4000, 'g') != 0 || malloc_usable_size (early_grown) < 4000)
+	{
+		fprintf (stderr, "early objects corrupted\n");
+		return 1;
+	}
+
+	// Shrinking leaves the object in place, growing moves it out
+	if (realloc (early_grown, 100) != early_grown)
+	{
+		fprintf (stderr, "shrinking an early object moved it\n");
+		return 1;
+	}
+	if ((early_large = realloc (early_large, 4 * MB)) == NULL ||
+	    check (early_large, MB, 'l') != 0)
+	{
+		fprintf (stderr, "growing an early object failed\n");
+		return 1;
+	}
+
+	free (early_small);
+	free (early_large);
+	free (early_grown);
+
+	fprintf (stderr, "bootstrap: done\n");
+	return 0;
+}
@@ -0,0 +1,35 @@
+#include <stdlib.h>
+#include <string.h>
+
+// Allocates objects from a constructor that runs before the one of
+// FlexMalloc, as this library is a dependency of the program and FlexMalloc
+// is preloaded. The objects are served by the bootstrap arena, and the
+// program reallocates and frees them once FlexMalloc is initialized.
+
+#define MB (1 << 20)
+
+char *early_small, *early_large, *early_grown;
+
+static void fill (char *p, size_t size, char c)
+{
+	memset (p, c, size);
+}
+
+static void __attribute__((constructor)) early (void)
+{
+	char *freed;
+
+	if ((early_small = malloc (100)) != NULL)
+		fill (early_small, 100, 's');
+	if ((early_large = calloc (1, MB)) != NULL)
+		fill (early_large, MB, 'l');
+
+	// Freed while it is the last object, and grown in place for the
+	// same reason
+	if ((freed = malloc (64)) != NULL)
+		free (freed);
+	if ((early_grown = malloc (1000)) != NULL)
+		early_grown = realloc (early_grown, 4000);
+	if (early_grown != NULL)
+		fill (early_grown, 4000, 'g');
+}
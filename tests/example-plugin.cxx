@@ -0,0 +1,133 @@
+// Minimal allocator plugin, built only against the installed headers. It
+// serves its objects through the libc functions that FlexMalloc gives it,
+// with their header in front of them, and counts the objects still alive
+// when the process ends.
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "allocator-plugin.hxx"
+
+class AllocatorExample final : public Allocator
+{
+	private:
+	AllocatorStatistics _stats;
+	unsigned long long _nlive;
+
+	public:
+	AllocatorExample (allocation_functions_t &af, Allocators *)
+	  : Allocator (af), _nlive (0)
+	{ }
+
+	const char * name (void) const
+	  { return "example"; }
+	const char * description (void) const
+	  { return "Example plugin based on the libc"; }
+
+	void * malloc (size_t size)
+	{
+		void *base = _af.malloc (Allocator::getTotalSize (size));
+		if (base == nullptr)
+			return nullptr;
+		_stats.record_malloc (size);
+		_nlive++;
+		return Allocator::generateAllocatorHeader (base, this, size);
+	}
+
+	void * calloc (size_t nmemb, size_t size)
+	{
+		void *res = this->malloc (nmemb * size);
+		if (res != nullptr)
+			::memset (res, 0, nmemb * size);
+		return res;
+	}
+
+	int posix_memalign (void **ptr, size_t align, size_t size)
+	{
+		void *base = _af.malloc (Allocator::getTotalSize (size + align));
+		if (base == nullptr)
+			return ENOMEM;
+		_stats.record_aligned_malloc (size + align);
+		_nlive++;
+		*ptr = Allocator::generateAllocatorHeaderOnAligned (base, align, this, size);
+		return 0;
+	}
+
+	void free (void *ptr)
+	{
+		Allocator::Header_t *hdr = Allocator::getAllocatorHeader (ptr);
+		void *base = hdr->base_ptr();
+		_stats.record_free (hdr->size());
+		_nlive--;
+		Allocator::releaseAllocatorHeader (ptr);
+		_af.free (base);
+	}
+
+	void * realloc (void *ptr, size_t size)
+	{
+		if (ptr == nullptr)
+		{
+			_stats.record_realloc_forward_malloc ();
+			return this->malloc (size);
+		}
+		size_t prev_size = Allocator::getAllocatorHeader (ptr)->size();
+		if (size <= prev_size)
+			return ptr;
+		void *res = this->malloc (size);
+		if (res != nullptr)
+		{
+			::memcpy (res, ptr, prev_size);
+			this->free (ptr);
+		}
+		_stats.record_realloc (size, prev_size);
+		return res;
+	}
+
+	size_t malloc_usable_size (void *ptr)
+	  { return Allocator::getAllocatorHeader (ptr)->size(); }
+	void * memcpy (void *dest, const void *src, size_t n)
+	  { return ::memcpy (dest, src, n); }
+
+	void configure (const char *config)
+	{
+		unsigned long long s;
+		if (sscanf (config, "Size %llu MBytes", &s) != 1)
+		{
+			VERBOSE_MSG(0, "example: Wrong configuration for the allocator. Available options include:\n"
+			               " Size <NUM> MBytes\n");
+			exit (1);
+		}
+		size (s << 20);
+		_is_ready = true;
+	}
+
+	void show_statistics (void) const
+	{
+		_stats.show_statistics ("example", true);
+		VERBOSE_MSG(1, "example: %llu objects still alive.\n", _nlive);
+	}
+
+	bool fits (size_t s) const
+	  { return _stats.water_mark() + s <= this->size(); }
+	size_t hwm (void) const
+	  { return _stats.water_mark(); }
+	void record_unfitted_malloc (size_t s)
+	  { _stats.record_unfitted_malloc (s); }
+	void record_unfitted_calloc (size_t s)
+	  { _stats.record_unfitted_calloc (s); }
+	void record_unfitted_aligned_malloc (size_t s)
+	  { _stats.record_unfitted_aligned_malloc (s); }
+	void record_unfitted_realloc (size_t s)
+	  { _stats.record_unfitted_realloc (s); }
+	void record_source_realloc (size_t s)
+	  { _stats.record_source_realloc (s); }
+	void record_target_realloc (size_t s)
+	  { _stats.record_target_realloc (s); }
+	void record_self_realloc (size_t s)
+	  { _stats.record_self_realloc (s); }
+	void record_realloc_forward_malloc (void)
+	  { _stats.record_realloc_forward_malloc (); }
+};
+
+FLEXMALLOC_ALLOCATOR_PLUGIN(AllocatorExample)
@@ -0,0 +1,94 @@
+# Helpers sourced by the test scripts, which run the test programs under
+# FlexMalloc and inspect the statistics it reports at exit. The objects are
+# routed to the tier under test by making it the fallback allocator, so the
+# locations do not depend on the build of the programs. The location that
+# matches none of them is kept even if it names the fallback allocator, so
+# that the objects still go through FlexMalloc. Tests that need locations of
+# their own give their file in $locations.
+
+: ${srcdir:=.}
+: ${FLEXMALLOC_LIB:=../src/.libs/libflexmalloc.so}
+
+# Exit status that makes automake report a test as skipped
+SKIP=77
+
+fail ()
+{
+	echo "$out"
+	echo "FAIL: $*"
+	exit 1
+}
+
+skip ()
+{
+	echo "SKIP: $*"
+	exit $SKIP
+}
+
+# run definitions fallback program [args...]
+#   runs program with the tier named fallback serving its objects, leaving
+#   its output (and FlexMalloc's) in $out and its exit status in $status.
+#   Definitions are taken from srcdir unless given by an absolute path.
+run ()
+{
+	local definitions=$1 fallback=$2
+	shift 2
+	case $definitions in
+		/*) ;;
+		*) definitions=$srcdir/$definitions ;;
+	esac
+	out=$(env FLEXMALLOC_DEFINITIONS=$definitions \
+	  FLEXMALLOC_LOCATIONS=${locations:-$srcdir/no-locations} \
+	  FLEXMALLOC_FALLBACK_ALLOCATOR=$fallback \
+	  FLEXMALLOC_IGNORE_LOCATIONS_ON_FALLBACK_ALLOCATOR=no \
+	  FLEXMALLOC_VERBOSE=${FLEXMALLOC_VERBOSE:-1} \
+	  LD_PRELOAD=$FLEXMALLOC_LIB "$@" 2>&1)
+	status=$?
+}
+
+# expect pattern: fails unless the output of the last run matches pattern
+expect ()
+{
+	echo "$out" | grep -q -e "$1" || fail "expected '$1'"
+}
+
+# reject pattern: fails if the output of the last run matches pattern
+reject ()
+{
+	echo "$out" | grep -q -e "$1" && fail "unexpected '$1'"
+	return 0
+}
+
+# succeeded: fails unless the last run exited successfully
+succeeded ()
+{
+	[ $status -eq 0 ] || fail "exit status $status"
+	reject "Assertion\|Segmentation\|Aborted"
+}
+
+# Whether the kernel lets the process bind memory to NUMA node 0
+have_numa ()
+{
+	[ -d /sys/devices/system/node/node0 ]
+}
+
+# definitions tier configuration: writes to the file definitions, in the
+#   current directory, the posix tier and the given configuration of tier
+definitions ()
+{
+	printf "# Memory configuration for allocator posix\nSize 4096 MBytes\n" > $1
+	printf "# Memory configuration for allocator %s\n%s\n" "$2" "$3" >> $1
+}
+
+# call_location program function callee: prints the raw location of the
+#   call to callee within function of program, i.e. the offset of its return
+#   address from the symbol of function, which program must export
+call_location ()
+{
+	local call next start
+	call=$(objdump -d $1 | awk -v f="<$2>:" -v c="<$3@plt>" '$2 == f { in_f = 1 } in_f && $0 ~ "call.*" c { print $1; exit }')
+	next=$(objdump -d $1 | awk -v c="$call" 'f { print $1; exit } $1 == c { f = 1 }')
+	start=$(nm $1 | awk -v f="$2" '$3 == f { print $1 }')
+	[ -n "$call" -a -n "$next" -a -n "$start" ] || return 1
+	printf "%s!%s+%x\n" "$(cd $(dirname $1) && pwd)/$(basename $1)" $2 $(( 0x${next%:} - 0x$start ))
+}
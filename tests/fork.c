@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Allocates large objects before and after a fork, in both processes. The
+// child has none of the helper threads FlexMalloc started in the parent,
+// and it is killed if it waits for them.
+
+#define SIZE (64 << 20)
+
+static int allocate (const char *who)
+{
+	char *p = malloc (SIZE);
+	if (p == NULL)
+	{
+		fprintf (stderr, "%s: malloc failed\n", who);
+		return 1;
+	}
+	memset (p, 1, SIZE);
+	free (p);
+	return 0;
+}
+
+int main (void)
+{
+	int status;
+	pid_t pid;
+
+	if (allocate ("parent") != 0)
+		return 1;
+
+	if ((pid = fork ()) < 0)
+		return 1;
+	else if (pid == 0)
+	{
+		alarm (30);
+		_exit (allocate ("child"));
+	}
+
+	if (allocate ("parent") != 0 || waitpid (pid, &status, 0) != pid)
+		return 1;
+	if (WIFSIGNALED(status))
+	{
+		fprintf (stderr, "child killed by signal %d\n", WTERMSIG(status));
+		return 1;
+	}
+	if (WEXITSTATUS(status) != 0)
+		return 1;
+
+	fprintf (stderr, "fork: done\n");
+	return 0;
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Allocates large objects, which FlexMalloc interleaves across two tiers
+// whose first one only has room for the part of one of them at a time, so
+// the second object is refused until the first has been freed, and a small
+// object, which goes to a single tier.
+
+#define MB (1 << 20)
+#define SIZE (64 * MB)
+
+int main (void)
+{
+	char *p, *q, *small;
+
+	if ((p = malloc (SIZE)) == NULL)
+		return 1;
+	memset (p, 1, SIZE);
+	if ((q = malloc (SIZE)) == NULL)
+		fprintf (stderr, "interleave: second object refused\n");
+	free (q);
+	free (p);
+
+	if ((p = malloc (SIZE)) == NULL || (small = malloc (MB)) == NULL)
+		return 1;
+	memset (p, 3, SIZE);
+	memset (small, 4, MB);
+	free (small);
+	free (p);
+
+	fprintf (stderr, "interleave: done\n");
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Moves a large object from the fallback allocator to the one of the
+// location of grow, given by the test through the offset of the realloc
+// call within grow, and grows it there once more. The contents must be
+// kept along the way.
+
+#define MB (1 << 20)
+
+void * grow (void *ptr, size_t size) __attribute__((noinline));
+
+void * grow (void *ptr, size_t size)
+{
+	return realloc (ptr, size);
+}
+
+static int check (const char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		if (p[i] != (char) (i / 4096))
+			return 1;
+	return 0;
+}
+
+static void fill (char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		p[i] = (char) (i / 4096);
+}
+
+int main (void)
+{
+	char *p = malloc (20 * MB);
+	if (p == NULL)
+		return 1;
+	fill (p, 20 * MB);
+
+	// Moved across allocators, and then grown in the new one
+	if ((p = grow (p, 24 * MB)) == NULL || check (p, 20 * MB) != 0)
+	{
+		fprintf (stderr, "moving the object failed\n");
+		return 1;
+	}
+	fill (p, 24 * MB);
+	if ((p = grow (p, 32 * MB)) == NULL || check (p, 24 * MB) != 0)
+	{
+		fprintf (stderr, "growing the moved object failed\n");
+		return 1;
+	}
+	free (p);
+
+	fprintf (stderr, "migrate: done\n");
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// Allocates, through the malloc call within place, one object of each size
+// given in MBytes, keeping them all alive until the end. The tests name that
+// call in their locations, through the offset of its return address within
+// place. The contents must be kept until the objects are freed.
+
+#define MB (1 << 20)
+
+void * place (size_t size) __attribute__((noinline));
+
+void * place (size_t size)
+{
+	return malloc (size);
+}
+
+static int check (const char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		if (p[i] != (char) (i / 4096))
+			return 1;
+	return 0;
+}
+
+static void fill (char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		p[i] = (char) (i / 4096);
+}
+
+int main (int argc, char *argv[])
+{
+	char *objects[argc];
+	int i;
+
+	for (i = 1; i < argc; ++i)
+	{
+		size_t size = strtoul (argv[i], NULL, 10) * MB;
+		if ((objects[i] = place (size)) == NULL)
+			return 1;
+		fill (objects[i], size);
+	}
+	for (i = 1; i < argc; ++i)
+	{
+		if (check (objects[i], strtoul (argv[i], NULL, 10) * MB) != 0)
+			return 1;
+		free (objects[i]);
+	}
+
+	fprintf (stderr, "place: done\n");
+	return 0;
+}
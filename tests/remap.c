@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// Grows an object from the libc heap across the mmap threshold of the posix
+// allocator (16 MBytes by default), which moves it into a mapping of its
+// own, and keeps growing it there, which remaps its pages instead of
+// copying them. The contents must be kept along the way.
+
+#define MB (1 << 20)
+
+static int check (const char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		if (p[i] != (char) (i / 4096))
+			return 1;
+	return 0;
+}
+
+static void fill (char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		p[i] = (char) (i / 4096);
+}
+
+int main (void)
+{
+	size_t sizes[] = { 8 * MB, 20 * MB, 40 * MB, 64 * MB };
+	unsigned u;
+	char *p = malloc (sizes[0]);
+	if (p == NULL)
+		return 1;
+	fill (p, sizes[0]);
+
+	for (u = 1; u < sizeof(sizes) / sizeof(sizes[0]); u++)
+	{
+		if ((p = realloc (p, sizes[u])) == NULL || check (p, sizes[u-1]) != 0)
+		{
+			fprintf (stderr, "growing to %zu MBytes failed\n", sizes[u] / MB);
+			return 1;
+		}
+		fill (p, sizes[u]);
+	}
+	free (p);
+
+	fprintf (stderr, "remap: done\n");
+	return 0;
+}
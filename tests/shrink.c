@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+// Shrinks objects by less than the shrink threshold of FlexMalloc (1 MByte
+// by default), which leaves them untouched, and by more, which gives the
+// memory past the new size back, both in the libc heap and in a mapping of
+// the posix allocator. The contents must be kept along the way.
+
+#define MB (1 << 20)
+
+static int check (const char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		if (p[i] != (char) (i / 4096))
+			return 1;
+	return 0;
+}
+
+static void fill (char *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i += 4096)
+		p[i] = (char) (i / 4096);
+}
+
+// Shrinks p to size, which must keep it in place if in_place is given, and
+// checks that its usable size becomes expected
+static char * shrink (char *p, size_t size, int in_place, size_t expected)
+{
+	char *res = realloc (p, size);
+	if (res == NULL || (in_place && res != p) || check (res, size) != 0 ||
+	    malloc_usable_size (res) != expected)
+	{
+		fprintf (stderr, "shrinking to %zu bytes failed\n", size);
+		exit (1);
+	}
+	return res;
+}
+
+int main (void)
+{
+	char *p = malloc (4 * MB);
+	if (p == NULL)
+		return 1;
+	fill (p, 4 * MB);
+	p = shrink (p, 4 * MB - MB / 2, 1, 4 * MB);
+	p = shrink (p, 1 * MB, 0, 1 * MB);
+	free (p);
+
+	p = malloc (64 * MB);
+	if (p == NULL)
+		return 1;
+	fill (p, 64 * MB);
+	p = shrink (p, 64 * MB - MB / 2, 1, 64 * MB);
+	p = shrink (p, 32 * MB, 1, 32 * MB);
+	p = shrink (p, 8 * MB, 0, 8 * MB);
+	free (p);
+
+	fprintf (stderr, "shrink: done\n");
+	return 0;
+}
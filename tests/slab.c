@@ -0,0 +1,71 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Allocates small objects in the main thread and frees them in another
+// one, which returns them to the slabs of the main thread through its
+// remote-free queue, and allocates again so that the queue is drained.
+
+#define NOBJECTS 4000
+
+static void *objects[NOBJECTS];
+
+static void * release (void *arg)
+{
+	int i;
+	for (i = 0; i < NOBJECTS; i++)
+	{
+		if (((char*) objects[i])[0] != (char) i)
+			return (void*) 1;
+		free (objects[i]);
+	}
+	return arg;
+}
+
+static int allocate (void)
+{
+	int i;
+	for (i = 0; i < NOBJECTS; i++)
+	{
+		size_t size = 16 + (i % 64) * 16;
+		if ((objects[i] = malloc (size)) == NULL)
+			return 1;
+		memset (objects[i], i, size);
+	}
+	return 0;
+}
+
+int main (void)
+{
+	pthread_t t;
+	void *res;
+	int round, i;
+
+	for (round = 0; round < 2; round++)
+	{
+		if (allocate () != 0)
+		{
+			fprintf (stderr, "allocation failed\n");
+			return 1;
+		}
+		if (pthread_create (&t, NULL, release, NULL) != 0 ||
+		    pthread_join (t, &res) != 0 || res != NULL)
+		{
+			fprintf (stderr, "remote free failed\n");
+			return 1;
+		}
+	}
+
+	// The objects of the last round are taken again from the queue
+	if (allocate () != 0)
+	{
+		fprintf (stderr, "allocation failed\n");
+		return 1;
+	}
+	for (i = 0; i < NOBJECTS; i++)
+		free (objects[i]);
+
+	fprintf (stderr, "slab: done\n");
+	return 0;
+}
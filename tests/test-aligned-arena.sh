@@ -0,0 +1,23 @@
+#!/bin/bash
+# Aligned and zero-sized objects give back to the numa arena all the capacity
+# they take, so that once they are freed the arena returns to the bytes in
+# use of a run of two rounds, which only keeps what the process allocates
+# for itself (e.g. when the unwinder is loaded to get the first callstack).
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+have_numa || skip "no NUMA node 0"
+
+for metadata in in-band out-of-band; do
+	FLEXMALLOC_METADATA=$metadata run numa-memory-configuration numa ./aligned-arena 2
+	succeeded
+	in_use=$(echo "$out" | sed -n 's/.*numa: Arena bound to node 0 .*, \([0-9]*\) bytes still in use.*/\1/p')
+	[ -n "$in_use" ] || fail "no arena statistics"
+
+	FLEXMALLOC_METADATA=$metadata run numa-memory-configuration numa ./aligned-arena 20000
+	succeeded
+	expect "aligned-arena: done"
+	expect "numa: Arena bound to node 0 .*, $in_use bytes still in use"
+	expect "numa: 0 allocations served through posix calls"
+done
+exit 0
@@ -0,0 +1,21 @@
+#!/bin/bash
+# Aligned objects are reallocated and freed with their header in front of
+# them or out of band, and an address without a header is reported rather
+# than used when all the headers are out of band.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+for tier in posix numa; do
+	[ $tier = numa ] && ! have_numa && continue
+	for metadata in in-band out-of-band; do
+		FLEXMALLOC_METADATA=$metadata run numa-memory-configuration $tier ./aligned-realloc
+		succeeded
+		expect "aligned-realloc: done"
+	done
+done
+
+FLEXMALLOC_METADATA=out-of-band run numa-memory-configuration posix ./aligned-realloc invalid
+[ $status -ne 0 ] || fail "freeing an invalid pointer did not abort"
+expect "aligned-realloc: done"
+expect "Invalid pointer .*, not allocated or already freed"
+exit 0
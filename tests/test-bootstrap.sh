@@ -0,0 +1,16 @@
+#!/bin/bash
+# Objects allocated before FlexMalloc is initialized, by the constructor of
+# a library the program depends on, come from the bootstrap arena and are
+# freed, shrunk and grown by the program once FlexMalloc runs.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+run numa-memory-configuration posix ./bootstrap
+succeeded
+expect "bootstrap: done"
+expect "Bootstrap arena: [0-9]* objects ([1-9][0-9]* freed and [1-9][0-9]* grown in place)"
+
+# The 1 MByte object of the constructor is in the arena
+in_use=$(echo "$out" | sed -n 's/.*Bootstrap arena: .*, \([0-9]*\) KBytes in use.*/\1/p')
+[ -n "$in_use" ] && [ $in_use -ge 1024 ] || fail "early objects not in the bootstrap arena"
+exit 0
@@ -0,0 +1,28 @@
+#!/bin/bash
+# The objects of a location that do not fit in its allocator go to the next
+# allocator of its chain rather than to the fallback one: the second object
+# of 32 MBytes no longer fits in the numa tier and goes to posix, while the
+# fallback slab allocator forwards no large object. The location reports the
+# hits and misses of each allocator of the chain.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+have_numa || skip "no NUMA node 0"
+type objdump nm > /dev/null 2>&1 || skip "objdump or nm not available"
+
+config=$PWD/chain-test-configuration
+locations=$PWD/chain-locations
+trap "rm -f $config $locations" EXIT
+definitions $config numa "Size 64 MBytes Nodes 0 Policy bind"
+printf "# Memory configuration for allocator slab\nSize 64 MBytes @ posix\n" >> $config
+location=$(call_location ./place place malloc) || skip "cannot find the malloc call in place"
+echo "$location @ numa > posix" > $locations
+
+run $config slab ./place 32 32 8
+succeeded
+expect "place: done"
+expect "3 matches and 1 not fit"
+expect "Then allocator 'posix': 1 fit and 0 not fit"
+expect "posix: 1 objects mapped on their own"
+expect "slab: .* 0 objects forwarded to posix"
+exit 0
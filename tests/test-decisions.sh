@@ -0,0 +1,32 @@
+#!/bin/bash
+# The decisions taken for the callstacks are saved at exit and preloaded by
+# the next run with the same locations file. Those of another locations
+# file are ignored.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+locations=$PWD/decisions-locations
+decisions=$PWD/decisions
+trap "rm -f $locations $decisions" EXIT
+cp $srcdir/malloc+free-locations $locations
+rm -f $decisions
+export FLEXMALLOC_DECISIONS_FILE=$decisions
+
+run base-memory-configuration posix ./aligned-realloc
+succeeded
+expect "Decisions file $decisions does not exist yet"
+expect "Saved [1-9][0-9]* decisions into $decisions"
+grep -q "^decision " $decisions || fail "no decision saved"
+
+run base-memory-configuration posix ./aligned-realloc
+succeeded
+expect "Preloaded [1-9][0-9]* decisions from $decisions (0 ignored)"
+expect "Decisions: [0-9]* known ([1-9][0-9]* preloaded), [1-9][0-9]* hits"
+
+# A changed locations file invalidates the decisions
+echo "# changed" >> $locations
+run base-memory-configuration posix ./aligned-realloc
+succeeded
+expect "Decisions file $decisions was generated for another locations file. Ignoring it."
+expect "Preloaded 0 decisions"
+exit 0
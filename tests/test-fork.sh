@@ -0,0 +1,21 @@
+#!/bin/bash
+# A child forked while the pre-faulting threads run has none of them, and
+# pre-faults its objects by itself rather than waiting for them. Likewise,
+# it symbolizes its callstacks by itself when the parent did it
+# asynchronously.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+FLEXMALLOC_PREFAULT=local FLEXMALLOC_PREFAULT_THRESHOLD=1048576 \
+  run numa-memory-configuration posix ./fork
+succeeded
+expect "Objects will be pre-faulted by"
+expect "Pre-faulting: 2 objects"
+expect "fork: done"
+
+locations=$srcdir/malloc+free-locations FLEXMALLOC_ASYNC_SYMBOLIZATION=yes \
+  run numa-memory-configuration posix ./fork
+succeeded
+expect "Callstacks will be symbolized asynchronously"
+expect "fork: done"
+exit 0
@@ -0,0 +1,49 @@
+#!/bin/bash
+# The configuration of the hugetlb tier is checked when FlexMalloc starts,
+# and when the pool of huge pages cannot hold the tier its objects are
+# still served, through posix calls.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+config=$PWD/hugetlb-test-configuration
+trap "rm -f $config" EXIT
+
+invalid ()
+{
+	definitions $config hugetlb "$1"
+	run $config posix ./aligned-realloc
+	[ $status -ne 0 ] || fail "configuration '$1' was accepted"
+	expect "$2"
+}
+
+invalid "Size 64 MBytes Pages 4M" "hugetlb: Invalid page size. Available"
+invalid "Size 64 MBytes 2M" "hugetlb: Invalid page size specification"
+invalid "Size 64 KBytes" "hugetlb: Invalid size suffix"
+invalid "Size MBytes" "hugetlb: Could not parse given size"
+invalid "Pages 2M" "hugetlb: Wrong configuration for the allocator"
+
+pool=/sys/kernel/mm/hugepages
+[ -d $pool ] || skip "no hugetlb support in the kernel"
+
+for pages in 2M 1G; do
+	case $pages in
+		2M) dir=$pool/hugepages-2048kB size=64 ;;
+		1G) dir=$pool/hugepages-1048576kB size=1024 ;;
+	esac
+	[ -d $dir ] || continue
+
+	definitions $config hugetlb "Size $size MBytes Pages $pages"
+	run $config hugetlb ./aligned-realloc
+	succeeded
+	expect "aligned-realloc: done"
+	# The pool may have changed in between, so either outcome is checked
+	# as a whole
+	if echo "$out" | grep -q "hugetlb: Reserved $size MBytes"; then
+		expect "hugetlb: 0 allocations served through posix calls"
+	else
+		expect "hugetlb: Warning! Could not reserve $size MBytes of"
+		expect "Allocations will be served by the fallback allocator"
+		reject "hugetlb: 0 allocations served through posix calls"
+	fi
+done
+exit 0
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Large objects are interleaved across the numa and posix tiers following
+# their weights, and each tier is charged for its part: the numa tier has
+# room for the part of a single object, so a second one is refused until the
+# first is freed. Small objects go to the tier with the largest weight.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+have_numa || skip "no NUMA node 0"
+
+config=$PWD/interleave-test-configuration
+trap "rm -f $config" EXIT
+
+definitions $config numa "Size 64 MBytes Nodes 0 Policy bind"
+printf "# Memory configuration for allocator interleave\nSize 1024 MBytes @ numa 3 @ posix\n" >> $config
+
+run $config interleave ./interleave
+succeeded
+expect "interleave: second object refused"
+expect "interleave: done"
+expect "interleave: 2 objects interleaved, [1-9][0-9]* small objects placed in numa"
+expect "interleave: 96 MBytes placed in numa (weight 3)"
+expect "interleave: 32 MBytes placed in posix (weight 1)"
+exit 0
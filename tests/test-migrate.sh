@@ -0,0 +1,43 @@
+#!/bin/bash
+# An object that a realloc moves from the fallback allocator to the one of
+# its location takes the whole pages of its own mapping along, and keeps
+# growing on the new tier. The pages of the heap of the libc are copied
+# instead, by the helper threads if requested.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+have_numa || skip "no NUMA node 0"
+type objdump nm > /dev/null 2>&1 || skip "objdump or nm not available"
+
+# The location is the return address of the realloc call within grow
+call=$(objdump -d ./migrate | awk '/<grow>:/ { f = 1 } f && /call.*<realloc@plt>/ { print $1; exit }')
+next=$(objdump -d ./migrate | awk -v c="$call" 'f { print $1; exit } $1 == c { f = 1 }')
+start=$(nm ./migrate | awk '$3 == "grow" { print $1 }')
+[ -n "$next" -a -n "$start" ] || skip "cannot find the realloc call in grow"
+locations=$PWD/migrate-locations
+printf "%s!grow+%x @ numa\n" "$PWD/migrate" $(( 0x${next%:} - 0x$start )) > $locations
+
+run numa-memory-configuration posix ./migrate
+succeeded
+expect "migrate: done"
+expect "split: 1 objects migrated"
+expect "HWM (in req. allocator / in fallback allocator): 32 / 0 Mbytes"
+
+FLEXMALLOC_MMAP_THRESHOLD=0 run numa-memory-configuration posix ./migrate
+succeeded
+expect "migrate: done"
+reject "objects migrated"
+expect "Copies from posix to numa: 1 objects"
+
+# The copy is split with the helper threads, when there are CPUs for them
+FLEXMALLOC_MMAP_THRESHOLD=0 FLEXMALLOC_COPY_THREADS=2 FLEXMALLOC_COPY_THRESHOLD=1048576 \
+  run numa-memory-configuration posix ./migrate
+succeeded
+expect "migrate: done"
+expect "Copies from posix to numa: 1 objects"
+if [ $(getconf _NPROCESSORS_ONLN) -gt 1 ]; then
+	expect "Large cross-tier copies will be done by [23] threads"
+fi
+
+rm -f $locations
+exit 0
@@ -0,0 +1,48 @@
+#!/bin/bash
+# The configuration of the numa tier is checked when FlexMalloc starts, the
+# nodes missing in the machine are skipped and the policies that need
+# several nodes still serve the objects with a single one.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+config=$PWD/numa-test-configuration
+trap "rm -f $config" EXIT
+
+invalid ()
+{
+	definitions $config numa "$1"
+	run $config posix ./aligned-realloc
+	[ $status -ne 0 ] || fail "configuration '$1' was accepted"
+	expect "$2"
+}
+
+invalid "Size 64 MBytes" "numa: Invalid node list"
+invalid "Size 64 MBytes Nodes 2-1" "numa: Invalid node list"
+invalid "Size 64 MBytes Nodes 64" "numa: Invalid node list"
+invalid "Size 64 MBytes Nodes 0 Policy local" "numa: Invalid policy. Available"
+invalid "Size 64 MBytes Nodes 0 Policy weighted-interleave Weights 1,2" "numa: Invalid weights. Give"
+invalid "Size 64 MBytes Nodes 0 Policy weighted-interleave Weights 0" "numa: Invalid weights. Give"
+invalid "Size 64 KBytes Nodes 0" "numa: Invalid size suffix"
+invalid "Nodes 0" "numa: Wrong configuration for the allocator"
+
+have_numa || skip "no NUMA node 0"
+
+for policy in bind preferred interleave weighted-interleave preferred-many; do
+	definitions $config numa "Size 64 MBytes Nodes 0 Policy $policy"
+	run $config numa ./aligned-realloc
+	succeeded
+	expect "aligned-realloc: done"
+	expect "numa: 0 allocations served through posix calls"
+done
+
+# A node that the machine lacks is skipped with a warning
+missing=$(ls -d /sys/devices/system/node/node[0-9]* | wc -l)
+if [ ! -d /sys/devices/system/node/node$missing ]; then
+	definitions $config numa "Size 64 MBytes Nodes 0,$missing Policy bind"
+	run $config numa ./aligned-realloc
+	succeeded
+	expect "numa: Warning! Could not apply the memory policy to 64 MBytes on node $missing"
+	expect "numa: Arena bound to node 0"
+	expect "aligned-realloc: done"
+fi
+exit 0
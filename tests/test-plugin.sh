@@ -0,0 +1,35 @@
+#!/bin/bash
+# The example plugin is loaded from the memory definitions and serves the
+# objects of the tier it adds, and plugins that cannot be loaded are
+# reported at start-up.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+plugin=$PWD/.libs/example-plugin.so
+[ -f $plugin ] || skip "example plugin not built"
+
+config=$PWD/plugin-test-configuration
+trap "rm -f $config" EXIT
+
+printf "# Allocator plugin %s\n" $plugin > $config
+printf "# Memory configuration for allocator posix\nSize 4096 MBytes\n" >> $config
+printf "# Memory configuration for allocator example\nSize 64 MBytes\n" >> $config
+run $config example ./aligned-realloc
+succeeded
+expect "Loading allocator plugin $plugin"
+expect "\* example (Example plugin based on the libc)"
+expect "aligned-realloc: done"
+expect "example|Number of aligned malloc calls: [1-9]"
+expect "example|Number of realloc calls: [1-9]"
+expect "example: [0-9]* objects still alive"
+
+printf "# Allocator plugin %s\n" $PWD/nonexistent.so > $config
+run $config posix ./aligned-realloc
+[ $status -ne 0 ] || fail "a missing plugin was accepted"
+expect "Error! Could not load allocator plugin $PWD/nonexistent.so"
+
+printf "# Allocator plugin %s\n" $FLEXMALLOC_LIB > $config
+run $config posix ./aligned-realloc
+[ $status -ne 0 ] || fail "a library without plugin was accepted"
+expect "is not an allocator plugin"
+exit 0
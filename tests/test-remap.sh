@@ -0,0 +1,17 @@
+#!/bin/bash
+# A posix object that grows across the mmap threshold moves once into a
+# mapping of its own, and then grows through mremap without copying its
+# contents. Without a threshold, every object stays in the libc heap.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+run numa-memory-configuration posix ./remap
+succeeded
+expect "remap: done"
+expect "posix: 1 objects mapped on their own, 2 grown through mremap (60 MBytes not copied)"
+
+FLEXMALLOC_MMAP_THRESHOLD=0 run numa-memory-configuration posix ./remap
+succeeded
+expect "remap: done"
+reject "objects mapped on their own"
+exit 0
@@ -0,0 +1,16 @@
+#!/bin/bash
+# A realloc that shrinks an object by the shrink threshold or more gives the
+# memory past the new size back, which its usable size and the statistics
+# of the tier reflect, while smaller reductions leave the object untouched.
+# The checks on each object are done by the program.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+run numa-memory-configuration posix ./shrink
+succeeded
+expect "shrink: done"
+# 3 MBytes from the heap object and 32 MBytes from the mapped one, which
+# is then moved back to the heap
+expect "posix| - 2 realloc shrinking the object for a total of 36700160 released bytes"
+expect "posix: 1 objects mapped on their own"
+exit 0
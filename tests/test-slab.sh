@@ -0,0 +1,12 @@
+#!/bin/bash
+# Small objects freed by a thread other than the one that allocated them
+# go back to the slabs of their owner, which takes them again on its next
+# allocations instead of carving more memory from the backing tier.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+run slab-memory-configuration slab ./slab
+succeeded
+expect "slab: done"
+expect "slab: 1 chunks of 4 MBytes from posix, 1 thread caches, 8000 remote frees, 0 objects forwarded"
+exit 0
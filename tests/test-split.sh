@@ -0,0 +1,24 @@
+#!/bin/bash
+# An object of a location marked with split that does not fit in the
+# capacity of its allocator is split: its leading part is placed like the
+# numa tier, up to the capacity left, and the rest like the fallback one.
+# The location accounts both parts, its lead without the bytes in front of
+# the object.
+
+. ${srcdir:-.}/flexmalloc-test.sh
+
+have_numa || skip "no NUMA node 0"
+type objdump nm > /dev/null 2>&1 || skip "objdump or nm not available"
+
+locations=$PWD/split-locations
+trap "rm -f $locations" EXIT
+location=$(call_location ./place place malloc) || skip "cannot find the malloc call in place"
+echo "$location @ numa split" > $locations
+
+run numa-memory-configuration posix ./place 96
+succeeded
+expect "place: done"
+expect "split: 1 objects split with 64 MBytes on the requested allocators and 32 MBytes on the fallback, 0 objects could not be split"
+expect "HWM (in req. allocator / in fallback allocator): 63 / 32 Mbytes"
+expect "1 matches and 1 not fit"
+exit 0